@@ -78,6 +78,7 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_ID_USB_FLASH_MANAGER   42
 #define DEVICE_ID_VIRTUAL_SPEAKER_PIN 43
 #define DEVICE_ID_LOG                 44
+#define DEVICE_ID_SPECTRUM_ANALYZER   45
 
 // Suggested range for device-specific IDs: 50-79
 // NOTE - not final, just suggested currently.
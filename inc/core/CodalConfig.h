@@ -215,6 +215,18 @@ DEALINGS IN THE SOFTWARE.
 #define CODAL_PROVIDE_PRINTF           1
 #endif
 
+// ManagedBuffers of up to this many bytes are stored inside the ManagedBuffer itself rather than on the heap.
+// Such buffers are copied by value, so getBytes() of a small buffer is only valid for the lifetime of that instance.
+// Set to 0 (the default) to keep all buffer data on the heap, with reference semantics for every buffer.
+#ifndef CODAL_MANAGED_BUFFER_INLINE_SIZE
+#define CODAL_MANAGED_BUFFER_INLINE_SIZE      0
+#endif
+
+// The number of distinct strings that ManagedString::intern() can hold.
+#ifndef CODAL_MANAGED_STRING_INTERN_SIZE
+#define CODAL_MANAGED_STRING_INTERN_SIZE      16
+#endif
+
 //
 // Stream API global constants
 //
@@ -228,6 +240,12 @@ DEALINGS IN THE SOFTWARE.
   #define CODAL_STREAM_IDLE_TIMEOUT_MS   75
 #endif
 
+// When set to '1', stream components record per stage call counts, time spent, bytes processed and buffer ages.
+// See StreamTrace.h. This adds a timer read to every pull() and pullRequest(), so is disabled by default.
+#ifndef CODAL_STREAM_TRACE
+  #define CODAL_STREAM_TRACE             0
+#endif
+
 // During early CODAL development there was some misuse of `using namespace codal;` in header files.
 // Removing it from CODAL libs can cause targets to break unless they apply a large patch like:
 // https://github.com/lancaster-university/codal-microbit-v2/pull/437
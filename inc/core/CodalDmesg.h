@@ -50,12 +50,15 @@ extern struct CodalLogStore codalLogStore;
   *
   * Supported format strings:
   *    %c - single character
-  *    %d - decimal number
+  *    %d - decimal number (also %i)
+  *    %u - unsigned decimal number
   *    %x - hexadecimal number (with 0x)
   *    %p - hexadecimal number padded with zeros (and with 0x)
   *    %X - hexadecimal number padded with zeros (and with 0x)
   *    %s - '\0'-terminated string
+  *    %f - floating point number, with 4 decimal places unless given (e.g. %2f or %.2f)
   *    %% - literal %
+  * Field widths and the '-' and '0' flags are also supported, see format_vprint() in CodalFormat.h.
   * Typically used via the DMESG() macro.
   *
   * @param format Format string
@@ -0,0 +1,140 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Number and string formatting shared by Serial::printf(), DMESG and ManagedString.
+  *
+  * All functions write into caller provided memory, and never allocate or use libm.
+  */
+
+#ifndef CODAL_FORMAT_H
+#define CODAL_FORMAT_H
+
+#include "CodalConfig.h"
+#include <stdarg.h>
+
+// Enables the legacy DMESG dialect in format_vprint():
+// hexadecimal values are upper case with a 0x prefix, %X and %p are padded to 8 digits,
+// a width given to %f without a precision is used as the precision, and %f defaults to 4 decimal places.
+#define CODAL_FORMAT_DMESG              0x01
+
+// Buffer sizes sufficient for the longest output of each of the number formatting functions, including the NULL terminator.
+#define CODAL_FORMAT_DECIMAL_SIZE       12
+#define CODAL_FORMAT_HEX_SIZE           9
+#define CODAL_FORMAT_FIXED_SIZE         22
+
+// The largest number of decimal places supported by format_fixed().
+#define CODAL_FORMAT_MAX_PRECISION      9
+
+namespace codal
+{
+    /**
+      * Receives the output of format_vprint().
+      *
+      * @param context The context pointer given to format_vprint().
+      * @param data The characters to output. This is not NULL terminated.
+      * @param length The number of characters to output.
+      */
+    typedef void (*FormatWriter)(void *context, const char *data, int length);
+
+    /**
+      * Writes the decimal representation of an unsigned integer.
+      *
+      * @param buffer Where to write the NULL terminated result. Must hold at least CODAL_FORMAT_DECIMAL_SIZE bytes.
+      * @param value The number to convert.
+      *
+      * @return the number of characters written, excluding the NULL terminator.
+      */
+    int format_unsigned(char *buffer, uint32_t value);
+
+    /**
+      * Writes the decimal representation of a signed integer.
+      *
+      * @param buffer Where to write the NULL terminated result. Must hold at least CODAL_FORMAT_DECIMAL_SIZE bytes.
+      * @param value The number to convert.
+      *
+      * @return the number of characters written, excluding the NULL terminator.
+      */
+    int format_decimal(char *buffer, int32_t value);
+
+    /**
+      * Writes the hexadecimal representation of an unsigned integer, without any prefix.
+      *
+      * @param buffer Where to write the NULL terminated result. Must hold at least CODAL_FORMAT_HEX_SIZE bytes.
+      * @param value The number to convert.
+      * @param digits The minimum number of digits to write, padding with leading zeros (at most 8).
+      * @param upperCase true to use the digits A-F, false to use a-f.
+      *
+      * @return the number of characters written, excluding the NULL terminator.
+      */
+    int format_hex(char *buffer, uint32_t value, int digits = 1, bool upperCase = false);
+
+    /**
+      * Writes a floating point number in fixed point notation, rounded to the given number of decimal places.
+      * Values of magnitude 2^32 or more are written as "ovf", in addition to "inf" and "nan".
+      *
+      * @param buffer Where to write the NULL terminated result. Must hold at least CODAL_FORMAT_FIXED_SIZE bytes.
+      * @param value The number to convert.
+      * @param precision The number of decimal places, between 0 and CODAL_FORMAT_MAX_PRECISION.
+      *
+      * @return the number of characters written, excluding the NULL terminator.
+      */
+    int format_fixed(char *buffer, double value, int precision);
+
+    /**
+      * Formats a printf style string, passing the output to the given writer in as few calls as possible.
+      *
+      * Supported conversions are %c, %d, %i, %u, %x, %X, %p, %s, %f and %%, with the '-' and '0' flags,
+      * a field width, and a precision (the number of decimal places for %f, or the maximum length for %s).
+      * The length modifiers h, l and z are accepted and ignored. Unknown conversions are written as "???".
+      *
+      * @param writer The function to receive the output.
+      * @param context A pointer passed to the writer.
+      * @param flags 0, or CODAL_FORMAT_DMESG to use the DMESG dialect.
+      * @param format The format string.
+      * @param ap The arguments to format.
+      *
+      * @return the total number of characters output.
+      */
+    int format_vprint(FormatWriter writer, void *context, int flags, const char *format, va_list ap);
+
+    /**
+      * Formats a printf style string into a buffer, as format_vprint().
+      * The output is truncated if necessary, and is always NULL terminated.
+      *
+      * @param buffer The buffer to write to.
+      * @param size The size of the buffer in bytes.
+      * @param format The format string.
+      *
+      * @return the number of characters written, excluding the NULL terminator.
+      *
+      * @code
+      * char line[32];
+      * format_string(line, sizeof(line), "x=%d y=%d t=%.2f", x, y, t);
+      * @endcode
+      */
+    int format_string(char *buffer, int size, const char *format, ...);
+}
+
+#endif
@@ -26,11 +26,18 @@ DEALINGS IN THE SOFTWARE.
 #define CODAL_SERIAL_H
 
 #include "ManagedString.h"
+#include "ManagedBuffer.h"
 #include "CodalComponent.h"
 #include "Pin.h"
 
 #define CODAL_SERIAL_DEFAULT_BAUD_RATE    115200
 #define CODAL_SERIAL_DEFAULT_BUFFER_SIZE  20
+#define CODAL_SERIAL_MAX_BUFFER_SIZE      32767
+
+// The number of ManagedBuffers that can be queued for transmission by reference. Must be a power of two.
+#ifndef CODAL_SERIAL_TX_QUEUE_SIZE
+#define CODAL_SERIAL_TX_QUEUE_SIZE        4
+#endif
 
 #define CODAL_SERIAL_EVT_DELIM_MATCH      1
 #define CODAL_SERIAL_EVT_HEAD_MATCH       2
@@ -60,6 +67,18 @@ namespace codal
         TxInterrupt
     };
 
+    /**
+      * A ManagedBuffer queued for transmission, along with how much of it has been sent.
+      * The buffer is sent once the txBuff tail reaches mark, so that it is interleaved
+      * in order with any bytes copied into the txBuff.
+      */
+    struct SerialTxBuffer
+    {
+        ManagedBuffer buffer;
+        uint16_t offset;
+        uint16_t mark;
+    };
+
     /**
       * Class definition for DeviceSerial.
       *
@@ -81,16 +100,39 @@ namespace codal
         //a variable used when a user calls the eventAfter() method.
         int rxBuffHeadMatch;
 
+        //a bitmap of the delimeters being tracked by readUntil(), indexed by character.
+        uint32_t delimeterMap[8];
+
+        //a bitmap of the delimeters set by eventOn(), indexed by character.
+        uint32_t eventDelimeterMap[8];
+
+        //the position in rxBuff of the most recently received delimeter, or -1 if there is none.
+        volatile int rxBuffDelimMatch;
+
+        //set while readUntil() is sleeping, so a match with delimeterMap also raises CODAL_SERIAL_EVT_DELIM_MATCH.
+        volatile bool rxBuffDelimWait;
+
+        // Ring buffers are a power of two in size, so indices wrap with a mask. One byte is always left unused.
         uint8_t *rxBuff;
-        uint8_t rxBuffSize;
+        uint16_t rxBuffSize;
         volatile uint16_t rxBuffHead;
         uint16_t rxBuffTail;
 
         uint8_t *txBuff;
-        uint8_t txBuffSize;
+        uint16_t txBuffSize;
         uint16_t txBuffHead;
         volatile uint16_t txBuffTail;
 
+        // Buffers queued for transmission by reference. Indices are free running, and taken modulo CODAL_SERIAL_TX_QUEUE_SIZE.
+        // Slots from txQueueFree up to txQueueTail have been sent, but not yet released.
+        SerialTxBuffer txQueue[CODAL_SERIAL_TX_QUEUE_SIZE];
+        volatile uint8_t txQueueHead;
+        volatile uint8_t txQueueTail;
+        uint8_t txQueueFree;
+
+        // The number of received bytes dropped because rxBuff was full.
+        volatile uint32_t rxOverflowCount;
+
         uint32_t baudrate;
 
         /**
@@ -113,10 +155,51 @@ namespace codal
          */
         int initialiseTx();
 
-        void circularCopy(uint8_t *circularBuff, uint8_t circularBuffSize, uint8_t *linearBuff, uint16_t tailPosition, uint16_t headPosition);
+        void circularCopy(uint8_t *circularBuff, uint16_t circularBuffSize, uint8_t *linearBuff, uint16_t tailPosition, uint16_t headPosition);
+
+        /**
+         * Copies up to len bytes from rxBuff into the given buffer, and consumes them.
+         *
+         * @return the number of bytes copied.
+         */
+        int rxCopy(uint8_t *buffer, int len);
+
+        /**
+         * Rebuilds the bitmap of delimeters tracked by our receive interrupt for readUntil(), if they have changed.
+         *
+         * @return true if the delimeters have changed.
+         */
+        bool setDelimeterMap(ManagedString delimeters);
+
+        /**
+         * Finds the first delimeter in the rxBuff, without consuming any data.
+         *
+         * @param searchAll if true, search the whole buffer, rather than relying on the position recorded by our receive interrupt.
+         *
+         * @return the index of the first delimeter in rxBuff, or -1 if there is none.
+         */
+        int findDelimeter(bool searchAll);
 
         int setTxInterrupt(uint8_t *string, int len, SerialMode mode);
 
+        /**
+         * Queues a ManagedBuffer for transmission without copying it. If the queue is full, ASYNC mode
+         * falls back to copying what will fit into the txBuff, and the other modes wait for the queue to drain.
+         *
+         * @return the number of bytes queued.
+         */
+        int queueTxBuffer(ManagedBuffer buffer, SerialMode mode);
+
+        /**
+         * Releases our references to any queued buffers that have been transmitted.
+         */
+        void releaseTxBuffers();
+
+        /**
+         * Discards any queued buffers that have not yet been transmitted.
+         */
+        void discardTxBuffers();
+
         public:
 
         void dataTransmitted();
@@ -138,9 +221,9 @@ namespace codal
           *
           * @param rx the Pin to be used for receiving data
           *
-          * @param rxBufferSize the size of the buffer to be used for receiving bytes
+          * @param rxBufferSize the size of the buffer to be used for receiving bytes, up to CODAL_SERIAL_MAX_BUFFER_SIZE
           *
-          * @param txBufferSize the size of the buffer to be used for transmitting bytes
+          * @param txBufferSize the size of the buffer to be used for transmitting bytes, up to CODAL_SERIAL_MAX_BUFFER_SIZE
           *
           * @code
           * DeviceSerial serial(USBTX, USBRX);
@@ -148,8 +231,9 @@ namespace codal
           * @note the default baud rate is 115200.
           *
           *       Buffers aren't allocated until the first send or receive respectively.
+          *       Buffer sizes are rounded up, so that the underlying ring buffers are a power of two in size.
           */
-        Serial(Pin& tx, Pin& rx, uint8_t rxBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint8_t txBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t id  = DEVICE_ID_SERIAL);
+        Serial(Pin& tx, Pin& rx, uint16_t rxBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t txBufferSize = CODAL_SERIAL_DEFAULT_BUFFER_SIZE, uint16_t id  = DEVICE_ID_SERIAL);
 
         /**
           * Sends a single character over the serial line.
@@ -240,6 +324,53 @@ namespace codal
           */
         int send(uint8_t *buffer, int bufferLen, SerialMode mode = DEVICE_DEFAULT_SERIAL_MODE);
 
+        /**
+          * Sends a ManagedBuffer over the serial line, without copying it into the txBuff.
+          * A reference to the buffer is held until it has been transmitted, so the caller
+          * may release its own reference as soon as this method returns.
+          *
+          * @param buffer the buffer to send
+          *
+          * @param mode the selected mode, one of: ASYNC, SYNC_SPINWAIT, SYNC_SLEEP. Each mode
+          *        gives a different behaviour:
+          *
+          *            ASYNC - the buffer is queued and this method returns immediately.
+          *                    If CODAL_SERIAL_TX_QUEUE_SIZE buffers are already queued, as
+          *                    much of the buffer as will fit is copied into the txBuff instead.
+          *
+          *            SYNC_SPINWAIT - the buffer is queued and this method will spin
+          *                            (lock up the processor) until it has been sent.
+          *
+          *            SYNC_SLEEP - the buffer is queued and the fiber sleeps until it
+          *                         has been sent. This allows other fibers to continue execution.
+          *
+          *         Defaults to SYNC_SLEEP.
+          *
+          * @return the number of bytes queued, CODAL_SERIAL_IN_USE if another fiber
+          *         is using the serial instance for transmission, or DEVICE_INVALID_PARAMETER
+          *         if the buffer is empty.
+          *
+          * @note The contents of the buffer should not be modified until it has been sent.
+          */
+        int send(ManagedBuffer buffer, SerialMode mode = DEVICE_DEFAULT_SERIAL_MODE);
+
+        /**
+          * Sends a sequence of ManagedBuffers over the serial line as a single transmission,
+          * for example a protocol header followed by its payload. No other fiber can send
+          * between the buffers, and none of them are copied unless the transmit queue is full.
+          *
+          * @param buffers an array of the buffers to send, in order. Empty buffers are skipped.
+          *
+          * @param count the number of buffers in the array.
+          *
+          * @param mode the selected mode, one of: ASYNC, SYNC_SPINWAIT, SYNC_SLEEP, as for send(ManagedBuffer).
+          *
+          * @return the total number of bytes queued, CODAL_SERIAL_IN_USE if another fiber
+          *         is using the serial instance for transmission, or DEVICE_INVALID_PARAMETER
+          *         if buffers is NULL, or count is <= 0.
+          */
+        int send(ManagedBuffer *buffers, int count, SerialMode mode = DEVICE_DEFAULT_SERIAL_MODE);
+
         /**
           * Reads a single character from the rxBuff
           *
@@ -297,6 +428,19 @@ namespace codal
           */
         ManagedString read(int size, SerialMode mode = DEVICE_DEFAULT_SERIAL_MODE);
 
+        /**
+          * Reads multiple bytes from the rxBuff directly into a newly allocated ManagedBuffer,
+          * avoiding the intermediate copies made when reading into a ManagedString.
+          *
+          * @param size the number of bytes to read.
+          *
+          * @param mode the selected mode, one of: ASYNC, SYNC_SPINWAIT, SYNC_SLEEP, as for read(uint8_t*, int, SerialMode).
+          *
+          * @return A ManagedBuffer containing the bytes read, which may be shorter than size in ASYNC mode,
+          *         or an empty ManagedBuffer if no data was read or an error was encountered.
+          */
+        ManagedBuffer readBuffer(int size, SerialMode mode = DEVICE_DEFAULT_SERIAL_MODE);
+
         /**
           * Reads multiple characters from the rxBuff and fills a user buffer.
           *
@@ -449,22 +593,24 @@ namespace codal
         /**
           * Reconfigures the size of our rxBuff
           *
-          * @param size the new size for our rxBuff
+          * @param size the new size for our rxBuff, up to CODAL_SERIAL_MAX_BUFFER_SIZE.
+          *             This is rounded up, so that the underlying ring buffer is a power of two in size.
           *
           * @return CODAL_SERIAL_IN_USE if another fiber is currently using this instance
           *         for reception, otherwise DEVICE_OK.
           */
-        int setRxBufferSize(uint8_t size);
+        int setRxBufferSize(uint16_t size);
 
         /**
           * Reconfigures the size of our txBuff
           *
-          * @param size the new size for our txBuff
+          * @param size the new size for our txBuff, up to CODAL_SERIAL_MAX_BUFFER_SIZE.
+          *             This is rounded up, so that the underlying ring buffer is a power of two in size.
           *
           * @return CODAL_SERIAL_IN_USE if another fiber is currently using this instance
           *         for transmission, otherwise DEVICE_OK.
           */
-        int setTxBufferSize(uint8_t size);
+        int setTxBufferSize(uint16_t size);
 
         /**
           * The size of our rx buffer in bytes.
@@ -514,6 +660,13 @@ namespace codal
           */
         int txBufferedSize();
 
+        /**
+          * The number of received bytes that have been dropped because our rx buffer was full.
+          *
+          * @return The number of bytes dropped since this instance was created.
+          */
+        uint32_t getRxOverflowCount();
+
         /**
           * Determines if the serial bus is currently in use by another fiber for reception.
           *
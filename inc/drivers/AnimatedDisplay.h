@@ -27,6 +27,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include "Display.h"
 #include "BitmapFont.h"
+#include "PackedImage.h"
 
 /**
   * Event codes raised by a Display
@@ -109,11 +110,14 @@ namespace codal
         // The text being displayed.
         ManagedString scrollingText;
 
+        // The glyphs of scrollingText, rendered once side by side at 1 bit per pixel.
+        PackedImage scrollingGlyphs;
+
         // The index of the character currently being displayed.
         int16_t scrollingChar;
 
         // The number of pixels the current character has been shifted on the display.
-        int8_t scrollingPosition;
+        int16_t scrollingPosition;
 
         //
         // State for printString() method.
@@ -153,7 +157,7 @@ namespace codal
 
         /**
          * Internal scrollText update method.
-         * Shift the screen image by one pixel to the left. If necessary, paste in the next char.
+         * Shift the screen image by one pixel to the left, and bring in the next column of the rendered text.
          */
         void updateScrollText();
 
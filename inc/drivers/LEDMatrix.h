@@ -108,7 +108,7 @@ namespace codal
         int         width;                      // The physical width of the LED matrix, in pixels.
         int         height;                     // The physical height of the LED matrix, in pixels.
         int         rows;                       // The number of drive pins connected to LEDs.
-        int         columns;                    // The number of sink pins connected to the LEDs.
+        int         columns;                    // The number of sink pins connected to the LEDs (at most 32).
 
         Pin         **rowPins;                  // Array of pointers containing an ordered list of pins to drive.
         Pin         **columnPins;               // Array of pointers containing an ordered list of pins to sink.
@@ -126,10 +126,21 @@ namespace codal
         uint8_t strobeRow;
         uint8_t rotation;
         uint8_t mode;
-        uint8_t greyscaleBitMsk;
         uint8_t timingCount;
+        uint8_t greyscaleSteps;
+        bool columnsValid;
         int frameTimeout;
 
+        // For each row in turn, the index into the image of the pixel on each column, with the rotation applied.
+        uint16_t *pixelMap;
+
+        // The columns currently sinking current (i.e. lit), one bit per column.
+        uint32_t columnState;
+
+        // The column patterns for the current row, and how long to show each, for greyscale.
+        uint32_t greyscaleMasks[LED_MATRIX_GREYSCALE_BIT_DEPTH];
+        uint16_t greyscaleTimes[LED_MATRIX_GREYSCALE_BIT_DEPTH];
+
         //
         // State used by all animation routines.
         //
@@ -145,10 +156,26 @@ namespace codal
         void renderFinish();
 
         /**
-         * Event handler, called when a requested time has elapsed (used for brightness control).
+         * Event handler, called when a requested time has elapsed (used for brightness control and greyscale).
          */
         void onTimeoutEvent(Event);
 
+        /**
+         * Rebuilds the table mapping each LED to its pixel in the image, for the current rotation.
+         */
+        void buildPixelMap();
+
+        /**
+         * Moves on to the next row: turns off the current row, and returns the pixels of the next in the image.
+         */
+        const uint16_t *nextRow();
+
+        /**
+         * Sets the column pins to the given pattern, only writing those that change.
+         * @param mask The columns to light, one bit per column.
+         */
+        void writeColumns(uint32_t mask);
+
         /**
          * Translates a bit mask to a bit mask suitable for the nrf PORT0 and PORT1.
          * Brightness has two levels on, or off.
@@ -162,7 +189,8 @@ namespace codal
         void renderWithLightSense();
 
         /**
-         * Translates a bit mask into a timer interrupt that gives the appearence of greyscale.
+         * Lights the next row with bit angle modulation: each bit plane of the pixel values is shown
+         * in turn, for a time proportional to its weight, stepping through them on timer events.
          */
         void renderGreyscale();
 
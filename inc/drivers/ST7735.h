@@ -31,6 +31,17 @@ DEALINGS IN THE SOFTWARE.
 #include "ScreenIO.h"
 #include "CodalFiber.h"
 
+// The number of bytes of each image column covered by one hash, when detecting changed regions.
+#ifndef ST7735_CHANGE_BAND_BYTES
+#define ST7735_CHANGE_BAND_BYTES 16
+#endif
+
+// The number of calls to sendIndexedImageChanges() after which the whole image is sent anyway, so a
+// change hidden by a hash collision is not left on the screen.
+#ifndef ST7735_CHANGE_FULL_REFRESH
+#define ST7735_CHANGE_FULL_REFRESH 64
+#endif
+
 namespace codal
 {
 
@@ -60,6 +71,16 @@ protected:
     // and doesn't support 12 bit color
     bool double16;
 
+    // the window set by setAddrWindow(), restored after a partial update
+    int windowX, windowY, windowW, windowH;
+    bool partialWindow;
+
+    // hashes of each band of each column of the last image sent by sendIndexedImageChanges()
+    uint32_t *bandHashes;
+    unsigned hashWidth, hashHeight;
+    bool hashesValid;
+    unsigned changesSinceRefresh;
+
     void beginCS() { if (cs) cs->setDigitalValue(0); }
     void endCS() { if (cs) cs->setDigitalValue(1); }
     void setCommand() { dc->setDigitalValue(0); }
@@ -67,6 +88,9 @@ protected:
 
     void sendCmd(uint8_t *buf, int len);
     void sendCmdSeq(const uint8_t *buf);
+    unsigned expandWords(uint8_t *buf, unsigned numBytes);
+    unsigned expandBytes(uint8_t *buf, unsigned num);
+    unsigned expandChunk(uint8_t *buf);
     void sendWords(unsigned numBytes);
     void startTransfer(unsigned size);
     void sendBytes(unsigned num);
@@ -75,6 +99,10 @@ protected:
     void sendDone();
     static void sendColorsStep(ST7735 *st);
 
+    void writeAddrWindow(int x, int y, int w, int h);
+    int sendRegion(const uint8_t *src, unsigned width, unsigned height, uint32_t *palette, int x,
+                   int y, int w, int h);
+
 public:
     ST7735(ScreenIO &io, Pin &cs, Pin &dc);
     virtual int init();
@@ -96,6 +124,26 @@ public:
      * NULL if unchanged).
      */
     int sendIndexedImage(const uint8_t *src, unsigned width, unsigned height, uint32_t *palette);
+    /**
+     * Send only the given rectangle of a 4 bit indexed color image, in the same format as
+     * sendIndexedImage(). The rest of the screen is left as it is. The rectangle is widened to
+     * cover whole bytes of the image, i.e. an even number of rows.
+     */
+    int sendIndexedImageRegion(const uint8_t *src, unsigned width, unsigned height,
+                               uint32_t *palette, int x, int y, int w, int h);
+    /**
+     * Send only the parts of a 4 bit indexed color image that have changed since the last call.
+     * Changes are found by hashing bands of each column, and the rectangle bounding all the
+     * changes is sent. The whole image is sent on the first call, when the size changes, when a
+     * palette is given, after invalidate() or sendIndexedImage(), and every
+     * ST7735_CHANGE_FULL_REFRESH calls.
+     */
+    int sendIndexedImageChanges(const uint8_t *src, unsigned width, unsigned height,
+                                uint32_t *palette);
+    /**
+     * Make the next sendIndexedImageChanges() send the whole image.
+     */
+    void invalidate() { hashesValid = false; }
     /**
      * Waits for the previous sendIndexedImage() operation to complete (it normally executes in
      * background).
@@ -0,0 +1,228 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+#ifndef ADPCM_SOURCE_H
+#define ADPCM_SOURCE_H
+
+// Default size of an IMA-ADPCM block, in bytes. 256 byte blocks hold 505 samples.
+#ifndef CONFIG_ADPCM_SOURCE_DEFAULT_BLOCK_SIZE
+#define CONFIG_ADPCM_SOURCE_DEFAULT_BLOCK_SIZE      256
+#endif
+
+#define ADPCM_SOURCE_DEFAULT_MAX_BUFFER             1024
+#define ADPCM_BLOCK_HEADER_SIZE                     4
+
+// The number of samples held in an IMA-ADPCM block of the given size, in bytes.
+#define ADPCM_SAMPLES_PER_BLOCK(x)                  (1 + ((x) - ADPCM_BLOCK_HEADER_SIZE) * 2)
+
+// Set in the reserved fourth header byte of a (final) block holding an even number of samples, whose last nibble is padding.
+#define ADPCM_BLOCK_FLAG_PADDED                     0x01
+
+/**
+ * A DataSource that streams mono IMA-ADPCM encoded audio from memory across the Stream APIs.
+ *
+ * Data is a sequence of blocks, laid out as in a mono IMA-ADPCM WAV file: each block begins with a four byte header
+ * holding the first sample (int16_t, little endian) and the initial step index, followed by 4 bit codes, low nibble first.
+ * ADPCM uses a quarter of the storage of 16 bit PCM, and blocks are decoded directly into output buffers.
+ */
+namespace codal
+{
+    class AdpcmSource : public DataSource
+    {
+        private:
+        int             outputFormat;           // The format to output in.
+        int             outputBufferSize;       // The maximum size of an output buffer, in bytes.
+        int             blockSize;              // The size of an encoded block, in bytes.
+        float           sampleRate;             // The sample rate of the encoded data.
+
+        const uint8_t   *data;                  // The input data being played (immutable)
+        const uint8_t   *in;                    // The input data being played (mutable)
+        int             length;                 // The length of the input data (immutable)
+        int             bytesToSend;            // The length of the input data (mutable)
+        int             count;                  // The number of times left to repeat
+
+        DataSink        *downstream;            // Pointer to our downstream component
+        bool            blockingPlayout;        // Set to true if a blocking playout has been requested
+        FiberLock       lock;                   // used to synchronise blocking play calls.
+
+        public:
+
+        /**
+         * Default Constructor.
+         */
+        AdpcmSource();
+
+        /**
+         * Provide the next available ManagedBuffer to our downstream caller, if available.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         *  Determine the data format of the buffers streamed out of this component.
+         */
+        virtual int getFormat();
+
+        /**
+         * Defines the data format of the buffers streamed out of this component.
+         * @param format valid values include:
+         *
+         * DATASTREAM_FORMAT_8BIT_UNSIGNED
+         * DATASTREAM_FORMAT_8BIT_SIGNED
+         * DATASTREAM_FORMAT_16BIT_UNSIGNED
+         * DATASTREAM_FORMAT_16BIT_SIGNED (default)
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        virtual int setFormat(int format);
+
+        /**
+         * Determine the sample rate of the data being streamed.
+         * @return the sample rate defined by setSampleRate(), or DATASTREAM_SAMPLE_RATE_UNKNOWN.
+         */
+        virtual float getSampleRate();
+
+        /**
+         * Defines the sample rate of the encoded data.
+         * @param sampleRate The sample rate, in Hz.
+         * @return DEVICE_OK on success.
+         */
+        int setSampleRate(float sampleRate);
+
+        /*
+         * Allow out downstream component to register itself with us
+         */
+        virtual void connect(DataSink &sink);
+
+        /**
+         * Determines if this source is connected to a downstream component
+         *
+         * @return true If a downstream is connected
+         * @return false If a downstream is not connected
+         */
+        virtual bool isConnected();
+
+        /**
+         *  Determine the maximum size of the buffers streamed out of this component.
+         *  @return The maximum size of this component's output buffers, in bytes.
+         */
+        int getBufferSize();
+
+        /**
+         *  Defines the maximum size of the buffers streamed out of this component.
+         *  Buffers always hold a whole number of decoded blocks, so at least one block is decoded for each buffer.
+         *  @param size the size of this component's output buffers, in bytes.
+         */
+        int setBufferSize(int size);
+
+        /**
+         * Determine the size of the encoded blocks being played.
+         * @return The block size, in bytes.
+         */
+        int getBlockSize();
+
+        /**
+         * Defines the size of the encoded blocks to be played. This must match the block size used by the encoder.
+         * @param size The block size, in bytes. Must be greater than ADPCM_BLOCK_HEADER_SIZE.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setBlockSize(int size);
+
+        /**
+         * Perform a blocking playout of the encoded data. Returns when all the data has been queued.
+         * @param data pointer to the encoded data to playout
+         * @param length the length of the encoded data, in bytes.
+         * @param count if set, playback the data the given number of times. Defaults to 1. Set to a negative number to loop forever.
+         */
+        void play(const void *data, int length, int count = 1);
+
+        /**
+         * Perform a blocking playout of the encoded data. Returns when all the data has been queued.
+         * @param b the buffer of encoded data to playout
+         * @param count if set, playback the data the given number of times. Defaults to 1. Set to a negative number to loop forever.
+         */
+        void play(ManagedBuffer b, int count = 1);
+
+        /**
+         * Perform a non-blocking playout of the encoded data.
+         * @param data pointer to the encoded data to playout
+         * @param length the length of the encoded data, in bytes.
+         * @param count if set, playback the data the given number of times. Defaults to 1. Set to a negative number to loop forever.
+         */
+        void playAsync(const void *data, int length, int count = 1);
+
+        /**
+         * Perform a non-blocking playout of the encoded data.
+         * @param b the buffer of encoded data to playout
+         * @param count if set, playback the data the given number of times. Defaults to 1. Set to a negative number to loop forever.
+         */
+        void playAsync(ManagedBuffer b, int count = 1);
+
+        /**
+         * Decodes a single IMA-ADPCM block.
+         *
+         * @param block The encoded block.
+         * @param length The length of the block, in bytes. Blocks shorter than the block size (at the end of a stream) are permitted.
+         * @param out Buffer to receive blockSamples(block, length) samples.
+         * @return The number of samples decoded.
+         */
+        static int decode(const uint8_t *block, int length, int16_t *out);
+
+        /**
+         * Determines the number of samples held in a single IMA-ADPCM block.
+         *
+         * @param block The encoded block.
+         * @param length The length of the block, in bytes.
+         * @return ADPCM_SAMPLES_PER_BLOCK(length), less one if the last nibble of the block is padding.
+         */
+        static int blockSamples(const uint8_t *block, int length);
+
+        /**
+         * Encodes 16 bit PCM samples as a sequence of IMA-ADPCM blocks suitable for playback with this class.
+         * Useful to compress audio recorded on the device, or to generate assets.
+         *
+         * @param samples The samples to encode.
+         * @param sampleCount The number of samples to encode.
+         * @param out Buffer to receive the encoded blocks. Must be at least encodedLength(sampleCount, blockSize) bytes.
+         * @param blockSize The size of each encoded block, in bytes.
+         * @return The number of bytes written, or DEVICE_INVALID_PARAMETER.
+         */
+        static int encode(const int16_t *samples, int sampleCount, uint8_t *out, int blockSize = CONFIG_ADPCM_SOURCE_DEFAULT_BLOCK_SIZE);
+
+        /**
+         * Determines the number of bytes needed to encode the given number of samples.
+         *
+         * @param sampleCount The number of samples to encode.
+         * @param blockSize The size of each encoded block, in bytes.
+         * @return The encoded length, in bytes.
+         */
+        static int encodedLength(int sampleCount, int blockSize = CONFIG_ADPCM_SOURCE_DEFAULT_BLOCK_SIZE);
+
+        private:
+        void _play(const void *data, int length, int count, bool mode);
+    };
+}
+#endif
@@ -0,0 +1,225 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef DMA_SINGLE_WIRE_STREAM_H
+#define DMA_SINGLE_WIRE_STREAM_H
+
+#include "ManagedBuffer.h"
+#include "DataStream.h"
+#include "DMASingleWireSerial.h"
+#include "CodalComponent.h"
+
+// The size of each receive buffer passed downstream, in bytes.
+#ifndef DMA_SINGLE_WIRE_STREAM_BUFFER_SIZE
+    #define DMA_SINGLE_WIRE_STREAM_BUFFER_SIZE      256
+#endif
+
+// The number of receive buffers: one being filled by DMA, and the rest waiting for the downstream component.
+// Must be a power of two, and at least two.
+#ifndef DMA_SINGLE_WIRE_STREAM_RX_BUFFERS
+    #define DMA_SINGLE_WIRE_STREAM_RX_BUFFERS       2
+#endif
+
+// The number of scheduler ticks without any new data, after which a partially filled receive buffer is passed downstream.
+#ifndef DMA_SINGLE_WIRE_STREAM_IDLE_TICKS
+    #define DMA_SINGLE_WIRE_STREAM_IDLE_TICKS       2
+#endif
+
+// The number of buffers that can be queued for transmission. Must be a power of two.
+#ifndef DMA_SINGLE_WIRE_STREAM_TX_QUEUE_SIZE
+    #define DMA_SINGLE_WIRE_STREAM_TX_QUEUE_SIZE    4
+#endif
+
+#define DMA_SINGLE_WIRE_STREAM_STATE_STOPPED        0
+#define DMA_SINGLE_WIRE_STREAM_STATE_RECEIVING      1
+#define DMA_SINGLE_WIRE_STREAM_STATE_TRANSMITTING   2
+
+namespace codal
+{
+    /**
+     * Streams data to and from a DMASingleWireSerial at line rate.
+     *
+     * Received data is captured by DMA into a ring of buffers: as soon as one buffer completes, DMA is restarted into the next,
+     * and the completed buffer is handed to the downstream DataSink as a ManagedBuffer, from fiber context.
+     * If the line goes idle part way through a buffer, the data received so far is handed on after DMA_SINGLE_WIRE_STREAM_IDLE_TICKS.
+     * Buffers to transmit are queued by reference and sent back to back by DMA, after which the line returns to receive mode.
+     * The CPU is only involved once per buffer, rather than once per byte.
+     *
+     * As the DMASingleWireSerial completion callback carries no context, only one DMASingleWireStream may be active at a time.
+     */
+    class DMASingleWireStream : public CodalComponent, public DataSource
+    {
+        private:
+        DMASingleWireSerial &serial;                                    // The serial port to stream through.
+        DataSink *downstream;                                           // Our downstream component.
+        volatile int state;                                             // STOPPED/RECEIVING/TRANSMITTING.
+
+        ManagedBuffer rxBuffers[DMA_SINGLE_WIRE_STREAM_RX_BUFFERS];     // Receive buffers. Indices are free running.
+        volatile uint8_t rxFill;                                        // Index of the buffer being filled by DMA.
+        uint8_t rxRead;                                                 // Index of the oldest buffer waiting to be pulled.
+        int rxLastCount;                                                // Bytes in the current buffer at the last scheduler tick.
+        uint8_t rxIdleTicks;                                            // Scheduler ticks since the current buffer last received data.
+
+        ManagedBuffer txQueue[DMA_SINGLE_WIRE_STREAM_TX_QUEUE_SIZE];    // Buffers waiting to be sent. Indices are free running.
+        volatile uint8_t txHead;                                        // Index of the next free slot.
+        volatile uint8_t txTail;                                        // Index of the buffer being sent.
+        uint8_t txFree;                                                 // Index of the oldest sent buffer not yet released.
+
+        volatile uint32_t overflowCount;                                // The number of receive buffers dropped as none were free.
+        volatile uint32_t errorCount;                                   // The number of transfers that failed.
+        uint16_t rxEvent;                                               // Event used to notify our downstream component in fiber context.
+        uint16_t txEvent;                                               // Event used to release transmitted buffers in fiber context.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param serial The serial port to stream through.
+         */
+        DMASingleWireStream(DMASingleWireSerial &serial);
+
+        /**
+         * Starts receiving data, and transmitting any queued buffers.
+         * Any other DMASingleWireStream that is active is stopped.
+         *
+         * @return DEVICE_OK on success.
+         */
+        int start();
+
+        /**
+         * Stops all DMA transfers. Any buffers queued for transmission are discarded, and any data received
+         * into the current buffer is lost.
+         */
+        void stop();
+
+        /**
+         * Queues a buffer for transmission. The buffer is sent by reference, so its contents should not be
+         * modified until it has been sent. Receiving is suspended while data is being transmitted.
+         *
+         * @param buffer The data to send.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the buffer is empty,
+         * or DEVICE_NO_RESOURCES if the transmit queue is full.
+         */
+        int send(ManagedBuffer buffer);
+
+        /**
+         * Determines the number of buffers queued for transmission, including the one being sent.
+         */
+        int getTxQueueLength();
+
+        /**
+         * Determines the number of received buffers dropped because the downstream component was not keeping up.
+         */
+        uint32_t getOverflowCount();
+
+        /**
+         * Determines the number of DMA transfers that completed with an error.
+         */
+        uint32_t getErrorCount();
+
+        /**
+         * Provide the next available received ManagedBuffer to our downstream caller, if available.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         * Allow our downstream component to register itself with us
+         */
+        virtual void connect(DataSink &sink);
+
+        /**
+         * Determines if this source is connected to a downstream component
+         */
+        virtual bool isConnected();
+
+        /**
+         * Disconnect our downstream component.
+         */
+        virtual void disconnect();
+
+        /**
+         * Determine the data format of the buffers streamed out of this component.
+         */
+        virtual int getFormat();
+
+        /**
+         * Determine the rate at which bytes are received at line rate, assuming 10 bits per byte.
+         */
+        virtual float getSampleRate();
+
+        /**
+         * Passes a partially filled receive buffer downstream once the line has been idle for DMA_SINGLE_WIRE_STREAM_IDLE_TICKS.
+         */
+        virtual void periodicCallback();
+
+        /**
+         * Handles completion of a DMA transfer. Called from interrupt context.
+         *
+         * @param event One of SWS_EVT_DATA_RECEIVED, SWS_EVT_DATA_SENT or SWS_EVT_ERROR.
+         */
+        void onDMAComplete(uint16_t event);
+
+        /**
+         * Destructor.
+         */
+        ~DMASingleWireStream();
+
+        private:
+
+        /**
+         * Starts a DMA receive into the current receive buffer.
+         */
+        void startReceive();
+
+        /**
+         * Hands the current receive buffer containing the given number of bytes downstream, and moves on to the next
+         * free buffer. If there is no free buffer, the data is dropped and the current buffer is reused.
+         */
+        void completeReceive(int length);
+
+        /**
+         * Stops receiving and starts transmitting the buffer at the tail of the transmit queue.
+         */
+        void startTransmit();
+
+        /**
+         * Issue a pull request to our downstream component, in fiber context.
+         */
+        void onRxEvent(Event);
+
+        /**
+         * Release our references to transmitted buffers, in fiber context.
+         */
+        void onTxEvent(Event);
+
+        /**
+         * Release our references to transmitted buffers.
+         */
+        void releaseTxBuffers();
+    };
+}
+
+#endif
@@ -28,6 +28,7 @@ DEALINGS IN THE SOFTWARE.
 #include "ManagedBuffer.h"
 #include "MessageBus.h"
 #include "CodalConfig.h"
+#include "StreamTrace.h"
 
 #define DATASTREAM_MAXIMUM_BUFFERS      1
 
@@ -94,6 +95,9 @@ namespace codal
             DataSink *downStream;
             DataSource &upStream;
 
+            // Per stage statistics, when CODAL_STREAM_TRACE is enabled.
+            CODAL_STREAM_TRACE_STAGE
+
              /**
              * Constructor.
              * Creates an empty DataSourceSink.
@@ -0,0 +1,217 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef FLASH_STREAM_RECORDING_H
+#define FLASH_STREAM_RECORDING_H
+
+#include "ManagedBuffer.h"
+#include "DataStream.h"
+#include "SPIFlash.h"
+#include "StreamRecording.h"
+
+// The size of the buffers passed downstream during playback.
+#ifndef CODAL_FLASH_STREAM_RECORDING_BUFFER_SIZE
+    #define CODAL_FLASH_STREAM_RECORDING_BUFFER_SIZE       256
+#endif
+
+// The number of upstream buffers that may be held in RAM while waiting to be written to flash.
+#ifndef CODAL_FLASH_STREAM_RECORDING_QUEUE_SIZE
+    #define CODAL_FLASH_STREAM_RECORDING_QUEUE_SIZE        4
+#endif
+
+namespace codal
+{
+    /**
+     * A StreamRecording that stores its data in SPI flash rather than RAM, allowing much longer recordings.
+     *
+     * Incoming buffers are queued and written to flash a page at a time by a background fiber, which also erases flash
+     * one row ahead of the write head. Playback is read back one buffer ahead of the downstream component.
+     * RAM use is bounded to the write queue, a single page and the prefetched buffer, regardless of the recording length.
+     *
+     * The recording itself is not persistent, and is lost on reset.
+     */
+    class FlashStreamRecording : public DataSourceSink
+    {
+        private:
+        SPIFlash &flash;                                    // The flash memory to record into.
+        uint32_t flashStart;                                // Address of the start of the flash area used, aligned to a small row.
+        uint32_t flashLength;                               // Length of the flash area used, in bytes.
+
+        uint32_t totalBufferLength;                         // Amount of data currently stored in this object.
+        int state;                                          // STOPPED/PLAYING/RECORDING.
+        uint32_t readOffset;                                // Offset into the recording, indicating the current point for playback.
+        uint32_t writeOffset;                               // Offset into the recording of the page currently being assembled.
+        uint32_t eraseOffset;                               // Offset into the recording of the first row not yet erased.
+
+        ManagedBuffer queue[CODAL_FLASH_STREAM_RECORDING_QUEUE_SIZE];   // Buffers received from upstream, waiting to be written.
+        volatile int queueHead;                             // Index of the oldest buffer in the queue.
+        volatile int queueLength;                           // Number of buffers in the queue.
+        uint32_t overflowCount;                             // Number of buffers dropped because the queue was full.
+
+        ManagedBuffer page;                                 // The page currently being assembled, while recording.
+        int pageLength;                                     // Number of bytes in the page currently being assembled.
+        ManagedBuffer prefetch;                             // The next buffer to play, read ahead of time.
+
+        uint16_t notifyEvent;                               // Event used to wake the background fiber.
+        bool workerActive;                                  // true if the background fiber is running.
+        bool flushPending;                                  // true if recording has stopped, but the final page has not yet been written.
+        FiberLock recordLock, playLock;                     // Indicates to synchronous recording threads when recording/playback is complete.
+
+        public:
+        /**
+         * @brief Construct a new Flash Stream Recording object
+         *
+         * @param source An upstream DataSource to connect to
+         * @param flash The flash memory to store recordings in
+         * @param start The address of the area of flash to use. Must be aligned to SPIFLASH_SMALL_ROW_SIZE.
+         * @param length The length of the area of flash to use, in bytes. Rounded down to a multiple of SPIFLASH_SMALL_ROW_SIZE.
+         */
+        FlashStreamRecording(DataSource &source, SPIFlash &flash, uint32_t start, uint32_t length);
+
+        virtual ManagedBuffer pull();
+        virtual int pullRequest();
+
+        /**
+         * @brief Calculate and return the length <b>in bytes</b> that this FlashStreamRecording represents
+         * @return int The length, in bytes.
+         */
+        int length();
+
+        /**
+         * @brief Calculate the recorded duration for this FlashStreamRecording.
+         *
+         * @param sampleRate The sample rate to calculate the duration for, in samples per second.
+         * @return The total duration of this FlashStreamRecording, based on the supplied sample rate, in seconds.
+         */
+        float duration( unsigned int sampleRate );
+
+        /**
+         * @brief Determine the number of upstream buffers dropped because flash could not be written quickly enough.
+         * @return The number of buffers dropped since recording began.
+         */
+        uint32_t getOverflowCount();
+
+        /**
+         * @brief Begin recording data from the connected upstream
+         *
+         * The FlashStreamRecording object is not already recording, it will stop any existing playback, erase its buffer, and start recording.
+         *
+         * Non-blocking, will return immediately.
+         *
+         * @return Returns DEVICE_OK on completion.
+         */
+        int recordAsync();
+
+        /**
+         * @brief Begin recording data from the connected upstream
+         *
+         * Blocking call, will deschedule the current fiber until the recording completes, and all data has been written to flash.
+         */
+        void record();
+
+        /**
+         * @brief Begin playing back the recorded data
+         *
+         * The FlashStreamRecording object will, if already recording; stop recording, rewind to the start of its buffer, and start playing.
+         *
+         * Non-blocking, will return immediately.
+         *
+         * @return Returns DEVICE_OK on completion.
+         */
+        int playAsync();
+
+        /**
+         * @brief Begin playing back the recorded data
+         *
+         * Blocking call, will deschedule the current fiber until the playback completes.
+         */
+        void play();
+
+        /**
+         * @brief Stop recording or playing the data stored in this FlashStreamRecording object.
+         *
+         * Any data received while recording is still written to flash.
+         *
+         * @return DEVICE_OK.
+         */
+        int stop();
+
+        /**
+         * @brief Erase the recording.
+         *
+         * Will also stop playback or recording, if either are active. Flash is erased lazily, as the next recording is made.
+         */
+        void erase();
+
+        /**
+         * @brief Checks if the object is playing back recorded data.
+         *
+         * @return True if playing back, else false if stopped or recording.
+         */
+        bool isPlaying();
+
+        /**
+         * @brief Checks if the object is recording new data.
+         *
+         * @return True if recording, else false if stopped or playing back.
+         */
+        bool isRecording();
+
+        /**
+         * @brief Checks if the object is stopped
+         *
+         * @return True if stopped, else false if recording or playing back.
+         */
+        bool isStopped();
+
+        /**
+         * Services the write queue, erase ahead and playback prefetch. Runs in a background fiber.
+         */
+        void process();
+
+        private:
+
+        /**
+         * Starts the background fiber, if it is not already running, and wakes it. Must be called from fiber context.
+         */
+        void wake();
+
+        /**
+         * Writes a buffer of recorded data to flash, a page at a time.
+         */
+        void write(ManagedBuffer buffer);
+
+        /**
+         * Writes the given page to flash, erasing the row it is in first if necessary.
+         */
+        int writePage(const uint8_t *data, int length);
+
+        /**
+         * Reads the next buffer of the recording from flash.
+         */
+        ManagedBuffer read();
+    };
+}
+
+#endif
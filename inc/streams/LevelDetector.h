@@ -62,6 +62,7 @@ namespace codal{
         int             sigma;              // Running total of the samples in the current window.
         bool            activated;          // Has this component been connected yet.
         uint64_t        timeout;            // The timestamp at which this component will cease actively sampling the data stream
+        CODAL_STREAM_TRACE_STAGE            // Per stage statistics, when CODAL_STREAM_TRACE is enabled.
 
 
         /**
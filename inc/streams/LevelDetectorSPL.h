@@ -85,7 +85,12 @@ DEALINGS IN THE SOFTWARE.
 #define LEVEL_DETECTOR_SPL_CLAP_MIN_QUIET_BLOCKS            20       // prevent very fast taps being registered as clap
 
 #define LEVEL_DETECTOR_SPL_TIMEOUT                          50      // Time in ms at which we request no further data.
-#define LEVEL_DETECTOR_SPL_OUTLIER_REJECTION                2       // Most extreme samples to reject in each packet.
+
+// The number of most extreme (lowest) samples to reject in each window, in the range 0..16.
+#ifndef LEVEL_DETECTOR_SPL_OUTLIER_REJECTION
+#define LEVEL_DETECTOR_SPL_OUTLIER_REJECTION                2
+#endif
+
 #define LEVEL_DETECTOR_SPL_NOISE_FLOOR                      40      // Noise level to reject in the microphone.
 
 
@@ -115,6 +120,13 @@ namespace codal{
         uint8_t         listenerCount;      // The total number of active listeners to this component.
         FiberLock       resourceLock;       // Fiberlock - used purely hold fibers requesting data before it is available.
         uint64_t        timestamp;          // Timestamp of the last time someone requesed data from this component.
+        int16_t         *window;            // Samples of a window that spans more than one buffer.
+        int             windowCapacity;     // The number of samples the window buffer can hold.
+        int             windowPosition;     // The number of samples currently held in the window buffer.
+        float           dbOffset;           // Cached dB offset for the current gain and sample scale.
+        float           dbGain;             // The gain used to calculate dbOffset.
+        float           dbMultiplier;       // The sample scale used to calculate dbOffset.
+        CODAL_STREAM_TRACE_STAGE            // Per stage statistics, when CODAL_STREAM_TRACE is enabled.
         public:
 
         /**
@@ -234,6 +246,7 @@ namespace codal{
         ~LevelDetectorSPL();
 
         private:
+        void processWindow(const int16_t *data, float multiplier, bool &nonzero);
         float splToUnit(float f, int queryUnit = -1);
         float unitToSpl(float f, int queryUnit = -1);
     };
@@ -27,6 +27,24 @@ DEALINGS IN THE SOFTWARE.
 
 #include "DataStream.h"
 
+// Number of bits of headroom reserved in the 32 bit mixing accumulator.
+// Each channel contribution is pre-scaled by this amount, allowing at least 2^MIXER_HEADROOM_BITS channels
+// at full volume and full scale to be summed before saturation.
+#ifndef MIXER_HEADROOM_BITS
+#define MIXER_HEADROOM_BITS             4
+#endif
+
+// Number of samples generated when pull() is called with no active channels.
+#ifndef MIXER_DEFAULT_BUFFER_SAMPLES
+#define MIXER_DEFAULT_BUFFER_SAMPLES    256
+#endif
+
+// Channel volume representing unity gain.
+#define MIXER_UNITY_VOLUME              1024
+
+// The highest channel volume used, so that a full scale 16 bit sample multiplied by the volume always fits in an int.
+#define MIXER_MAX_VOLUME                32767
+
 namespace codal
 {
 
@@ -35,17 +53,43 @@ class MixerChannel
 private:
     MixerChannel *next;
     DataStream *stream;
+    uint32_t rampGain;              // Current gain during a volume ramp, in 16.16 fixed point.
+    int32_t rampStep;               // Per sample change in gain during a volume ramp, in 16.16 fixed point.
+    uint32_t rampSamples;           // Number of samples remaining in the current volume ramp.
+    uint16_t rampTarget;            // The volume at the end of the current volume ramp.
     friend class Mixer;
 
 public:
     uint16_t volume;
     bool isSigned;
+
+    /**
+     * Changes the volume of this channel, optionally as a linear ramp over a number of samples.
+     *
+     * Ramps are applied per sample when the Mixer has an output format defined (see Mixer::setFormat()).
+     * Otherwise, the volume changes at the start of the next buffer.
+     *
+     * @param volume The new volume of the channel, where MIXER_UNITY_VOLUME (1024) represents unity gain.
+     *               Values above MIXER_MAX_VOLUME are treated as MIXER_MAX_VOLUME.
+     * @param rampSamples The number of samples over which to move from the current volume to the new volume. (default: 0)
+     * @return DEVICE_OK on success.
+     */
+    int setVolume(uint16_t volume, uint32_t rampSamples = 0);
 };
 
 class Mixer : public DataSource, public DataSink
 {
     MixerChannel *channels;
     DataSink *downStream;
+    int outputFormat;               // The format to output, or DATASTREAM_FORMAT_UNKNOWN for legacy 10 bit output.
+    int32_t *accumulator;           // Mixing accumulator, one 32 bit word per output sample.
+    int accumulatorSize;            // The number of samples the accumulator can currently hold.
+    CODAL_STREAM_TRACE_STAGE        // Per stage statistics, when CODAL_STREAM_TRACE is enabled.
+
+    /**
+     * Mixes all channels into a 32 bit accumulator and saturates the result into the configured output format.
+     */
+    ManagedBuffer pullAccumulated();
 
 public:
     /**
@@ -79,6 +123,33 @@ public:
      */
     virtual void connect(DataSink &sink);
 
+    /**
+     * Determine the data format of the buffers streamed out of this component.
+     * @return the output format, or DATASTREAM_FORMAT_UNKNOWN if the legacy 10 bit unsigned output is in use.
+     */
+    virtual int getFormat();
+
+    /**
+     * Defines the data format of the buffers streamed out of this component.
+     *
+     * When set, channels are mixed in a 32 bit accumulator with a single saturation pass into the given format,
+     * and each channel is read in the format reported by its stream (channels reporting DATASTREAM_FORMAT_UNKNOWN
+     * are treated as legacy 10 bit samples, according to their isSigned flag). Channel volume ramps are applied per sample.
+     *
+     * @param format valid values include:
+     *
+     * DATASTREAM_FORMAT_UNKNOWN (legacy 10 bit unsigned output)
+     * DATASTREAM_FORMAT_8BIT_UNSIGNED
+     * DATASTREAM_FORMAT_8BIT_SIGNED
+     * DATASTREAM_FORMAT_16BIT_UNSIGNED
+     * DATASTREAM_FORMAT_16BIT_SIGNED
+     * DATASTREAM_FORMAT_32BIT_UNSIGNED
+     * DATASTREAM_FORMAT_32BIT_SIGNED
+     *
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the format is not supported.
+     */
+    virtual int setFormat(int format);
+
     /**
      * Determines if this source is connected to a downstream component
      * 
@@ -32,6 +32,26 @@ DEALINGS IN THE SOFTWARE.
 #define SERIAL_STREAM_MODE_BINARY               1
 #define SERIAL_STREAM_MODE_DECIMAL              2
 #define SERIAL_STREAM_MODE_HEX                  4
+#define SERIAL_STREAM_MODE_FRAMED               8
+
+// Number of samples written on each line, in the text modes.
+#define SERIAL_STREAM_SAMPLES_PER_LINE          16
+
+/**
+ * SERIAL_STREAM_MODE_FRAMED sends each buffer as a frame: a header, followed by the raw sample data.
+ * All header fields are little endian:
+ *
+ * offset 0:  SERIAL_STREAM_FRAME_SYNC (2 bytes)
+ * offset 2:  data format, one of the DATASTREAM_FORMAT constants (1 byte)
+ * offset 3:  SERIAL_STREAM_FRAME_VERSION (1 byte)
+ * offset 4:  sample rate, in Hz (4 bytes)
+ * offset 8:  sequence number, incremented for each frame (2 bytes)
+ * offset 10: length of the sample data, in bytes (2 bytes)
+ * offset 12: CRC-16/CCITT-FALSE of header bytes 0..11 and the sample data (2 bytes)
+ */
+#define SERIAL_STREAM_FRAME_SYNC                0xDAC0
+#define SERIAL_STREAM_FRAME_VERSION             1
+#define SERIAL_STREAM_FRAME_HEADER_SIZE         14
 
 namespace codal
 {
@@ -41,12 +61,14 @@ namespace codal
         ManagedBuffer   lastBuffer;         
         int             mode;
         Serial          *serial;
+        uint16_t        sequence;           // Sequence number of the next frame, in SERIAL_STREAM_MODE_FRAMED.
+        uint32_t        dropped;            // Number of sends dropped because the serial port was in use.
 
         public:
         /**
          * Creates a simple component that logs a stream of signed 16 bit data as signed 8-bit data over serial.
          * @param source a DataSource to measure the level of.
-         * @param mode the format of the serialised data. Valid options are SERIAL_STREAM_MODE_BINARY (default), SERIAL_STREAM_MODE_DECIMAL, SERIAL_STREAM_MODE_HEX.
+         * @param mode the format of the serialised data. Valid options are SERIAL_STREAM_MODE_BINARY (default), SERIAL_STREAM_MODE_DECIMAL, SERIAL_STREAM_MODE_HEX, SERIAL_STREAM_MODE_FRAMED.
          * @param output the serial instance used to stream data to. Uses the first registered serial port by default.
          */
         SerialStreamer(DataSource &source, int mode = SERIAL_STREAM_MODE_BINARY, Serial *output = Serial::defaultSerial);
@@ -72,6 +94,23 @@ namespace codal
          * returns the last buffer processed by this component
          */
         ManagedBuffer getLastBuffer();
+
+        /**
+         * Determines the number of buffers, frames or lines of text dropped because the serial port was in use by another fiber.
+         */
+        uint32_t getDropCount();
+
+        private:
+
+        /**
+         * Sends a buffer as a single frame, in SERIAL_STREAM_MODE_FRAMED.
+         */
+        void streamFrame(ManagedBuffer buffer, int format);
+
+        /**
+         * Sends a buffer as lines of text, in SERIAL_STREAM_MODE_DECIMAL or SERIAL_STREAM_MODE_HEX.
+         */
+        void streamText(ManagedBuffer buffer, int format);
     };
 }
 #endif
@@ -0,0 +1,198 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+
+#ifndef SPECTRUM_ANALYZER_H
+#define SPECTRUM_ANALYZER_H
+
+/**
+ * SpectrumAnalyzer events
+ */
+#define SPECTRUM_ANALYZER_EVT_FRAME                 1                   // A new spectrum frame has been calculated.
+#define SPECTRUM_ANALYZER_EVT_BAND_HIGH(band)       (0x100 + (band))    // The energy of the given band has risen above its threshold.
+#define SPECTRUM_ANALYZER_EVT_BAND_LOW(band)        (0x200 + (band))    // The energy of the given band has fallen below its threshold.
+
+/**
+ * Default configuration values
+ */
+#ifndef SPECTRUM_ANALYZER_DEFAULT_FFT_SIZE
+#define SPECTRUM_ANALYZER_DEFAULT_FFT_SIZE          256
+#endif
+
+#ifndef SPECTRUM_ANALYZER_DEFAULT_BANDS
+#define SPECTRUM_ANALYZER_DEFAULT_BANDS             8
+#endif
+
+#define SPECTRUM_ANALYZER_MIN_FFT_SIZE              16
+#define SPECTRUM_ANALYZER_MAX_FFT_SIZE              1024
+#define SPECTRUM_ANALYZER_MAX_BANDS                 16
+
+namespace codal{
+
+    /**
+     * A DataSink that computes the power spectrum of a stream.
+     *
+     * Incoming samples are gathered into overlapping frames, weighted with a Hann window, and transformed with
+     * a fixed point radix-2 real FFT using precomputed twiddle factors. From each frame, the analyzer derives the
+     * power of each frequency bin, the energy of a set of logarithmically spaced bands and the dominant frequency.
+     *
+     * A SPECTRUM_ANALYZER_EVT_FRAME event is raised for each frame, and SPECTRUM_ANALYZER_EVT_BAND_HIGH / LOW events
+     * are raised as band energies cross their thresholds.
+     */
+    class SpectrumAnalyzer : public CodalComponent, public DataSink
+    {
+        DataSource      &upstream;          // The component producing data to process.
+        int16_t         *frame;             // Time domain samples of the frame being collected.
+        int16_t         *work;              // FFT working buffer (N/2 interleaved complex values).
+        int16_t         *twiddles;          // Interleaved cos/-sin twiddle factors for k = 0..N/2-1, in Q15.
+        int16_t         *window;            // The first half of the (symmetric) Hann window, in Q15.
+        uint32_t        *power;             // Power of each frequency bin from the most recent frame.
+        uint16_t        bandEdges[SPECTRUM_ANALYZER_MAX_BANDS + 1]; // First bin of each band (plus one past the last band).
+        uint32_t        bandEnergy[SPECTRUM_ANALYZER_MAX_BANDS];    // Mean power per bin of each band, from the most recent frame.
+        uint32_t        bandThreshold[SPECTRUM_ANALYZER_MAX_BANDS]; // Energy above which a band is considered high.
+        uint16_t        bandState;          // Bitmask of bands currently above their threshold.
+        int             fftSize;            // The number of samples in each frame (N).
+        int             hopSize;            // The number of new samples between consecutive frames.
+        int             fill;               // The number of samples currently held in the frame.
+        int             bands;              // The number of bands in use.
+        int             dominantBin;        // The bin with the highest power in the most recent frame.
+        uint32_t        frames;             // The number of frames processed.
+
+        public:
+
+        /**
+          * Creates a component that calculates the frequency spectrum of a stream.
+          *
+          * @param source a DataSource to analyze.
+          * @param fftSize The number of samples per frame. Must be a power of two between SPECTRUM_ANALYZER_MIN_FFT_SIZE and SPECTRUM_ANALYZER_MAX_FFT_SIZE.
+          * @param bands The number of logarithmically spaced frequency bands to report.
+          * @param id The id to use for the message bus when transmitting events.
+          */
+        SpectrumAnalyzer(DataSource &source, int fftSize = SPECTRUM_ANALYZER_DEFAULT_FFT_SIZE, int bands = SPECTRUM_ANALYZER_DEFAULT_BANDS, uint16_t id = DEVICE_ID_SPECTRUM_ANALYZER);
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Defines the frame size, and reallocates the FFT tables.
+         *
+         * @param fftSize The number of samples per frame. Must be a power of two between SPECTRUM_ANALYZER_MIN_FFT_SIZE and SPECTRUM_ANALYZER_MAX_FFT_SIZE.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the size is not supported, or DEVICE_NO_RESOURCES.
+         */
+        int setFFTSize(int fftSize);
+
+        /**
+         * Determines the frame size currently in use.
+         * @return the number of samples per frame.
+         */
+        int getFFTSize();
+
+        /**
+         * Defines the number of new samples consumed between consecutive frames.
+         * A value of half the FFT size (the default) gives 50% overlap.
+         *
+         * @param hop The number of samples, in the range 1..fftSize.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setHopSize(int hop);
+
+        /**
+         * Defines the number of logarithmically spaced bands into which the spectrum is divided.
+         *
+         * @param bands The number of bands, in the range 1..SPECTRUM_ANALYZER_MAX_BANDS. This is limited to the number of available bins.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setBands(int bands);
+
+        /**
+         * Determines the number of bands in use.
+         * @return the number of bands.
+         */
+        int getBands();
+
+        /**
+         * Defines the energy threshold of a band. SPECTRUM_ANALYZER_EVT_BAND_HIGH and SPECTRUM_ANALYZER_EVT_BAND_LOW
+         * events are raised when the band's energy crosses this value. A threshold of zero disables events for the band.
+         *
+         * @param band The band to configure.
+         * @param threshold The energy threshold, in the same units as getBandEnergy().
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setBandThreshold(int band, uint32_t threshold);
+
+        /**
+         * Determines the energy of a band in the most recent frame.
+         *
+         * @param band The band to query.
+         * @return The mean power per bin of the band, or 0 if the band is invalid.
+         */
+        uint32_t getBandEnergy(int band);
+
+        /**
+         * Determines the frequency range covered by a band.
+         *
+         * @param band The band to query.
+         * @param low Set to the lowest frequency in the band, in Hz.
+         * @param high Set to the highest frequency in the band, in Hz.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int getBandFrequencies(int band, float &low, float &high);
+
+        /**
+         * Determines the frequency with the highest power in the most recent frame (excluding DC).
+         * @return The centre frequency of the dominant bin, in Hz.
+         */
+        float getDominantFrequency();
+
+        /**
+         * Provides the power of each frequency bin in the most recent frame.
+         * Bin k covers the frequency k * sampleRate / fftSize.
+         *
+         * @return A pointer to fftSize / 2 power values, valid until the next frame is processed.
+         */
+        const uint32_t *getPowerSpectrum();
+
+        /**
+         * Determines the number of frames processed since creation.
+         * @return the number of frames.
+         */
+        uint32_t getFrameCount();
+
+        /**
+         * Destructor.
+         */
+        ~SpectrumAnalyzer();
+
+        private:
+        void processFrame();
+        void releaseTables();
+    };
+}
+
+#endif
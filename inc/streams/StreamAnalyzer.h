@@ -21,6 +21,11 @@ namespace codal
         int             pullRequests;                   // Number of active pull requests
         ManagedBuffer   quantizationData;               // Long running data collected from the data stream
         ManagedBuffer   buffer;                         // The most recent buffer received
+        bool            statisticsEnabled;              // If set, minimum, maximum and mean are gathered alongside the histogram
+        int             minimum;                        // Lowest sample seen since the last reset
+        int             maximum;                        // Highest sample seen since the last reset
+        int64_t         sum;                            // Sum of all samples seen since the last reset
+        uint32_t        count;                          // Number of samples seen since the last reset
 
         public:
         /**
@@ -65,10 +70,52 @@ namespace codal
 
         /**
          * Defines the sample range used by this analyzer.
-         * @param range A positive integer value defining the maximum allowable value.
+         * @param range A positive integer value defining the maximum allowable value, or zero (the default) to use
+         * the full range of the upstream format.
          */
         void setRange(int range);
 
+        /**
+         * Enables or disables the calculation of minimum, maximum and mean sample values.
+         * These are gathered in the same pass as the histogram.
+         *
+         * @param enable true to gather statistics, false otherwise.
+         */
+        void enableStatistics(bool enable);
+
+        /**
+         * Determines the lowest sample value seen since the last reset. Requires statistics to be enabled.
+         * @return the lowest sample value, in the representation of the upstream format.
+         */
+        int getMinimum();
+
+        /**
+         * Determines the highest sample value seen since the last reset. Requires statistics to be enabled.
+         * @return the highest sample value, in the representation of the upstream format.
+         */
+        int getMaximum();
+
+        /**
+         * Determines the mean sample value seen since the last reset. Requires statistics to be enabled.
+         * @return the mean sample value, in the representation of the upstream format.
+         */
+        int getMean();
+
+        /**
+         * Determines the number of samples analyzed since the last reset.
+         * @return the number of samples.
+         */
+        uint32_t getSampleCount();
+
+        /**
+         * Estimates a percentile of the samples seen since the last reset, from the histogram.
+         *
+         * @param percentile The percentile to calculate, in the range 0..100.
+         * @return The lower bound of the histogram level containing the requested percentile, in the representation
+         * of the upstream format, or DEVICE_INVALID_PARAMETER.
+         */
+        int getPercentile(int percentile);
+
         /** 
          * Defines a value that is and'ed with each sample before analysis
          * Useful to mask off unwanted bit in the sample data.
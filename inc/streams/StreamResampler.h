@@ -0,0 +1,126 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+
+#ifndef STREAM_RESAMPLER_H
+#define STREAM_RESAMPLER_H
+
+/**
+ * Default configuration values
+ */
+
+// The number of FIR taps applied per output sample (i.e. per polyphase branch) when upsampling.
+// When downsampling, this is scaled by the decimation ratio so the filter spans the same number of output periods.
+// Higher values give a sharper anti-aliasing filter, at a linear increase in CPU cost.
+#ifndef CONFIG_RESAMPLER_TAPS_PER_PHASE
+#define CONFIG_RESAMPLER_TAPS_PER_PHASE     16
+#endif
+
+// The largest interpolation factor (numerator of the resampling ratio) supported.
+// The coefficient table holds one 16 bit word per tap, for each phase.
+#ifndef CONFIG_RESAMPLER_MAX_PHASES
+#define CONFIG_RESAMPLER_MAX_PHASES         32
+#endif
+
+// Number of fractional bits used by the fixed point filter coefficients.
+#define RESAMPLER_COEFFICIENT_BITS          14
+
+namespace codal{
+
+    /**
+     * A polyphase FIR sample rate converter.
+     *
+     * Converts a stream by an arbitrary rational ratio of interpolation / decimation, applying a windowed-sinc
+     * anti-aliasing filter with fixed point coefficients. Only the filter phase contributing to an output sample
+     * is evaluated, so the cost is approximately CONFIG_RESAMPLER_TAPS_PER_PHASE multiply-accumulates per input or
+     * output sample (whichever is the greater), independent of the ratio.
+     *
+     * Unlike the sample dropping of SplitterChannel::requestSampleDropRate(), this supports non integer ratios,
+     * and removes content above the output Nyquist frequency before decimation, so it does not alias.
+     * A StreamResampler can be connected to a SplitterChannel, allowing several consumers to receive the same
+     * source at their own sample rates.
+     */
+    class StreamResampler : public DataSourceSink
+    {
+        int16_t         *coefficients;      // Filter coefficients, grouped by phase (taps per phase).
+        int32_t         *history;           // Most recent input samples, stored twice to avoid wrapping (2 * taps).
+        int             historyPosition;    // Index of the oldest sample in the history.
+        int             taps;               // The number of filter taps per phase.
+        int             interpolation;      // Numerator of the resampling ratio (L).
+        int             decimation;         // Denominator of the resampling ratio (M).
+        int             phase;              // The current polyphase branch, in the range 0..L-1.
+
+        public:
+
+        /**
+          * Creates a component that converts the sample rate of a stream by the ratio interpolation / decimation.
+          *
+          * @param source a DataSource to receive data from
+          * @param interpolation The numerator of the ratio by which to change the sample rate. (default: 1)
+          * @param decimation The denominator of the ratio by which to change the sample rate. (default: 1)
+          */
+        StreamResampler(DataSource &source, int interpolation = 1, int decimation = 1);
+
+        /**
+         * Provide the next available ManagedBuffer to our downstream caller, if available.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         * Determine the sample rate of the buffers streamed out of this component.
+         * @return the upstream sample rate, scaled by interpolation / decimation.
+         */
+        virtual float getSampleRate();
+
+        /**
+         * Defines the resampling ratio of this component. The ratio is reduced to its simplest form,
+         * and the anti-aliasing filter recalculated.
+         *
+         * @param interpolation The numerator of the ratio by which to change the sample rate.
+         * @param decimation The denominator of the ratio by which to change the sample rate.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the reduced numerator exceeds CONFIG_RESAMPLER_MAX_PHASES,
+         * or DEVICE_NO_RESOURCES if the filter could not be allocated.
+         */
+        int setRatio(int interpolation, int decimation);
+
+        /**
+         * Defines the sample rate of the buffers streamed out of this component, relative to the current upstream sample rate.
+         * Both rates are rounded to the nearest Hz before the ratio is derived.
+         *
+         * @param sampleRate The output sample rate, in Hz.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the rates cannot be expressed as a supported ratio,
+         * or DEVICE_NOT_SUPPORTED if the upstream sample rate is unknown.
+         */
+        int setSampleRate(float sampleRate);
+
+        /**
+         * Destructor.
+         */
+        ~StreamResampler();
+    };
+}
+
+#endif
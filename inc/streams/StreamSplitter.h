@@ -56,12 +56,27 @@ namespace codal{
 
     class StreamSplitter;
 
+    /**
+     * Per-channel delivery statistics, maintained by the StreamSplitter.
+     */
+    struct SplitterChannelStatistics
+    {
+        uint32_t    offered;                // Number of buffers offered to this channel (pullRequests made).
+        uint32_t    pulled;                 // Number of offered buffers the channel's consumer pulled, whether straight away or later.
+        uint32_t    dropped;                // Number of offered buffers replaced by the next one before being pulled.
+        uint32_t    shared;                 // Number of buffers delivered by reference, without a copy.
+        uint16_t    lag;                    // Number of consecutive buffers dropped since the consumer last pulled.
+        uint16_t    maxLag;                 // The highest value lag has reached.
+    };
+
     class SplitterChannel : public DataSourceSink {
         private:
             StreamSplitter * parent;
             int sampleDropRate = 1;
             int sampleDropPosition = 0;
             int sampleSigma = 0;
+            bool pending = false;           // true if a buffer has been offered, but not yet pulled.
+            SplitterChannelStatistics stats = {};
 
             ManagedBuffer resample( ManagedBuffer _in, uint8_t * buffer = NULL, int length = -1 );
         
@@ -79,19 +94,52 @@ namespace codal{
             SplitterChannel( StreamSplitter *parent, DataSink *output );
             virtual ~SplitterChannel();
 
+            /**
+             * Copies the next buffer for this channel into caller supplied memory.
+             *
+             * @param rawBuffer The memory to write samples into.
+             * @param length The maximum number of bytes to write.
+             * @return A pointer to the byte following the last byte written.
+             */
             uint8_t * pullInto( uint8_t * rawBuffer, int length );
+
+            /**
+             * Provide the next available ManagedBuffer to our downstream caller.
+             *
+             * Channels that do not resample receive the same ManagedBuffer as every other such channel, without copying.
+             * This buffer is shared and must be treated as read only: consumers wishing to modify it should check
+             * ManagedBuffer::isShared() and take a copy first (as EffectFilter and StreamNormalizer do).
+             * The last channel offered a buffer takes it over from the splitter, so is free to modify it in place
+             * if nothing else holds a reference.
+             */
             virtual ManagedBuffer pull();
             virtual int getFormat();
             virtual int setFormat(int format);
             virtual int requestSampleDropRate(int sampleDropRate);
             virtual float getSampleRate();
             virtual void dataWanted(int wanted);
+
+            /**
+             * Determine the delivery statistics of this channel.
+             * @return A snapshot of the statistics gathered since creation, or since the last call to resetStatistics().
+             */
+            SplitterChannelStatistics getStatistics();
+
+            /**
+             * Resets the delivery statistics of this channel to zero.
+             */
+            void resetStatistics();
+
+            friend StreamSplitter;
     };
 
     class StreamSplitter : public DataSink, public CodalComponent 
     {
     private:
         ManagedBuffer       lastBuffer;                            // Buffer being processed
+        SplitterChannel     *finalChannel;                         // The last channel to be offered lastBuffer, which may take it over
+        bool                bufferReleased;                        // Set once finalChannel has taken over lastBuffer
+        CODAL_STREAM_TRACE_STAGE                                   // Per stage statistics, when CODAL_STREAM_TRACE is enabled.
 
     public:
         int                 channels;                              // Current number of channels Splitter is serving
@@ -0,0 +1,146 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_STREAM_TRACE_H
+#define CODAL_STREAM_TRACE_H
+
+#include "CodalConfig.h"
+
+/**
+ * Optional instrumentation for stream pipelines, enabled by setting CODAL_STREAM_TRACE to 1.
+ *
+ * Each instrumented component declares a StreamTraceStage with CODAL_STREAM_TRACE_STAGE, names it with
+ * CODAL_STREAM_TRACE_INIT, and marks the start of its pull() and pullRequest() methods with CODAL_STREAM_TRACE_PULL()
+ * and CODAL_STREAM_TRACE_PULL_REQUEST(). The time recorded for a stage excludes time spent in any other stage it calls,
+ * so the cost of each stage can be read directly. When tracing is disabled, all of these macros compile to nothing.
+ */
+#if CONFIG_ENABLED(CODAL_STREAM_TRACE)
+    #define CODAL_STREAM_TRACE_STAGE                codal::StreamTraceStage streamTrace;
+    #define CODAL_STREAM_TRACE_INIT(name)           streamTrace.setName(name)
+    #define CODAL_STREAM_TRACE_PULL()               codal::StreamTraceScope streamTraceScope(streamTrace, true)
+    #define CODAL_STREAM_TRACE_PULL_REQUEST()       codal::StreamTraceScope streamTraceScope(streamTrace, false)
+    #define CODAL_STREAM_TRACE_BYTES(n)             streamTrace.stats.bytes += (n)
+#else
+    #define CODAL_STREAM_TRACE_STAGE
+    #define CODAL_STREAM_TRACE_INIT(name)           ((void)0)
+    #define CODAL_STREAM_TRACE_PULL()               ((void)0)
+    #define CODAL_STREAM_TRACE_PULL_REQUEST()       ((void)0)
+    #define CODAL_STREAM_TRACE_BYTES(n)             ((void)0)
+#endif
+
+#if CONFIG_ENABLED(CODAL_STREAM_TRACE)
+
+namespace codal
+{
+    /**
+     * The statistics recorded for a single stage of a stream pipeline.
+     */
+    struct StreamTraceStats
+    {
+        const char *name;           // The name of the stage.
+        uint32_t pulls;             // The number of calls to pull().
+        uint32_t pullRequests;      // The number of calls to pullRequest().
+        uint32_t bytes;             // The number of bytes output by pull(), or consumed by a sink.
+        uint32_t timeUs;            // The total time spent in this stage, excluding other stages it calls.
+        uint32_t maxTimeUs;         // The longest time spent in a single call.
+        uint32_t ageUs;             // The total time buffers waited between a pullRequest() and the following pull().
+        uint32_t maxAgeUs;          // The longest time a buffer waited between a pullRequest() and the following pull().
+    };
+
+    /**
+     * Records the statistics of one stage. All stages are held in a list, so they can be reported together.
+     */
+    class StreamTraceStage
+    {
+        public:
+        StreamTraceStats stats;
+        uint32_t requestTime;       // The time of the oldest pullRequest() not yet followed by a pull().
+        bool requestPending;        // true if requestTime is valid.
+        StreamTraceStage *next;
+
+        StreamTraceStage();
+        ~StreamTraceStage();
+
+        /**
+         * Sets the name under which this stage is reported.
+         */
+        void setName(const char *name);
+    };
+
+    /**
+     * Times a call to pull() or pullRequest() for the lifetime of the object.
+     * Nested scopes deduct their time from the enclosing scope, so each stage records only its own cost.
+     *
+     * @note Scopes are tracked on a single stack, so a pipeline driven from interrupt context that preempts
+     * one running in fiber context will have its time attributed to both.
+     */
+    class StreamTraceScope
+    {
+        StreamTraceStage &stage;
+        StreamTraceScope *parent;
+        uint32_t start;
+        uint32_t childTimeUs;
+
+        public:
+        StreamTraceScope(StreamTraceStage &stage, bool isPull);
+        ~StreamTraceScope();
+    };
+
+    /**
+     * Access to the statistics of all traced stages.
+     */
+    class StreamTrace
+    {
+        public:
+
+        /**
+         * Determines the number of stages currently being traced.
+         */
+        static int getStageCount();
+
+        /**
+         * Takes a copy of the statistics of each stage, in the order the stages were created.
+         *
+         * @param stats An array to fill.
+         * @param count The maximum number of stages to copy.
+         *
+         * @return the number of stages copied.
+         */
+        static int snapshot(StreamTraceStats *stats, int count);
+
+        /**
+         * Resets the statistics of all stages to zero.
+         */
+        static void reset();
+
+        /**
+         * Writes the statistics of all stages to DMESG, one line per stage.
+         */
+        static void dmesg();
+    };
+}
+
+#endif
+
+#endif
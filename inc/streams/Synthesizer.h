@@ -29,11 +29,49 @@ DEALINGS IN THE SOFTWARE.
 
 #define SYNTHESIZER_SAMPLE_RATE        44100
 #define TONE_WIDTH                  1024
+#define TONE_WIDTH_BITS             10
+
+// Number of independent wavetable voices supported by each Synthesizer.
+#ifndef CONFIG_SYNTHESIZER_VOICES
+#define CONFIG_SYNTHESIZER_VOICES   4
+#endif
+
+// Number of entries in each wavetable, as a power of two. Custom wavetables must be this size.
+#define SYNTHESIZER_WAVETABLE_BITS          8
+#define SYNTHESIZER_WAVETABLE_SIZE          (1 << SYNTHESIZER_WAVETABLE_BITS)
+
+// Number of band-limited tables held for the sawtooth and square waveforms, one per octave.
+// Lower tables hold more harmonics, and are used for lower frequencies.
+#ifndef CONFIG_SYNTHESIZER_BANDLIMITED_TABLES
+#define CONFIG_SYNTHESIZER_BANDLIMITED_TABLES   8
+#endif
+
+// Waveforms available to wavetable voices.
+#define SYNTHESIZER_WAVEFORM_SINE           0
+#define SYNTHESIZER_WAVEFORM_TRIANGLE       1
+#define SYNTHESIZER_WAVEFORM_SAWTOOTH       2
+#define SYNTHESIZER_WAVEFORM_SQUARE         3
+#define SYNTHESIZER_WAVEFORM_CUSTOM         4
 
 namespace codal
 {
     typedef uint16_t (*SynthesizerGetSample)(void *arg, int position);
 
+    /**
+     * A single wavetable oscillator voice.
+     */
+    struct SynthesizerVoice
+    {
+        uint32_t        phase;          // Phase, in 0.32 fixed point. The top SYNTHESIZER_WAVETABLE_BITS bits index the wavetable.
+        uint32_t        increment;      // Phase increment per output sample.
+        float           frequency;      // Frequency of this voice, in Hz.
+        const int16_t   *table;         // The wavetable currently in use, chosen according to frequency for band-limited waveforms.
+        const int16_t   *custom;        // User supplied wavetable, for SYNTHESIZER_WAVEFORM_CUSTOM.
+        uint16_t        volume;         // Volume of this voice, in the range 0..1024.
+        uint8_t         waveform;       // One of the SYNTHESIZER_WAVEFORM constants.
+        bool            on;             // true if this voice is currently sounding.
+    };
+
     class Synthesizer : public DataSource, public CodalComponent
     {
         int     samplePeriodNs;        // The length of a single sample, in nanoseconds.
@@ -49,7 +87,10 @@ namespace codal
         int     bytesWritten;          // Number of bytes written to the output buffer.
         void*   tonePrintArg;
         SynthesizerGetSample tonePrint;     // The tone currently selected playout tone (always unsigned).
-        int     position;              // Position within the tonePrint
+        uint32_t phase;                // Position within the tonePrint, in 0.32 fixed point.
+
+        SynthesizerVoice voices[CONFIG_SYNTHESIZER_VOICES];    // Wavetable voices, played when no tonePrint frequency is set.
+        bool    voicesEnabled;         // true once any wavetable voice has been used.
 
         public:
 
@@ -149,8 +190,60 @@ namespace codal
         // legacy
         void setTone(const uint16_t *tonePrint) { setTone(CustomTone, (void*)tonePrint); }
 
+        /**
+         * Defines the waveform played by a wavetable voice.
+         * Sawtooth and square waveforms are band-limited, to avoid aliasing at high frequencies.
+         *
+         * @param voice The voice to configure, in the range 0..CONFIG_SYNTHESIZER_VOICES-1.
+         * @param waveform One of the SYNTHESIZER_WAVEFORM constants.
+         * @param table For SYNTHESIZER_WAVEFORM_CUSTOM, a table of SYNTHESIZER_WAVETABLE_SIZE signed 16 bit samples
+         * describing a single period. The table is not copied, and must remain valid while in use.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if the wavetable could not be allocated.
+         */
+        int setWaveform(int voice, int waveform, const int16_t *table = NULL);
+
+        /**
+         * Starts a wavetable voice playing, or changes the frequency and volume of a voice already playing.
+         * Wavetable voices are mixed together, and played whenever no tonePrint frequency is set via setFrequency().
+         *
+         * @param voice The voice to play, in the range 0..CONFIG_SYNTHESIZER_VOICES-1.
+         * @param frequency The frequency, in Hz to generate. Must be below half the sample rate.
+         * @param volume The volume of this voice, in the range 0..1024.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int noteOn(int voice, float frequency, int volume = 1024);
+
+        /**
+         * Stops a wavetable voice playing.
+         *
+         * @param voice The voice to stop, in the range 0..CONFIG_SYNTHESIZER_VOICES-1.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int noteOff(int voice);
+
         private:
 
+        /**
+         * Renders the sum of all wavetable voices into the given buffer.
+         *
+         * @param out The buffer to write to.
+         * @param samples The number of samples to render.
+         * @param gain The overall gain to apply, in the range 0..1024.
+         */
+        void renderVoices(uint16_t *out, int samples, int gain);
+
+        /**
+         * Calculates the phase increment and wavetable for a voice, based on its frequency and waveform.
+         */
+        void updateVoice(SynthesizerVoice &v);
+
+        /**
+         * Calculates the phase increment per sample for a waveform of the given period.
+         */
+        uint32_t phaseIncrement(int periodNs);
+
         /**
          * Determine the number of samples required for the given playout time.
          *
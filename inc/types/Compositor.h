@@ -0,0 +1,277 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_COMPOSITOR_H
+#define CODAL_COMPOSITOR_H
+
+#include "CodalConfig.h"
+#include "Image.h"
+
+// The maximum number of separate regions the compositor tracks. Further changes are merged into the nearest region.
+#ifndef COMPOSITOR_MAX_DIRTY_REGIONS
+#define COMPOSITOR_MAX_DIRTY_REGIONS        8
+#endif
+
+// Sprite transforms. The rotation is applied first, then the flips, so these combine to give all eight orientations.
+#define SPRITE_TRANSFORM_NONE               0x00
+#define SPRITE_TRANSFORM_FLIP_X             0x01
+#define SPRITE_TRANSFORM_FLIP_Y             0x02
+#define SPRITE_TRANSFORM_ROTATE_90          0x04
+#define SPRITE_TRANSFORM_ROTATE_180         (SPRITE_TRANSFORM_FLIP_X | SPRITE_TRANSFORM_FLIP_Y)
+#define SPRITE_TRANSFORM_ROTATE_270         (SPRITE_TRANSFORM_ROTATE_90 | SPRITE_TRANSFORM_FLIP_X | SPRITE_TRANSFORM_FLIP_Y)
+
+// Color key value indicating that every pixel of a sprite is drawn.
+#define SPRITE_NO_COLOR_KEY                 -1
+
+namespace codal
+{
+    /**
+      * A rectangular region of an image.
+      */
+    struct CompositorRegion
+    {
+        int16_t x;
+        int16_t y;
+        int16_t width;
+        int16_t height;
+    };
+
+    /**
+      * Class definition for a Sprite.
+      *
+      * A Sprite is an Image placed on a Compositor, with a position, z-order, transform and optional transparent color.
+      * Changes made through the setters are picked up by the compositor on its next render().
+      */
+    class Sprite
+    {
+        friend class Compositor;
+
+        Image image;
+        int16_t x;
+        int16_t y;
+        int16_t z;
+        int16_t colorKey;
+        uint8_t transform;
+        bool visible;
+        bool changed;
+
+        // Whether, and where, the sprite was drawn by the last render.
+        bool drawn;
+        CompositorRegion drawnRegion;
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param image The image to show.
+          *
+          * @param x The x co-ordinate of the top left of the sprite. Defaults to 0.
+          *
+          * @param y The y co-ordinate of the top left of the sprite. Defaults to 0.
+          *
+          * @param z The z-order of the sprite. Sprites with a higher z are drawn over those with a lower one. Defaults to 0.
+          */
+        Sprite(Image image, int x = 0, int y = 0, int z = 0);
+
+        /**
+          * Changes the image shown by this sprite.
+          */
+        void setImage(Image image);
+
+        /**
+          * Moves the sprite to the given position.
+          */
+        void setPosition(int x, int y);
+
+        /**
+          * Moves the sprite by the given offset.
+          */
+        void move(int dx, int dy);
+
+        /**
+          * Changes the z-order of the sprite.
+          */
+        void setZ(int z);
+
+        /**
+          * Sets the transform applied to the image.
+          *
+          * @param transform A combination of the SPRITE_TRANSFORM_ flags.
+          */
+        void setTransform(uint8_t transform);
+
+        /**
+          * Sets the pixel value treated as transparent.
+          *
+          * @param key The transparent value, or SPRITE_NO_COLOR_KEY to draw every pixel.
+          */
+        void setColorKey(int key);
+
+        /**
+          * Shows or hides the sprite.
+          */
+        void setVisible(bool visible);
+
+        /**
+          * Marks the sprite to be redrawn, e.g. after its image has been modified in place.
+          */
+        void invalidate()
+        {
+            changed = true;
+        }
+
+        int getX() { return x; }
+        int getY() { return y; }
+        int getZ() { return z; }
+        uint8_t getTransform() { return transform; }
+        bool isVisible() { return visible; }
+
+        /**
+          * Gets the width of the sprite on screen, after any rotation.
+          */
+        int getWidth()
+        {
+            return (transform & SPRITE_TRANSFORM_ROTATE_90) ? image.getHeight() : image.getWidth();
+        }
+
+        /**
+          * Gets the height of the sprite on screen, after any rotation.
+          */
+        int getHeight()
+        {
+            return (transform & SPRITE_TRANSFORM_ROTATE_90) ? image.getWidth() : image.getHeight();
+        }
+    };
+
+    /**
+      * Class definition for a Compositor.
+      *
+      * A Compositor draws a set of Sprites over a background into a target Image.
+      * It keeps track of the regions of the target affected by changes since the last render, and only
+      * recomposites those, so the cost of a frame is proportional to what moved rather than to the size of the screen.
+      * After each render, the updated regions can be read back to send just those parts to a display.
+      */
+    class Compositor
+    {
+        Image target;
+        Image background;
+        uint8_t backgroundColor;
+
+        Sprite **sprites;
+        int spriteCount;
+        int spriteCapacity;
+
+        CompositorRegion dirty[COMPOSITOR_MAX_DIRTY_REGIONS];
+        int dirtyCount;
+
+        CompositorRegion updated[COMPOSITOR_MAX_DIRTY_REGIONS];
+        int updatedCount;
+
+        /**
+          * Adds a region to be recomposited, merging it with any it overlaps.
+          */
+        void addDirtyRegion(CompositorRegion r);
+
+        /**
+          * Redraws the background and sprites within one region of the target.
+          */
+        void composite(const CompositorRegion &r);
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param target The image to composite into.
+          */
+        Compositor(Image target);
+
+        /**
+          * Destructor.
+          */
+        ~Compositor();
+
+        /**
+          * Adds a sprite. The sprite must remain valid until it is removed, or the compositor is destroyed.
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the sprite has already been added.
+          */
+        int add(Sprite &sprite);
+
+        /**
+          * Removes a sprite.
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the sprite was not added.
+          */
+        int remove(Sprite &sprite);
+
+        /**
+          * Uses a flat color as the background.
+          */
+        void setBackground(uint8_t color);
+
+        /**
+          * Uses an image as the background. It is drawn at the top left of the target.
+          */
+        void setBackground(Image image);
+
+        /**
+          * Marks the whole target to be recomposited.
+          */
+        void invalidate();
+
+        /**
+          * Marks a region of the target to be recomposited.
+          */
+        void invalidate(int x, int y, int width, int height);
+
+        /**
+          * Recomposites every region affected by changes since the last render.
+          *
+          * @return The number of regions updated.
+          */
+        int render();
+
+        /**
+          * Gets the number of regions updated by the last render.
+          */
+        int getUpdatedRegionCount()
+        {
+            return updatedCount;
+        }
+
+        /**
+          * Gets one of the regions updated by the last render.
+          *
+          * @param i The index of the region, from 0 to getUpdatedRegionCount() - 1.
+          */
+        CompositorRegion getUpdatedRegion(int i)
+        {
+            return updated[i];
+        }
+    };
+}
+
+#endif
@@ -175,6 +175,26 @@ namespace codal
              */
             Sample3D transform(Sample3D s, CoordinateSystem system);
 
+            /**
+             * Transforms an array of 3D x,y,z tuples from ENU format into the format defined in this instance.
+             * The transformation is determined once for the whole array, then applied to every sample without branching.
+             *
+             * @param in the sample points to convert, in ENU format.
+             * @param out the array to store the converted samples. May be the same as in.
+             * @param count the number of samples to convert.
+             * @param system The coordinate system to use in the result.
+             */
+            void transform(const Sample3D *in, Sample3D *out, int count, CoordinateSystem system);
+
+            /**
+             * Transforms an array of 3D x,y,z tuples from ENU format into the format defined in this instance.
+             *
+             * @param in the sample points to convert, in ENU format.
+             * @param out the array to store the converted samples. May be the same as in.
+             * @param count the number of samples to convert.
+             */
+            void transform(const Sample3D *in, Sample3D *out, int count);
+
     };
 }
 #endif
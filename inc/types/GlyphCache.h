@@ -0,0 +1,170 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_GLYPH_CACHE_H
+#define CODAL_GLYPH_CACHE_H
+
+#include "CodalConfig.h"
+#include "BitmapFont.h"
+#include "Image.h"
+#include "PackedImage.h"
+#include "ManagedString.h"
+
+namespace codal
+{
+    /**
+      * Class definition for a GlyphCache.
+      *
+      * Renders text from a BitmapFont into an Image or PackedImage a whole glyph row at a time.
+      *
+      * Every row of a glyph is one of the (1 << BITMAP_FONT_WIDTH) possible patterns of lit columns, so rather than
+      * expanding each glyph, the cache holds every row pattern pre-expanded to the pixel format of the target image:
+      * bytes of 0 or 255 for an Image, or a word of packed pixels at the maximum value for a PackedImage.
+      * This covers all the glyphs of any font in 128 or 256 bytes.
+      */
+    class GlyphCache
+    {
+        BitmapFont font;
+        uint8_t bitsPerPixel;
+        uint8_t rowWords;
+        uint32_t *rows;
+
+        /**
+          * Look up the glyph for the given character.
+          *
+          * @return A pointer to the rows of the glyph, or NULL if the character is not in the font.
+          */
+        const uint8_t *getGlyph(char c);
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param font The font to render.
+          *
+          * @param bpp The pixel format to render into: 8 for an Image, or 1, 2 or 4 for a PackedImage of that depth. Defaults to 8.
+          */
+        GlyphCache(BitmapFont font, int bpp = 8);
+
+        /**
+          * GlyphCache owns its expanded rows, so it cannot be copied.
+          */
+        GlyphCache(const GlyphCache &) = delete;
+        GlyphCache &operator=(const GlyphCache &) = delete;
+
+        /**
+          * Destructor.
+          */
+        ~GlyphCache();
+
+        /**
+          * Changes the font used for rendering. The expanded rows do not depend on the font, so this is cheap.
+          *
+          * @param font The font to render.
+          */
+        void setFont(BitmapFont font);
+
+        /**
+          * Gets the number of bits per pixel this cache renders.
+          */
+        int getBitsPerPixel()
+        {
+            return bitsPerPixel;
+        }
+
+        /**
+          * Draws a character into an Image. Every pixel of the glyph cell is written, clipped to the bounds of the image.
+          *
+          * @param image The Image to draw into. The cache must be for 8 bits per pixel.
+          *
+          * @param c The character to draw.
+          *
+          * @param x The x co-ordinate of the top left of the character.
+          *
+          * @param y The y co-ordinate of the top left of the character.
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the character is not in the font or the depth does not match.
+          */
+        int drawChar(Image &image, char c, int x, int y);
+
+        /**
+          * Draws a character into a PackedImage. Every pixel of the glyph cell is written, clipped to the bounds of the image.
+          *
+          * @param image The PackedImage to draw into. It must have the same depth as the cache.
+          *
+          * @param c The character to draw.
+          *
+          * @param x The x co-ordinate of the top left of the character.
+          *
+          * @param y The y co-ordinate of the top left of the character.
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the character is not in the font or the depth does not match.
+          */
+        int drawChar(PackedImage &image, char c, int x, int y);
+
+        /**
+          * Draws a string into an Image, one character every BITMAP_FONT_WIDTH + spacing pixels.
+          * Characters that are not in the font are drawn as spaces.
+          *
+          * @param image The Image to draw into. The cache must be for 8 bits per pixel.
+          *
+          * @param s The text to draw.
+          *
+          * @param x The x co-ordinate of the top left of the first character.
+          *
+          * @param y The y co-ordinate of the top left of the first character.
+          *
+          * @param spacing The number of blank columns between characters. Defaults to 1.
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the depth does not match.
+          */
+        int drawText(Image &image, ManagedString s, int x, int y, int spacing = 1);
+
+        /**
+          * Draws a string into a PackedImage, one character every BITMAP_FONT_WIDTH + spacing pixels.
+          * Characters that are not in the font are drawn as spaces.
+          *
+          * @param image The PackedImage to draw into. It must have the same depth as the cache.
+          *
+          * @param s The text to draw.
+          *
+          * @param x The x co-ordinate of the top left of the first character.
+          *
+          * @param y The y co-ordinate of the top left of the first character.
+          *
+          * @param spacing The number of blank columns between characters. Defaults to 1.
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the depth does not match.
+          */
+        int drawText(PackedImage &image, ManagedString s, int x, int y, int spacing = 1);
+
+        /**
+          * Gets the shared 8 bit per pixel cache for the current system font, as used by Image::print().
+          */
+        static GlyphCache &getSystemCache();
+    };
+}
+
+#endif
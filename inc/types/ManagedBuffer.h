@@ -46,10 +46,48 @@ namespace codal
       * Class definition for a ManagedBuffer.
       * A ManagedBuffer holds a series of bytes for general purpose use.
       * n.b. This is a mutable, managed type.
+      *
+      * A ManagedBuffer may be a view onto part of a larger BufferData (see view()), so several buffers
+      * can refer to different ranges of the same memory without copying it. The mutating methods
+      * (setByte, writeBytes, writeBuffer, fill, shift and rotate) are copy-on-write: if the underlying data
+      * is shared or read only, this instance first takes a private copy of its bytes. Writes made directly
+      * through getBytes() or operator[] are not copied, and are seen by every buffer sharing that data.
       */
     class ManagedBuffer
     {
-        BufferData      *ptr;     // Pointer to payload data
+        BufferData      *ptr;           // Pointer to payload data, or NULL if the data is held inline
+        uint16_t        viewOffset;     // Offset of this buffer's first byte within ptr->payload
+        uint16_t        viewLength;     // Length of this buffer in bytes
+#if CODAL_MANAGED_BUFFER_INLINE_SIZE > 0
+        uint8_t         inlineData[CODAL_MANAGED_BUFFER_INLINE_SIZE];   // Payload of small buffers
+#endif
+
+        /**
+          * Provides the address of the first byte of this buffer.
+          */
+        uint8_t *data() const
+        {
+#if CODAL_MANAGED_BUFFER_INLINE_SIZE > 0
+            if (ptr == NULL)
+                return (uint8_t *)inlineData;
+#endif
+            return ptr->payload + viewOffset;
+        }
+
+        /**
+          * Ensures this buffer is the only reference to writable data, copying its bytes if required.
+          */
+        void makeWritable();
+
+        /**
+          * Adds a reference to the data held by the given buffer.
+          */
+        void assign(const ManagedBuffer &buffer);
+
+        /**
+          * Removes our reference to the data we hold.
+          */
+        void release();
 
         public:
 
@@ -109,7 +147,7 @@ namespace codal
 
         /**
           * Constructor.
-          * Create a buffer from a raw BufferData pointer. It will ptr->incr(). This is to be used by specialized runtimes.
+          * Create a buffer covering the whole of a raw BufferData pointer. It will ptr->incr(). This is to be used by specialized runtimes.
           *
           * @param p The pointer to use.
           */
@@ -143,12 +181,14 @@ namespace codal
           */
         uint8_t *getBytes()
         {
-            return ptr->payload;
+            return data();
         }
 
         /**
           * Get current ptr, do not decr() it, and set the current instance to an empty buffer.
           * This is to be used by specialized runtimes which pass BufferData around.
+          * If this buffer is a view onto part of a larger BufferData, or is held inline,
+          * a BufferData holding just the bytes of this buffer is created and returned instead.
           */
         BufferData *leakData();
 
@@ -187,7 +227,7 @@ namespace codal
          */
         uint8_t operator [] (int i) const
         {
-            return ptr->payload[i];
+            return data()[i];
         }
 
         /**
@@ -204,7 +244,7 @@ namespace codal
          */
         uint8_t& operator [] (int i)
         {
-            return ptr->payload[i];
+            return data()[i];
         }
 
         /**
@@ -267,12 +307,35 @@ namespace codal
           * p1.length();                 // Returns 16.
           * @endcode
           */
-        int length() const { return ptr->length; }
+        int length() const { return viewLength; }
 
         int fill(uint8_t value, int offset = 0, int length = -1);
 
+        /**
+          * Creates a new buffer holding a copy of part of this buffer.
+          *
+          * @param offset The index of the first byte to copy.
+          * @param length The number of bytes to copy, or -1 to copy to the end of this buffer.
+          * @return A new, independent buffer.
+          */
         ManagedBuffer slice(int offset = 0, int length = -1) const;
 
+        /**
+          * Creates a buffer that refers to part of this buffer, without copying or allocating memory.
+          * The view shares its data with this buffer, until either is modified through a copy-on-write method.
+          *
+          * @param offset The index of the first byte of the view.
+          * @param length The number of bytes in the view, or -1 to view up to the end of this buffer.
+          * @return A buffer referring to the requested range of this buffer.
+          *
+          * Example:
+          * @code
+          * ManagedBuffer packet(32);
+          * ManagedBuffer payload = packet.view(4);     // Bytes 4..31 of packet, with no copy.
+          * @endcode
+          */
+        ManagedBuffer view(int offset = 0, int length = -1) const;
+
         void shift(int offset, int start = 0, int length = -1);
 
         void rotate(int offset, int start = 0, int length = -1);
@@ -283,7 +346,16 @@ namespace codal
 
         int writeBuffer(int dstOffset, const ManagedBuffer &src, int srcOffset = 0, int length = -1);
 
-        bool isReadOnly() const { return ptr->isReadOnly(); }
+        bool isReadOnly() const { return ptr != NULL && ptr->isReadOnly(); }
+
+        /**
+          * Determines if the data in this buffer is referenced by more than one ManagedBuffer, or resides in flash memory.
+          * Components that modify buffers in place should take a copy of shared buffers first (copy-on-write),
+          * so that other holders of the same buffer are unaffected.
+          *
+          * @return true if the buffer is shared or read only, false if this is the only reference.
+          */
+        bool isShared() const { return ptr != NULL && ptr->refCount > 3; }
 
         int truncate(int length);
     };
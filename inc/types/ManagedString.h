@@ -361,6 +361,28 @@ namespace codal
           */
         char charAt(int16_t index);
 
+        /**
+          * Provides the shared, interned copy of a string.
+          *
+          * The first time a given string is interned, it is added to a small table and held there for the
+          * lifetime of the program. Interning an equal string later returns the same character buffer,
+          * so equality tests between interned strings are a single pointer comparison.
+          * This is intended for strings that are compared frequently, such as keys, commands and names.
+          * If the table is full, the string is returned unchanged.
+          *
+          * @param s The string to intern.
+          *
+          * @return a ManagedString equal to s, sharing its buffer with all other interned copies.
+          *
+          * @code
+          * ManagedString cmd = ManagedString::intern(serial.readUntil("\n"));
+          *
+          * if (cmd == ManagedString::intern("reset"))   // pointer comparison when cmd is "reset"
+          *     target_reset();
+          * @endcode
+          */
+        static ManagedString intern(const ManagedString &s);
+
 
         /**
           * Provides an immutable 8 bit wide character buffer representing this string.
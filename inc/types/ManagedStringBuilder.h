@@ -0,0 +1,157 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MANAGED_STRING_BUILDER_H
+#define MANAGED_STRING_BUILDER_H
+
+#include "CodalConfig.h"
+#include "ManagedString.h"
+
+namespace codal
+{
+    /**
+      * Class definition for a ManagedStringBuilder.
+      *
+      * Builds up a string from many parts in a single growable buffer, then hands that buffer
+      * over to a ManagedString without copying it. Repeated `s = s + x` allocates and copies the whole
+      * string on every step; appending to a builder only allocates when its capacity is exceeded,
+      * and the capacity doubles each time, so building a string of n characters costs O(n).
+      *
+      * @code
+      * ManagedStringBuilder line;
+      *
+      * line.append("x=");
+      * line.append(x);
+      * line.append(", y=");
+      * line.append(y);
+      *
+      * serial.send(line.toString());
+      * @endcode
+      */
+    class ManagedStringBuilder
+    {
+        StringData      *ptr;           // The string under construction, or NULL if nothing has been allocated yet.
+        uint16_t        capacity;       // The number of characters ptr can hold, excluding the terminating NULL.
+
+        // Builders own their buffer exclusively, so may not be copied.
+        ManagedStringBuilder(const ManagedStringBuilder &);
+        ManagedStringBuilder& operator = (const ManagedStringBuilder &);
+
+        /**
+          * Ensures the buffer can hold at least the given number of characters.
+          *
+          * @param length The number of characters required.
+          *
+          * @return DEVICE_OK, or DEVICE_NO_RESOURCES if the memory could not be allocated.
+          */
+        int reserve(int length);
+
+        public:
+
+        /**
+          * Constructor.
+          *
+          * @param capacity The number of characters to allocate space for up front. Defaults to allocating on first use.
+          */
+        ManagedStringBuilder(int capacity = 0);
+
+        /**
+          * Destructor.
+          * Releases any string still under construction.
+          */
+        ~ManagedStringBuilder();
+
+        /**
+          * Appends characters to the string.
+          *
+          * @param str The characters to append.
+          * @param length The number of characters to append.
+          *
+          * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if the string could not be extended.
+          */
+        int append(const char *str, int length);
+
+        /**
+          * Appends a NULL terminated character array to the string.
+          *
+          * @param str The characters to append.
+          *
+          * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if the string could not be extended.
+          */
+        int append(const char *str);
+
+        /**
+          * Appends a ManagedString to the string.
+          *
+          * @param s The string to append.
+          *
+          * @return DEVICE_OK, or DEVICE_NO_RESOURCES if the string could not be extended.
+          */
+        int append(const ManagedString &s);
+
+        /**
+          * Appends a single character to the string.
+          *
+          * @param c The character to append.
+          *
+          * @return DEVICE_OK, or DEVICE_NO_RESOURCES if the string could not be extended.
+          */
+        int append(char c);
+
+        /**
+          * Appends the decimal representation of an integer to the string.
+          *
+          * @param value The integer to append.
+          *
+          * @return DEVICE_OK, or DEVICE_NO_RESOURCES if the string could not be extended.
+          */
+        int append(int value);
+
+        /**
+          * Determines the number of characters appended so far.
+          *
+          * @return the length of the string under construction.
+          */
+        int length() const
+        {
+            return ptr ? ptr->len : 0;
+        }
+
+        /**
+          * Discards the string under construction, keeping the allocated buffer for reuse.
+          */
+        void clear();
+
+        /**
+          * Provides the string built so far, and resets this builder to empty.
+          *
+          * The buffer is shrunk to fit and handed over to the returned ManagedString, so the characters are not copied.
+          *
+          * @return a ManagedString holding the appended characters.
+          */
+        ManagedString toString();
+    };
+}
+
+#endif
@@ -0,0 +1,367 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef DEVICE_MATRIX_H
+#define DEVICE_MATRIX_H
+
+#include "CodalConfig.h"
+#include "ErrorNo.h"
+#include "CoordinateSystem.h"
+
+namespace codal
+{
+    /**
+      * Inverts a 3x3 matrix, held in row major order.
+      *
+      * @param m The matrix to invert.
+      * @param result The inverted matrix. May not be the same as m.
+      *
+      * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the matrix is singular.
+      */
+    int matrix_invert3(const float *m, float *result);
+
+    /**
+      * Inverts a 4x4 matrix, held in row major order.
+      *
+      * @param m The matrix to invert.
+      * @param result The inverted matrix. May not be the same as m.
+      *
+      * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the matrix is singular.
+      */
+    int matrix_invert4(const float *m, float *result);
+
+    /**
+      * Multiplies an RxC matrix by a CxK matrix, all held in row major order.
+      * Specialised below for the 3x3 and 4x4 cases used in 3D geometry.
+      *
+      * @param a The left hand matrix.
+      * @param b The right hand matrix.
+      * @param result The RxK product. May not be the same as a or b.
+      */
+    template <int R, int C, int K>
+    inline void matrix_multiply(const float *a, const float *b, float *result)
+    {
+        for (int r = 0; r < R; r++)
+        {
+            for (int k = 0; k < K; k++)
+            {
+                float v = 0.0f;
+
+                for (int i = 0; i < C; i++)
+                    v += a[r * C + i] * b[i * K + k];
+
+                result[r * K + k] = v;
+            }
+        }
+    }
+
+    template <>
+    inline void matrix_multiply<3, 3, 3>(const float *a, const float *b, float *result)
+    {
+        for (int r = 0; r < 9; r += 3)
+        {
+            float a0 = a[r], a1 = a[r + 1], a2 = a[r + 2];
+
+            result[r]     = a0 * b[0] + a1 * b[3] + a2 * b[6];
+            result[r + 1] = a0 * b[1] + a1 * b[4] + a2 * b[7];
+            result[r + 2] = a0 * b[2] + a1 * b[5] + a2 * b[8];
+        }
+    }
+
+    template <>
+    inline void matrix_multiply<4, 4, 4>(const float *a, const float *b, float *result)
+    {
+        for (int r = 0; r < 16; r += 4)
+        {
+            float a0 = a[r], a1 = a[r + 1], a2 = a[r + 2], a3 = a[r + 3];
+
+            result[r]     = a0 * b[0] + a1 * b[4] + a2 * b[8]  + a3 * b[12];
+            result[r + 1] = a0 * b[1] + a1 * b[5] + a2 * b[9]  + a3 * b[13];
+            result[r + 2] = a0 * b[2] + a1 * b[6] + a2 * b[10] + a3 * b[14];
+            result[r + 3] = a0 * b[3] + a1 * b[7] + a2 * b[11] + a3 * b[15];
+        }
+    }
+
+    template <>
+    inline void matrix_multiply<3, 3, 1>(const float *a, const float *b, float *result)
+    {
+        result[0] = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        result[1] = a[3] * b[0] + a[4] * b[1] + a[5] * b[2];
+        result[2] = a[6] * b[0] + a[7] * b[1] + a[8] * b[2];
+    }
+
+    template <>
+    inline void matrix_multiply<4, 4, 1>(const float *a, const float *b, float *result)
+    {
+        result[0] = a[0]  * b[0] + a[1]  * b[1] + a[2]  * b[2] + a[3]  * b[3];
+        result[1] = a[4]  * b[0] + a[5]  * b[1] + a[6]  * b[2] + a[7]  * b[3];
+        result[2] = a[8]  * b[0] + a[9]  * b[1] + a[10] * b[2] + a[11] * b[3];
+        result[3] = a[12] * b[0] + a[13] * b[1] + a[14] * b[2] + a[15] * b[3];
+    }
+
+    /**
+      * Class definition for a fixed size matrix of floats.
+      *
+      * The dimensions are part of the type, so the elements are held inline (on the stack, or within
+      * the enclosing object) and no operation allocates memory. Mismatched dimensions are compile time errors.
+      * This is intended for the small matrices used in 3D geometry and sensor fusion. See also Matrix4,
+      * for matrices whose size is only known at runtime.
+      *
+      * @code
+      * Matrix<3,3> rotation = Matrix<3,3>::identity();
+      * Matrix<3,1> v;
+      * Matrix<3,1> rotated = rotation.multiply(v);
+      * @endcode
+      */
+    template <int R, int C>
+    class Matrix
+    {
+        public:
+
+        float   data[R * C];        // The elements of the matrix, in row major order.
+
+        /**
+          * Constructor.
+          * Create a matrix with all elements set to zero.
+          */
+        Matrix()
+        {
+            for (int i = 0; i < R * C; i++)
+                data[i] = 0.0f;
+        }
+
+        /**
+          * Constructor.
+          * Create a matrix from the given values.
+          *
+          * @param values R * C values, in row major order.
+          */
+        Matrix(const float *values)
+        {
+            for (int i = 0; i < R * C; i++)
+                data[i] = values[i];
+        }
+
+        /**
+          * Provides an identity matrix of this size.
+          */
+        static Matrix identity()
+        {
+            Matrix m;
+
+            for (int i = 0; i < R && i < C; i++)
+                m.data[i * C + i] = 1.0f;
+
+            return m;
+        }
+
+        /**
+          * Determines the number of columns in this matrix.
+          */
+        static constexpr int width()
+        {
+            return C;
+        }
+
+        /**
+          * Determines the number of rows in this matrix.
+          */
+        static constexpr int height()
+        {
+            return R;
+        }
+
+        /**
+          * Reads the matrix element at the given position.
+          *
+          * @return The value of the matrix element at the given position. 0 is returned if the given index is out of range.
+          */
+        float get(int row, int col) const
+        {
+            if (row < 0 || col < 0 || row >= R || col >= C)
+                return 0;
+
+            return data[row * C + col];
+        }
+
+        /**
+          * Writes the matrix element at the given position. Indexes out of range are ignored.
+          */
+        void set(int row, int col, float v)
+        {
+            if (row < 0 || col < 0 || row >= R || col >= C)
+                return;
+
+            data[row * C + col] = v;
+        }
+
+        /**
+          * Unchecked access to the matrix element at the given position.
+          */
+        float& operator() (int row, int col)
+        {
+            return data[row * C + col];
+        }
+
+        float operator() (int row, int col) const
+        {
+            return data[row * C + col];
+        }
+
+        /**
+          * Transposes this matrix.
+          *
+          * @return the resultant matrix.
+          */
+        Matrix<C, R> transpose() const
+        {
+            Matrix<C, R> result;
+
+            for (int r = 0; r < R; r++)
+                for (int c = 0; c < C; c++)
+                    result.data[c * R + r] = data[r * C + c];
+
+            return result;
+        }
+
+        /**
+          * Multiplies this matrix with the given matrix.
+          *
+          * @param matrix the matrix to multiply this matrix's values against.
+          *
+          * @return the resultant matrix.
+          */
+        template <int K>
+        Matrix<R, K> multiply(const Matrix<C, K> &matrix) const
+        {
+            Matrix<R, K> result;
+            matrix_multiply<R, C, K>(data, matrix.data, result.data);
+            return result;
+        }
+
+        /**
+          * Multiplies the transpose of this matrix with the given matrix.
+          *
+          * @param matrix the matrix to multiply the transpose of this matrix against.
+          *
+          * @return the resultant matrix.
+          */
+        template <int K>
+        Matrix<C, K> multiplyT(const Matrix<R, K> &matrix) const
+        {
+            Matrix<C, K> result;
+
+            for (int c = 0; c < C; c++)
+            {
+                for (int k = 0; k < K; k++)
+                {
+                    float v = 0.0f;
+
+                    for (int i = 0; i < R; i++)
+                        v += data[i * C + c] * matrix.data[i * K + k];
+
+                    result.data[c * K + k] = v;
+                }
+            }
+
+            return result;
+        }
+
+        /**
+          * Inverts this matrix. Only 3x3 and 4x4 matrices are supported by this operation.
+          *
+          * @param result The matrix in which to store the inverse.
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if this matrix is singular.
+          */
+        int invert(Matrix &result) const
+        {
+            static_assert(R == C && (R == 3 || R == 4), "Only 3x3 and 4x4 matrices can be inverted");
+
+            if (&result == this)
+            {
+                Matrix m(*this);
+                return m.invert(result);
+            }
+
+            return R == 3 ? matrix_invert3(data, result.data) : matrix_invert4(data, result.data);
+        }
+
+        /**
+          * Applies this matrix to an array of samples.
+          * A 3x3 matrix is applied to each (x, y, z) sample directly. A 4x4 matrix treats each sample as
+          * the point (x, y, z, 1), so may also apply an offset; its bottom row is not used.
+          *
+          * @param in The samples to transform.
+          * @param out The array to store the results. May be the same as in.
+          * @param count The number of samples.
+          *
+          * @code
+          * Matrix<4,4> calibration;
+          * Sample3D samples[32];
+          * calibration.transform(samples, samples, 32);
+          * @endcode
+          */
+        void transform(const Sample3D *in, Sample3D *out, int count) const
+        {
+            static_assert(R == C && (R == 3 || R == 4), "Only 3x3 and 4x4 matrices can transform samples");
+
+            // Rows beyond the third are only read for 4x4 matrices, and the offsets are zero otherwise.
+            const float m00 = data[0],         m01 = data[1],         m02 = data[2];
+            const float m10 = data[C],         m11 = data[C + 1],     m12 = data[C + 2];
+            const float m20 = data[2 * C],     m21 = data[2 * C + 1], m22 = data[2 * C + 2];
+            const float t0 = C == 4 ? data[C - 1] : 0.0f;
+            const float t1 = C == 4 ? data[2 * C - 1] : 0.0f;
+            const float t2 = C == 4 ? data[3 * C - 1] : 0.0f;
+
+            for (int i = 0; i < count; i++)
+            {
+                float x = in[i].x, y = in[i].y, z = in[i].z;
+
+                out[i].x = roundToInt(m00 * x + m01 * y + m02 * z + t0);
+                out[i].y = roundToInt(m10 * x + m11 * y + m12 * z + t1);
+                out[i].z = roundToInt(m20 * x + m21 * y + m22 * z + t2);
+            }
+        }
+
+        /**
+          * Applies this matrix to a single sample, as transform(const Sample3D *, Sample3D *, int).
+          */
+        Sample3D transform(const Sample3D &s) const
+        {
+            Sample3D result;
+            transform(&s, &result, 1);
+            return result;
+        }
+
+        private:
+
+        static int roundToInt(float v)
+        {
+            return (int)(v < 0 ? v - 0.5f : v + 0.5f);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,322 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_PACKED_IMAGE_H
+#define CODAL_PACKED_IMAGE_H
+
+#include "CodalConfig.h"
+#include "Image.h"
+#include "RefCounted.h"
+
+namespace codal
+{
+    struct PackedImageData : RefCounted
+    {
+        uint16_t width;         // Width in pixels
+        uint16_t height;        // Height in pixels
+        uint16_t bitsPerPixel;  // 1, 2 or 4
+        uint16_t stride;        // Number of 32 bit words in each row
+        uint32_t data[0];       // Rows of pixels, packed LSB first, each starting on a word boundary
+    };
+
+    /**
+      * Class definition for a PackedImage.
+      *
+      * A PackedImage is a bitmap holding 1, 2 or 4 bits per pixel, rather than the byte per pixel of Image.
+      * Each row is a sequence of 32 bit words, with pixel 0 in the least significant bits of the first word,
+      * so blits, shifts and crops can move a whole word of pixels at a time. Any bits in the last word
+      * of a row beyond the width of the image are always zero.
+      *
+      * n.b. This is a mutable, managed type.
+      */
+    class PackedImage
+    {
+        PackedImageData *ptr;     // Pointer to payload data
+
+        /**
+          * Internal constructor which provides sanity checking and initialises class properties.
+          *
+          * @param x the width of the image
+          *
+          * @param y the height of the image
+          *
+          * @param bpp the number of bits per pixel: 1, 2 or 4.
+          */
+        void init(const int16_t x, const int16_t y, int bpp);
+
+        /**
+          * Internal constructor which defaults to the empty image.
+          */
+        void init_empty();
+
+        public:
+
+        /**
+          * Default Constructor.
+          * Creates a new reference to the empty (0x0) bitmap.
+          */
+        PackedImage();
+
+        /**
+          * Constructor.
+          * Create an image from a specially prepared constant array, with no copying. Will call ptr->incr().
+          *
+          * @param ptr The literal - 0xffff, then width, height, bits per pixel and stride as 16 bit values, then the packed rows.
+          * The literal has to be 4-byte aligned.
+          */
+        PackedImage(PackedImageData *ptr);
+
+        /**
+          * Constructor.
+          * Create a blank bitmap of a given size and depth.
+          *
+          * @param x the width of the image.
+          *
+          * @param y the height of the image.
+          *
+          * @param bpp the number of bits per pixel: 1, 2 or 4. Defaults to 1.
+          *
+          * @code
+          * PackedImage i(128, 64); // a frame buffer for a monochrome panel
+          * @endcode
+          */
+        PackedImage(const int16_t x, const int16_t y, int bpp = 1);
+
+        /**
+          * Constructor.
+          * Create a packed copy of an 8 bit per pixel Image.
+          *
+          * Brightness levels 0-255 are scaled to the range of the given depth, rounding up so that
+          * any pixel that is lit in the source remains lit. At 1 bit per pixel, any non-zero pixel is set.
+          *
+          * @param image the Image to convert.
+          *
+          * @param bpp the number of bits per pixel: 1, 2 or 4. Defaults to 1.
+          */
+        PackedImage(const Image &image, int bpp = 1);
+
+        /**
+          * Copy Constructor.
+          * Add ourselves as a reference to an existing PackedImage.
+          *
+          * @param image The PackedImage to reference.
+          */
+        PackedImage(const PackedImage &image);
+
+        /**
+          * Destructor.
+          * Removes buffer resources held by the instance.
+          */
+        ~PackedImage();
+
+        /**
+          * Copy assign operation.
+          *
+          * @param i The PackedImage to reference.
+          */
+        PackedImage& operator = (const PackedImage& i);
+
+        /**
+          * Equality operation.
+          *
+          * @param i The PackedImage to test ourselves against.
+          *
+          * @return true if this image has the same size, depth and pixels as the one supplied, false otherwise.
+          */
+        bool operator== (const PackedImage& i);
+
+        /**
+          * Return the packed rows of the bitmap.
+          */
+        uint32_t *getBitmap()
+        {
+            return ptr->data;
+        }
+
+        /**
+          * Gets the width of this image.
+          */
+        int getWidth() const
+        {
+            return ptr->width;
+        }
+
+        /**
+          * Gets the height of this image.
+          */
+        int getHeight() const
+        {
+            return ptr->height;
+        }
+
+        /**
+          * Gets the number of bits used for each pixel.
+          */
+        int getBitsPerPixel() const
+        {
+            return ptr->bitsPerPixel;
+        }
+
+        /**
+          * Gets the number of 32 bit words in each row of the bitmap.
+          */
+        int getStride() const
+        {
+            return ptr->stride;
+        }
+
+        /**
+          * Gets the largest pixel value this image can hold, i.e. (1 << bits per pixel) - 1.
+          */
+        int getMaxValue() const
+        {
+            return (1 << ptr->bitsPerPixel) - 1;
+        }
+
+        /**
+          * Resets all pixels in this image to 0.
+          */
+        void clear();
+
+        /**
+          * Sets the pixel at the given co-ordinates to a given value.
+          *
+          * @param x The co-ordinate of the pixel to change.
+          *
+          * @param y The co-ordinate of the pixel to change.
+          *
+          * @param value The new value of the pixel, from 0 to getMaxValue().
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER.
+          */
+        int setPixelValue(int16_t x , int16_t y, uint8_t value);
+
+        /**
+          * Retrieves the value of a given pixel.
+          *
+          * @param x The x co-ordinate of the pixel to read. Must be within the dimensions of the image.
+          *
+          * @param y The y co-ordinate of the pixel to read. Must be within the dimensions of the image.
+          *
+          * @return The value of the pixel, from 0 to getMaxValue(), or DEVICE_INVALID_PARAMETER.
+          */
+        int getPixelValue(int16_t x , int16_t y);
+
+        /**
+          * Pastes a given image at the given co-ordinates, a word of pixels at a time.
+          * Any pixels in the relevant area of this image are replaced.
+          *
+          * @param image The PackedImage to paste. It must have the same depth as this image.
+          *
+          * @param x The leftmost X co-ordinate in this image where the given image should be pasted. Defaults to 0.
+          *
+          * @param y The uppermost Y co-ordinate in this image where the given image should be pasted. Defaults to 0.
+          *
+          * @param alpha set to 1 if clear pixels in given image should be treated as transparent. Set to 0 otherwise. Defaults to 0.
+          *
+          * @return The number of pixels written, or DEVICE_INVALID_PARAMETER if the depths differ.
+          *
+          * @code
+          * PackedImage screen(128, 64);
+          * PackedImage sprite(Image("0,1,0\n1,1,1\n0,1,0\n"));
+          * screen.paste(sprite, 10, 20, 1);
+          * @endcode
+          */
+        int paste(const PackedImage &image, int16_t x = 0, int16_t y = 0, uint8_t alpha = 0);
+
+        /**
+          * Shifts the pixels in this image a given number of pixels to the left.
+          *
+          * @param n The number of pixels to shift.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int shiftLeft(int16_t n);
+
+        /**
+          * Shifts the pixels in this image a given number of pixels to the right.
+          *
+          * @param n The number of pixels to shift.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int shiftRight(int16_t n);
+
+        /**
+          * Shifts the pixels in this image a given number of pixels upward.
+          *
+          * @param n The number of pixels to shift.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int shiftUp(int16_t n);
+
+        /**
+          * Shifts the pixels in this image a given number of pixels downward.
+          *
+          * @param n The number of pixels to shift.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int shiftDown(int16_t n);
+
+        /**
+          * Creates a new image from a region of this one, clipped to the bounds of this image.
+          *
+          * @param startx the location to start the crop in the x-axis
+          *
+          * @param starty the location to start the crop in the y-axis
+          *
+          * @param cropWidth the width of the desired cropped region
+          *
+          * @param cropHeight the height of the desired cropped region
+          *
+          * @return the cropped image, of the same depth as this one.
+          */
+        PackedImage crop(int startx, int starty, int cropWidth, int cropHeight);
+
+        /**
+          * Converts this image to an 8 bit per pixel Image.
+          *
+          * Pixel values are scaled to brightness levels 0-255, so the largest value becomes 255.
+          *
+          * @return a new Image of the same size.
+          */
+        Image toImage();
+
+        /**
+          * Check if image is read-only (i.e., residing in flash).
+          */
+        bool isReadOnly();
+
+        /**
+          * Create a copy of the image bitmap. Used particularly, when isReadOnly() is true.
+          *
+          * @return an instance of PackedImage which can be modified independently of the current instance
+          */
+        PackedImage clone();
+    };
+}
+
+#endif
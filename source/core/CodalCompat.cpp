@@ -28,6 +28,7 @@ DEALINGS IN THE SOFTWARE.
   */
 #include "CodalConfig.h"
 #include "CodalCompat.h"
+#include "CodalFormat.h"
 #include "ErrorNo.h"
 
 static uint32_t random_value;
@@ -71,31 +72,10 @@ int codal::string_reverse(char *s)
   */
 int codal::itoa(int n, char *s)
 {
-    int i = 0;
-    int positive = (n >= 0);
-
     if (s == NULL)
         return DEVICE_INVALID_PARAMETER;
 
-    // Record the sign of the number,
-    // Ensure our working value is positive.
-    if (positive)
-        n = -n;
-
-    // Calculate each character, starting with the LSB.
-    do {
-         s[i++] = abs(n % 10) + '0';
-    } while (abs(n /= 10) > 0);
-
-    // Add a negative sign as needed
-    if (!positive)
-        s[i++] = '-';
-
-    // Terminate the string.
-    s[i] = '\0';
-
-    // Flip the order.
-    string_reverse(s);
+    format_decimal(s, n);
 
     return DEVICE_OK;
 }
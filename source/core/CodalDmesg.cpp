@@ -28,6 +28,7 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalDevice.h"
 #include "CodalConfig.h"
 #include "CodalCompat.h"
+#include "CodalFormat.h"
 #include "Timer.h"
 
 CodalLogStore codalLogStore;
@@ -68,52 +69,9 @@ static void logwrite(const char *msg)
     logwriten(msg, strlen(msg));
 }
 
-static void writeNum(char *buf, uint32_t n, bool full)
+static void logformatwrite(void *, const char *msg, int l)
 {
-    int i = 0;
-    int sh = 28;
-    while (sh >= 0)
-    {
-        int d = (n >> sh) & 0xf;
-        if (full || d || sh == 0 || i)
-        {
-            buf[i++] = d > 9 ? 'A' + d - 10 : '0' + d;
-        }
-        sh -= 4;
-    }
-    buf[i] = 0;
-}
-
-static void logwritenum(uint32_t n, bool full, bool hex)
-{
-    char buff[20];
-
-    if (hex)
-    {
-        writeNum(buff, n, full);
-        logwrite("0x");
-    }
-    else
-    {
-        itoa(n, buff);
-    }
-
-    logwrite(buff);
-}
-
-static void logwritedouble( double v, int precision = 8 )
-{
-    int iVal = (int)v;
-    double fRem = v - (double)iVal;
-
-    logwritenum( iVal, false, false );
-    logwrite(".");
-
-    while( precision-- > 0 ) {
-        fRem = fRem * 10.0;
-        logwritenum( (uint32_t)fRem, false, false );
-        fRem -= (int)fRem;
-    }
+    logwriten(msg, l);
 }
 
 void codal_dmesg_nocrlf(const char *format, ...)
@@ -154,75 +112,22 @@ void codal_dmesg_flush()
 
 void codal_vdmesg(const char *format, bool crlf, va_list ap)
 {
-    const char *end = format;
+    #if CONFIG_ENABLED(DMESG_SHOW_TIMES) || CONFIG_ENABLED(DMESG_SHOW_FIBERS)
+    char buff[CODAL_FORMAT_DECIMAL_SIZE];
+    #endif
 
     #if CONFIG_ENABLED(DMESG_SHOW_TIMES)
-    logwritenum( (uint32_t)system_timer_current_time(), false, false );
+    logwriten( buff, format_unsigned( buff, (uint32_t)system_timer_current_time() ) );
     logwrite( "\t" );
     #endif
 
     #if CONFIG_ENABLED(DMESG_SHOW_FIBERS)
-    logwritenum( (uint32_t)((uint64_t)currentFiber & 0x000000000000FFFF), false, true );
+    logwrite( "0x" );
+    logwriten( buff, format_hex( buff, (uint32_t)((uint64_t)currentFiber & 0x000000000000FFFF), 1, true ) );
     logwrite( "\t" );
     #endif
 
-    int param = 0;
-
-    while (*end)
-    {
-        if (*end++ == '%')
-        {
-            logwriten(format, end - format - 1);
-            param = 0;
-l_parse_continue:
-            switch (*end++)
-            {
-            case '0' ... '9': {
-                int val = (int)*(end-1) - (int)'0';
-                param = (param * 10) + val;
-                goto l_parse_continue; // Note that labels are only valid within a single method context, so this is semi-safe
-            } break;
-
-            case 'c': {
-                uint32_t val = va_arg(ap, uint32_t);
-                logwriten((const char *)&val, 1);
-            } break;
-            case 'u': // should be printed as unsigned, but will do for now
-            case 'd': {
-                uint32_t val = va_arg(ap, uint32_t);
-                logwritenum(val, false, false);
-            } break;
-            case 'x': {
-                uint32_t val = va_arg(ap, uint32_t);
-                logwritenum(val, false, true);
-            } break;
-            case 'p':
-            case 'X': {
-                uint32_t val = va_arg(ap, uint32_t);
-                logwritenum(val, true, true);
-            } break;
-            case 's': {
-                uint32_t val = va_arg(ap, uint32_t);
-                logwrite((char *)(void *)val);
-            } break;
-            case 'f': {
-                double val = va_arg(ap, double);
-                if( param > 0 )
-                    logwritedouble( val, param );
-                else
-                    logwritedouble( val, 4 );
-            } break;
-            case '%':
-                logwrite("%");
-                break;
-            default:
-                logwrite("???");
-                break;
-            }
-            format = end;
-        }
-    }
-    logwriten(format, end - format);
+    format_vprint(logformatwrite, NULL, CODAL_FORMAT_DMESG, format, ap);
 
     if (crlf)
         logwrite("\r\n");
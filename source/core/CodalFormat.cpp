@@ -0,0 +1,464 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Number and string formatting shared by Serial::printf(), DMESG and ManagedString.
+  *
+  * All functions write into caller provided memory, and never allocate or use libm.
+  */
+#include "CodalFormat.h"
+#include "CodalCompat.h"
+
+using namespace codal;
+
+// Decimal digits in pairs, so integers are converted two digits (and one division) at a time.
+static const char digitPairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char hexLower[] = "0123456789abcdef";
+static const char hexUpper[] = "0123456789ABCDEF";
+
+static const uint32_t powersOfTen[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+/**
+  * Writes exactly the given number of decimal digits of a value, ending just before the given address.
+  */
+static void writeDigits(char *end, uint32_t value, int count)
+{
+    while (count >= 2)
+    {
+        uint32_t q = value / 100;
+        const char *pair = &digitPairs[2 * (value - q * 100)];
+
+        *--end = pair[1];
+        *--end = pair[0];
+
+        value = q;
+        count -= 2;
+    }
+
+    if (count)
+        *--end = '0' + value;
+}
+
+/**
+  * Writes a run of padding characters.
+  */
+static int writePadding(FormatWriter writer, void *context, char c, int count)
+{
+    static const char spaces[] = "                ";
+    static const char zeros[] = "0000000000000000";
+
+    const int chunk = sizeof(spaces) - 1;
+
+    for (int remaining = count; remaining > 0; remaining -= chunk)
+        writer(context, c == '0' ? zeros : spaces, min(remaining, chunk));
+
+    return count;
+}
+
+/**
+  * Writes the decimal representation of an unsigned integer.
+  *
+  * @param buffer Where to write the NULL terminated result. Must hold at least CODAL_FORMAT_DECIMAL_SIZE bytes.
+  * @param value The number to convert.
+  *
+  * @return the number of characters written, excluding the NULL terminator.
+  */
+int codal::format_unsigned(char *buffer, uint32_t value)
+{
+    int count = 1;
+
+    while (count < 10 && value >= powersOfTen[count])
+        count++;
+
+    writeDigits(buffer + count, value, count);
+    buffer[count] = 0;
+
+    return count;
+}
+
+/**
+  * Writes the decimal representation of a signed integer.
+  *
+  * @param buffer Where to write the NULL terminated result. Must hold at least CODAL_FORMAT_DECIMAL_SIZE bytes.
+  * @param value The number to convert.
+  *
+  * @return the number of characters written, excluding the NULL terminator.
+  */
+int codal::format_decimal(char *buffer, int32_t value)
+{
+    if (value >= 0)
+        return format_unsigned(buffer, value);
+
+    // Negate as unsigned, so INT32_MIN is handled correctly.
+    *buffer = '-';
+    return format_unsigned(buffer + 1, 0u - (uint32_t)value) + 1;
+}
+
+/**
+  * Writes the hexadecimal representation of an unsigned integer, without any prefix.
+  *
+  * @param buffer Where to write the NULL terminated result. Must hold at least CODAL_FORMAT_HEX_SIZE bytes.
+  * @param value The number to convert.
+  * @param digits The minimum number of digits to write, padding with leading zeros (at most 8).
+  * @param upperCase true to use the digits A-F, false to use a-f.
+  *
+  * @return the number of characters written, excluding the NULL terminator.
+  */
+int codal::format_hex(char *buffer, uint32_t value, int digits, bool upperCase)
+{
+    const char *nibbles = upperCase ? hexUpper : hexLower;
+    int count = 1;
+
+    while (count < 8 && (value >> (count * 4)))
+        count++;
+
+    if (digits > count)
+        count = min(digits, 8);
+
+    buffer[count] = 0;
+
+    for (int i = count - 1; i >= 0; i--)
+    {
+        buffer[i] = nibbles[value & 0x0f];
+        value >>= 4;
+    }
+
+    return count;
+}
+
+/**
+  * Writes a floating point number in fixed point notation, rounded to the given number of decimal places.
+  * Values of magnitude 2^32 or more are written as "ovf", in addition to "inf" and "nan".
+  *
+  * @param buffer Where to write the NULL terminated result. Must hold at least CODAL_FORMAT_FIXED_SIZE bytes.
+  * @param value The number to convert.
+  * @param precision The number of decimal places, between 0 and CODAL_FORMAT_MAX_PRECISION.
+  *
+  * @return the number of characters written, excluding the NULL terminator.
+  */
+int codal::format_fixed(char *buffer, double value, int precision)
+{
+    char *p = buffer;
+    const char *special = NULL;
+
+    if (value != value)
+        special = "nan";
+
+    if (value < 0)
+    {
+        *p++ = '-';
+        value = -value;
+    }
+
+    if (special == NULL && value - value != 0)
+        special = "inf";
+    else if (special == NULL && value >= 4294967295.0)
+        special = "ovf";
+
+    if (special)
+    {
+        memcpy(p, special, 4);
+        return p - buffer + 3;
+    }
+
+    precision = max(0, min(precision, CODAL_FORMAT_MAX_PRECISION));
+
+    // Split into integer and fractional parts, rounding the fraction and carrying into the integer part if required.
+    uint32_t integer = (uint32_t)value;
+    uint32_t scale = powersOfTen[precision];
+    uint32_t fraction = (uint32_t)((value - integer) * scale + 0.5);
+
+    if (fraction >= scale)
+    {
+        fraction -= scale;
+        integer++;
+    }
+
+    p += format_unsigned(p, integer);
+
+    if (precision > 0)
+    {
+        *p++ = '.';
+        writeDigits(p + precision, fraction, precision);
+        p += precision;
+    }
+
+    *p = 0;
+
+    return p - buffer;
+}
+
+/**
+  * Formats a printf style string, passing the output to the given writer in as few calls as possible.
+  *
+  * Supported conversions are %c, %d, %i, %u, %x, %X, %p, %s, %f and %%, with the '-' and '0' flags,
+  * a field width, and a precision (the number of decimal places for %f, or the maximum length for %s).
+  * The length modifiers h, l and z are accepted and ignored. Unknown conversions are written as "???".
+  *
+  * @param writer The function to receive the output.
+  * @param context A pointer passed to the writer.
+  * @param flags 0, or CODAL_FORMAT_DMESG to use the DMESG dialect.
+  * @param format The format string.
+  * @param ap The arguments to format.
+  *
+  * @return the total number of characters output.
+  */
+int codal::format_vprint(FormatWriter writer, void *context, int flags, const char *format, va_list ap)
+{
+    bool dmesg = flags & CODAL_FORMAT_DMESG;
+    const char *literal = format;
+    int total = 0;
+
+    while (*format)
+    {
+        if (*format != '%')
+        {
+            format++;
+            continue;
+        }
+
+        // Output any text preceding this conversion in one go.
+        if (format > literal)
+        {
+            writer(context, literal, format - literal);
+            total += format - literal;
+        }
+
+        format++;
+
+        bool leftAlign = false;
+        bool zeroPad = false;
+        int width = 0;
+        int precision = -1;
+
+        for (;; format++)
+        {
+            if (*format == '-')
+                leftAlign = true;
+            else if (*format == '0')
+                zeroPad = true;
+            else
+                break;
+        }
+
+        while (*format >= '0' && *format <= '9')
+            width = width * 10 + (*format++ - '0');
+
+        if (*format == '.')
+        {
+            precision = 0;
+            format++;
+
+            while (*format >= '0' && *format <= '9')
+                precision = precision * 10 + (*format++ - '0');
+        }
+
+        while (*format == 'h' || *format == 'l' || *format == 'z')
+            format++;
+
+        char field[CODAL_FORMAT_FIXED_SIZE];
+        const char *text = field;
+        const char *prefix = NULL;
+        int prefixLength = 0;
+        int length = 0;
+        bool numeric = true;
+        char conversion = *format;
+
+        if (conversion)
+            format++;
+
+        switch (conversion)
+        {
+            case 'c':
+                field[0] = (char)va_arg(ap, int);
+                length = 1;
+                numeric = false;
+                break;
+
+            case 'd':
+            case 'i':
+            {
+                int32_t value = va_arg(ap, int32_t);
+
+                if (value < 0)
+                {
+                    prefix = "-";
+                    prefixLength = 1;
+                }
+
+                length = format_unsigned(field, value < 0 ? 0u - (uint32_t)value : (uint32_t)value);
+                break;
+            }
+
+            case 'u':
+                length = format_unsigned(field, va_arg(ap, uint32_t));
+                break;
+
+            case 'x':
+            case 'X':
+            case 'p':
+            {
+                uint32_t value = conversion == 'p' ? (uint32_t)(uintptr_t)va_arg(ap, void *) : va_arg(ap, uint32_t);
+                int digits = (conversion == 'p' || (dmesg && conversion == 'X')) ? 8 : 1;
+
+                length = format_hex(field, value, digits, dmesg || conversion == 'X');
+
+                if (dmesg || conversion == 'p')
+                {
+                    prefix = "0x";
+                    prefixLength = 2;
+                }
+                break;
+            }
+
+            case 's':
+                text = va_arg(ap, const char *);
+
+                if (text == NULL)
+                    text = "(null)";
+
+                while (text[length] && (precision < 0 || length < precision))
+                    length++;
+
+                numeric = false;
+                break;
+
+            case 'f':
+                if (precision < 0 && dmesg)
+                {
+                    precision = width > 0 ? width : 4;
+                    width = 0;
+                }
+                else if (precision < 0)
+                {
+                    precision = 6;
+                }
+
+                length = format_fixed(field, va_arg(ap, double), precision);
+
+                if (field[0] == '-')
+                {
+                    prefix = "-";
+                    prefixLength = 1;
+                    text++;
+                    length--;
+                }
+                break;
+
+            case '%':
+                field[0] = '%';
+                length = 1;
+                numeric = false;
+                break;
+
+            default:
+                text = "???";
+                length = 3;
+                numeric = false;
+                break;
+        }
+
+        int padding = max(0, width - prefixLength - length);
+
+        if (padding && !leftAlign && !(zeroPad && numeric))
+            writePadding(writer, context, ' ', padding);
+
+        if (prefixLength)
+            writer(context, prefix, prefixLength);
+
+        if (padding && !leftAlign && zeroPad && numeric)
+            writePadding(writer, context, '0', padding);
+
+        if (length)
+            writer(context, text, length);
+
+        if (padding && leftAlign)
+            writePadding(writer, context, ' ', padding);
+
+        total += padding + prefixLength + length;
+        literal = format;
+    }
+
+    if (format > literal)
+    {
+        writer(context, literal, format - literal);
+        total += format - literal;
+    }
+
+    return total;
+}
+
+struct FormatStringContext
+{
+    char *buffer;
+    int remaining;
+};
+
+static void formatStringWriter(void *context, const char *data, int length)
+{
+    FormatStringContext *c = (FormatStringContext *)context;
+
+    length = min(length, c->remaining);
+    memcpy(c->buffer, data, length);
+
+    c->buffer += length;
+    c->remaining -= length;
+}
+
+/**
+  * Formats a printf style string into a buffer, as format_vprint().
+  * The output is truncated if necessary, and is always NULL terminated.
+  *
+  * @param buffer The buffer to write to.
+  * @param size The size of the buffer in bytes.
+  * @param format The format string.
+  *
+  * @return the number of characters written, excluding the NULL terminator.
+  */
+int codal::format_string(char *buffer, int size, const char *format, ...)
+{
+    if (buffer == NULL || size <= 0)
+        return 0;
+
+    FormatStringContext context;
+    context.buffer = buffer;
+    context.remaining = size - 1;
+
+    va_list ap;
+    va_start(ap, format);
+    format_vprint(formatStringWriter, &context, 0, format, ap);
+    va_end(ap);
+
+    *context.buffer = 0;
+
+    return context.buffer - buffer;
+}
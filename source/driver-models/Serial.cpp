@@ -1,6 +1,7 @@
 #include "Serial.h"
 #include "NotifyEvents.h"
 #include "CodalDmesg.h"
+#include "CodalFormat.h"
 
 using namespace codal;
 
@@ -22,26 +23,25 @@ void Serial::dataReceived(char c)
     if(!(status & CODAL_SERIAL_STATUS_RX_BUFF_INIT))
         return;
 
-    int delimeterOffset = 0;
-    int delimLength = this->delimeters.length();
+    uint8_t u = (uint8_t)c;
+    bool isDelimeter = (delimeterMap[u >> 5] >> (u & 31)) & 1;
 
-    //iterate through our delimeters (if any) to see if there is a match
-    while(delimeterOffset < delimLength)
-    {
-        //fire an event if there is to block any waiting fibers
-        if(this->delimeters.charAt(delimeterOffset) == c)
-            Event(this->id, CODAL_SERIAL_EVT_DELIM_MATCH);
-
-        delimeterOffset++;
-    }
+    //fire an event if there is to block any waiting fibers
+    if(((eventDelimeterMap[u >> 5] >> (u & 31)) & 1) || (isDelimeter && rxBuffDelimWait))
+        Event(this->id, CODAL_SERIAL_EVT_DELIM_MATCH);
 
-    uint16_t newHead = (rxBuffHead + 1) % rxBuffSize;
+    uint16_t newHead = (rxBuffHead + 1) & (rxBuffSize - 1);
 
     //look ahead to our newHead value to see if we are about to collide with the tail
     if(newHead != rxBuffTail)
     {
         //if we are not, store the character, and update our actual head.
         this->rxBuff[rxBuffHead] = c;
+
+        //remember where the most recent delimeter is, so readUntil() doesn't need to search for it.
+        if(isDelimeter)
+            rxBuffDelimMatch = rxBuffHead;
+
         rxBuffHead = newHead;
 
         //if we have any fibers waiting for a specific number of characters, unblock them
@@ -55,8 +55,11 @@ void Serial::dataReceived(char c)
         status |= CODAL_SERIAL_STATUS_RXD;
     }
     else
+    {
         //otherwise, our buffer is full, send an event to the user...
+        rxOverflowCount++;
         Event(this->id, CODAL_SERIAL_EVT_RX_FULL);
+    }
 }
 
 void Serial::dataTransmitted()
@@ -64,31 +67,47 @@ void Serial::dataTransmitted()
     if(!(status & CODAL_SERIAL_STATUS_TX_BUFF_INIT))
         return;
 
-    //send our current char
-    putc((char)txBuff[txBuffTail]);
+    uint8_t queueTail = txQueueTail;
 
-    //unblock any waiting fibers that are waiting for transmission to finish.
-    uint16_t nextTail = (txBuffTail + 1) % txBuffSize;
+    if(queueTail != txQueueHead && txQueue[queueTail % CODAL_SERIAL_TX_QUEUE_SIZE].mark == txBuffTail)
+    {
+        //the next queued buffer is due, so send directly from it.
+        SerialTxBuffer &b = txQueue[queueTail % CODAL_SERIAL_TX_QUEUE_SIZE];
+
+        putc((char)b.buffer.getBytes()[b.offset++]);
 
-    if(nextTail == txBuffHead)
+        //once it is complete, leave the buffer for a fiber to release.
+        if(b.offset >= b.buffer.length())
+            txQueueTail = ++queueTail;
+    }
+    else
+    {
+        //send our current char
+        putc((char)txBuff[txBuffTail]);
+
+        //update our tail!
+        txBuffTail = (txBuffTail + 1) & (txBuffSize - 1);
+    }
+
+    //unblock any waiting fibers that are waiting for transmission to finish.
+    if(txBuffTail == txBuffHead && queueTail == txQueueHead)
     {
         Event(DEVICE_ID_NOTIFY, CODAL_SERIAL_EVT_TX_EMPTY);
         disableInterrupt(TxInterrupt);
     }
-
-    //update our tail!
-    txBuffTail = nextTail;
 }
 
 int Serial::setTxInterrupt(uint8_t *string, int len, SerialMode mode)
 {
     int copiedBytes = 0;
+    uint16_t mask = txBuffSize - 1;
 
     while(copiedBytes < len)
     {
-        uint16_t nextHead = (txBuffHead + 1) % txBuffSize;
+        // Copy as much as will fit into the free space, in at most two segments.
+        int space = (txBuffTail - txBuffHead - 1) & mask;
 
-        if(nextHead == txBuffTail)
+        if(space == 0)
         {
             enableInterrupt(TxInterrupt);
 
@@ -100,11 +119,19 @@ int Serial::setTxInterrupt(uint8_t *string, int len, SerialMode mode)
 
             if(mode == ASYNC)
                 break;
+
+            continue;
         }
 
-        this->txBuff[txBuffHead] = string[copiedBytes];
-        txBuffHead = nextHead;
-        copiedBytes++;
+        int l = min(len - copiedBytes, space);
+        int first = min(l, txBuffSize - txBuffHead);
+
+        memcpy(&txBuff[txBuffHead], &string[copiedBytes], first);
+        memcpy(&txBuff[0], &string[copiedBytes + first], l - first);
+
+        // Publish the new head only once the data is in place, as the TX interrupt may already be running.
+        txBuffHead = (txBuffHead + l) & mask;
+        copiedBytes += l;
     }
 
     //set the TX interrupt
@@ -113,8 +140,70 @@ int Serial::setTxInterrupt(uint8_t *string, int len, SerialMode mode)
     return copiedBytes;
 }
 
+/**
+ * Queues a ManagedBuffer for transmission without copying it. If the queue is full, ASYNC mode
+ * falls back to copying what will fit into the txBuff, and the other modes wait for the queue to drain.
+ *
+ * @return the number of bytes queued.
+ */
+int Serial::queueTxBuffer(ManagedBuffer buffer, SerialMode mode)
+{
+    releaseTxBuffers();
+
+    while((uint8_t)(txQueueHead - txQueueFree) >= CODAL_SERIAL_TX_QUEUE_SIZE)
+    {
+        if(mode == ASYNC)
+            return setTxInterrupt(buffer.getBytes(), buffer.length(), ASYNC);
+
+        if(mode == SYNC_SLEEP)
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, CODAL_SERIAL_EVT_TX_EMPTY);
+
+        if(mode == SYNC_SPINWAIT)
+            while(txBufferedSize() > 0);
+
+        releaseTxBuffers();
+    }
+
+    SerialTxBuffer &b = txQueue[txQueueHead % CODAL_SERIAL_TX_QUEUE_SIZE];
+
+    b.buffer = buffer;
+    b.offset = 0;
+    b.mark = txBuffHead;
+
+    // Publish the entry only once it is complete, as the TX interrupt may already be running.
+    txQueueHead = txQueueHead + 1;
+
+    enableInterrupt(TxInterrupt);
+
+    return buffer.length();
+}
+
+/**
+ * Releases our references to any queued buffers that have been transmitted.
+ */
+void Serial::releaseTxBuffers()
+{
+    uint8_t queueTail = txQueueTail;
+
+    while(txQueueFree != queueTail)
+        txQueue[txQueueFree++ % CODAL_SERIAL_TX_QUEUE_SIZE].buffer = ManagedBuffer();
+}
+
+/**
+ * Discards any queued buffers that have not yet been transmitted.
+ */
+void Serial::discardTxBuffers()
+{
+    txQueueTail = txQueueHead;
+    releaseTxBuffers();
+}
+
 void Serial::idleCallback()
 {
+    // Drop our references to buffers that have been sent, unless a fiber is busy queueing more.
+    if (txQueueFree != txQueueTail && !txInUse())
+        releaseTxBuffers();
+
     if (this->status & CODAL_SERIAL_STATUS_RXD)
     {
         Event(this->id, CODAL_SERIAL_EVT_DATA_RECEIVED);
@@ -174,6 +263,7 @@ int Serial::initialiseRx()
 
     this->rxBuffHead = 0;
     this->rxBuffTail = 0;
+    this->rxBuffDelimMatch = -1;
 
     //set the receive interrupt
     status |= CODAL_SERIAL_STATUS_RX_BUFF_INIT;
@@ -193,6 +283,9 @@ int Serial::initialiseTx()
         //ensure that we receive no interrupts after freeing our buffer
         disableInterrupt(TxInterrupt);
         free(this->txBuff);
+
+        //queued buffers are positioned relative to the old txBuff, so can't be kept.
+        discardTxBuffers();
     }
 
     status &= ~CODAL_SERIAL_STATUS_TX_BUFF_INIT;
@@ -224,16 +317,49 @@ int Serial::initialiseTx()
  * @note this method assumes that the linear buffer has the appropriate amount of
  *       memory to contain the copy operation
  */
-void Serial::circularCopy(uint8_t *circularBuff, uint8_t circularBuffSize, uint8_t *linearBuff, uint16_t tailPosition, uint16_t headPosition)
+void Serial::circularCopy(uint8_t *circularBuff, uint16_t circularBuffSize, uint8_t *linearBuff, uint16_t tailPosition, uint16_t headPosition)
 {
-    int toBuffIndex = 0;
+    int length = (headPosition - tailPosition) & (circularBuffSize - 1);
+    int first = min(length, circularBuffSize - tailPosition);
 
-    while(tailPosition != headPosition)
-    {
-        linearBuff[toBuffIndex++] = circularBuff[tailPosition];
+    memcpy(linearBuff, &circularBuff[tailPosition], first);
+    memcpy(&linearBuff[first], &circularBuff[0], length - first);
+}
 
-        tailPosition = (tailPosition + 1) % circularBuffSize;
-    }
+/**
+ * Copies up to len bytes from rxBuff into the given buffer, and consumes them.
+ *
+ * @param buffer a pointer to the destination linear buffer
+ *
+ * @param len the maximum number of bytes to copy
+ *
+ * @return the number of bytes copied.
+ */
+int Serial::rxCopy(uint8_t *buffer, int len)
+{
+    uint16_t head = rxBuffHead;
+    int l = min(len, (head - rxBuffTail) & (rxBuffSize - 1));
+
+    circularCopy(rxBuff, rxBuffSize, buffer, rxBuffTail, (rxBuffTail + l) & (rxBuffSize - 1));
+    rxBuffTail = (rxBuffTail + l) & (rxBuffSize - 1);
+
+    return l;
+}
+
+/*
+ * Determines the size of ring buffer to allocate for the given usable size: the next power of two
+ * that leaves room for the unused byte that separates the head from the tail.
+ */
+static uint16_t ringBufferSize(int size)
+{
+    int s = 2;
+
+    size = min(size, CODAL_SERIAL_MAX_BUFFER_SIZE);
+
+    while (s < size + 1)
+        s <<= 1;
+
+    return s;
 }
 
 
@@ -258,13 +384,14 @@ void Serial::circularCopy(uint8_t *circularBuff, uint8_t circularBuffSize, uint8
  *
  *       Buffers aren't allocated until the first send or receive respectively.
  */
-Serial::Serial(Pin& tx, Pin& rx, uint8_t rxBufferSize, uint8_t txBufferSize, uint16_t id) : tx(&tx), rx(&rx)
+Serial::Serial(Pin& tx, Pin& rx, uint16_t rxBufferSize, uint16_t txBufferSize, uint16_t id) : tx(&tx), rx(&rx)
 {
     this->id = id;
 
-    // + 1 so there is a usable buffer size, of the size the user requested.
-    this->rxBuffSize = rxBufferSize + 1;
-    this->txBuffSize = txBufferSize + 1;
+    // Rounded up so there is a usable buffer size of at least the size the user requested.
+    this->rxBuffSize = ringBufferSize(rxBufferSize);
+    this->txBuffSize = ringBufferSize(txBufferSize);
+    this->rxOverflowCount = 0;
 
     this->rxBuff = NULL;
     this->txBuff = NULL;
@@ -275,7 +402,15 @@ Serial::Serial(Pin& tx, Pin& rx, uint8_t rxBufferSize, uint8_t txBufferSize, uin
     this->txBuffHead = 0;
     this->txBuffTail = 0;
 
+    this->txQueueHead = 0;
+    this->txQueueTail = 0;
+    this->txQueueFree = 0;
+
     this->rxBuffHeadMatch = -1;
+    this->rxBuffDelimMatch = -1;
+    this->rxBuffDelimWait = false;
+    memclr(this->delimeterMap, sizeof(this->delimeterMap));
+    memclr(this->eventDelimeterMap, sizeof(this->eventDelimeterMap));
 
     reassignPin(&this->tx, &tx);
     reassignPin(&this->rx, &rx);
@@ -395,84 +530,134 @@ int Serial::send(uint8_t *buffer, int bufferLen, SerialMode mode)
     return bytesWritten;
 }
 
-#if CONFIG_ENABLED(CODAL_PROVIDE_PRINTF)
-void Serial::printf(const char* format, ...)
+/**
+ * Sends a ManagedBuffer over the serial line, without copying it into the txBuff.
+ * A reference to the buffer is held until it has been transmitted, so the caller
+ * may release its own reference as soon as this method returns.
+ *
+ * @param buffer the buffer to send
+ *
+ * @param mode the selected mode, one of: ASYNC, SYNC_SPINWAIT, SYNC_SLEEP. Each mode
+ *        gives a different behaviour:
+ *
+ *            ASYNC - the buffer is queued and this method returns immediately.
+ *                    If CODAL_SERIAL_TX_QUEUE_SIZE buffers are already queued, as
+ *                    much of the buffer as will fit is copied into the txBuff instead.
+ *
+ *            SYNC_SPINWAIT - the buffer is queued and this method will spin
+ *                            (lock up the processor) until it has been sent.
+ *
+ *            SYNC_SLEEP - the buffer is queued and the fiber sleeps until it
+ *                         has been sent. This allows other fibers to continue execution.
+ *
+ *         Defaults to SYNC_SLEEP.
+ *
+ * @return the number of bytes queued, CODAL_SERIAL_IN_USE if another fiber
+ *         is using the serial instance for transmission, or DEVICE_INVALID_PARAMETER
+ *         if the buffer is empty.
+ *
+ * @note The contents of the buffer should not be modified until it has been sent.
+ */
+int Serial::send(ManagedBuffer buffer, SerialMode mode)
 {
-    va_list arg;
-    va_start(arg, format);
+    return send(&buffer, 1, mode);
+}
+
+/**
+ * Sends a sequence of ManagedBuffers over the serial line as a single transmission,
+ * for example a protocol header followed by its payload. No other fiber can send
+ * between the buffers, and none of them are copied unless the transmit queue is full.
+ *
+ * @param buffers an array of the buffers to send, in order. Empty buffers are skipped.
+ *
+ * @param count the number of buffers in the array.
+ *
+ * @param mode the selected mode, one of: ASYNC, SYNC_SPINWAIT, SYNC_SLEEP, as for send(ManagedBuffer).
+ *
+ * @return the total number of bytes queued, CODAL_SERIAL_IN_USE if another fiber
+ *         is using the serial instance for transmission, or DEVICE_INVALID_PARAMETER
+ *         if buffers is NULL, or count is <= 0.
+ */
+int Serial::send(ManagedBuffer *buffers, int count, SerialMode mode)
+{
+    if(txInUse())
+        return DEVICE_SERIAL_IN_USE;
 
-    const char *end = format;
+    if(count <= 0 || buffers == NULL)
+        return DEVICE_INVALID_PARAMETER;
 
-    // We might want to call disable / enable interrupts on the serial line if print is called from ISR context
-    char buff[20];
-    while (*end)
+    int total = 0;
+
+    for(int i = 0; i < count; i++)
+        total += buffers[i].length();
+
+    if(total == 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    lockTx();
+
+    //lazy initialisation of our tx buffer
+    if(!(status & CODAL_SERIAL_STATUS_TX_BUFF_INIT))
     {
-        char current = *end++;
-        if (current == '%')
+        int result = initialiseTx();
+
+        if(result != DEVICE_OK)
         {
-            uint32_t val = va_arg(arg, uint32_t);
-            char* str = (char *)((void *)val);
-            char* buffPtr = buff;
-            char c = 0;
-            bool firstDigitFound = false;
-            bool lowerCase = false;
-            switch (*end++)
-            {
+            unlockTx();
+            return result;
+        }
+    }
 
-            case 'c':
-                putc((char)val);
-                break;
-            case 'd':
-                memset(buff, 0, 20);
-                itoa(val, buff);
-                while((c = *buffPtr++) != 0)
-                    putc(c);
-                break;
+    int bytesWritten = 0;
 
-            case 's':
-                while((c = *str++) != 0)
-                    putc(c);
-                break;
+    for(int i = 0; i < count; i++)
+    {
+        if(buffers[i].length() == 0)
+            continue;
 
-            case '%':
-                putc('%');
-                break;
+        int queued = queueTxBuffer(buffers[i], mode);
+        bytesWritten += queued;
 
-            case 'x':
-                lowerCase = true;
-                // fall through
-            case 'X':
-                for (uint8_t i = 8; i > 0; i--)
-                {
-                    uint8_t digit = ((uint8_t) (val >> ((i - 1) * 4)) & 0x0f) + (uint8_t) '0';
-                    if (digit > '9')
-                    {
-                        if (lowerCase)
-                            digit += 39;
-                        else
-                            digit += 7;
-                    }
-                    if (digit != '0')
-                    {
-                        putc((char)digit);
-                        firstDigitFound = true;
-                    }
-                    else if (firstDigitFound || i == 1)
-                        putc((char)digit);
-                }
-                break;
-            case 'p':
-            default:
-                putc('?');
-                putc('?');
-                putc('?');
-                break;
-            }
-        }
-        else
-            putc(current);
+        // In ASYNC mode, stop at the first buffer that could not be sent in full, so the output is not corrupted.
+        if(queued < buffers[i].length())
+            break;
     }
 
+    //wait for our buffers to be sent, so the caller is free to modify them on return.
+    if(mode == SYNC_SLEEP)
+        while(txBufferedSize() > 0)
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, CODAL_SERIAL_EVT_TX_EMPTY);
+
+    if(mode == SYNC_SPINWAIT)
+        while(txBufferedSize() > 0);
+
+    releaseTxBuffers();
+
+    unlockTx();
+
+    return bytesWritten;
+}
+
+#if CONFIG_ENABLED(CODAL_PROVIDE_PRINTF)
+/**
+  * Passes formatted output from printf() directly to the hardware, one character at a time.
+  */
+static void serialPrintfWriter(void *context, const char *data, int length)
+{
+    Serial *serial = (Serial *)context;
+
+    while (length--)
+        serial->putc(*data++);
+}
+
+void Serial::printf(const char* format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+
+    // We might want to call disable / enable interrupts on the serial line if print is called from ISR context
+    format_vprint(serialPrintfWriter, this, 0, format, arg);
+
     va_end(arg);
 }
 #endif
@@ -564,7 +749,7 @@ int Serial::getChar(SerialMode mode)
 
     char c = rxBuff[rxBuffTail];
 
-    rxBuffTail = (rxBuffTail + 1) % rxBuffSize;
+    rxBuffTail = (rxBuffTail + 1) & (rxBuffSize - 1);
 
     return c;
 }
@@ -607,6 +792,34 @@ ManagedString Serial::read(int size, SerialMode mode)
     return ManagedString((char *)buff, returnedSize);
 }
 
+/**
+ * Reads multiple bytes from the rxBuff directly into a newly allocated ManagedBuffer,
+ * avoiding the intermediate copies made when reading into a ManagedString.
+ *
+ * @param size the number of bytes to read.
+ *
+ * @param mode the selected mode, one of: ASYNC, SYNC_SPINWAIT, SYNC_SLEEP, as for read(uint8_t*, int, SerialMode).
+ *
+ * @return A ManagedBuffer containing the bytes read, which may be shorter than size in ASYNC mode,
+ *         or an empty ManagedBuffer if no data was read or an error was encountered.
+ */
+ManagedBuffer Serial::readBuffer(int size, SerialMode mode)
+{
+    if(size <= 0)
+        return ManagedBuffer();
+
+    ManagedBuffer buffer(size);
+
+    int returnedSize = read(buffer.getBytes(), size, mode);
+
+    if(returnedSize <= 0)
+        return ManagedBuffer();
+
+    buffer.truncate(returnedSize);
+
+    return buffer;
+}
+
 /**
  * Reads multiple characters from the rxBuff and fills a user buffer.
  *
@@ -650,38 +863,23 @@ int Serial::read(uint8_t *buffer, int bufferLen, SerialMode mode)
             return result;
     }
 
-    int bufferIndex = 0;
-
-    int temp = 0;
+    // Copy whatever is already buffered in bulk, then wait for more if the mode requires it.
+    int bufferIndex = rxCopy(buffer, bufferLen);
 
-    if(mode == ASYNC)
+    while(bufferIndex < bufferLen && mode != ASYNC)
     {
-        while(bufferIndex < bufferLen && (temp = getChar(mode)) != DEVICE_NO_DATA)
-        {
-            buffer[bufferIndex] = (char)temp;
-            bufferIndex++;
-        }
-    }
+        if(mode == SYNC_SPINWAIT)
+            while(!isReadable());
 
-    if(mode == SYNC_SPINWAIT)
-    {
-        while(bufferIndex < bufferLen)
+        if(mode == SYNC_SLEEP)
         {
-            buffer[bufferIndex] = (char)getChar(mode);
-            bufferIndex++;
-        }
-    }
+            int needed = min(bufferLen - bufferIndex, rxBuffSize - 1) - rxBufferedSize();
 
-    if(mode == SYNC_SLEEP)
-    {
-        if(bufferLen > rxBufferedSize())
-            eventAfter(bufferLen - rxBufferedSize(), mode);
-
-        while(bufferIndex < bufferLen)
-        {
-            buffer[bufferIndex] = (char)getChar(mode);
-            bufferIndex++;
+            if(needed > 0)
+                eventAfter(needed, mode);
         }
+
+        bufferIndex += rxCopy(buffer + bufferIndex, bufferLen - bufferIndex);
     }
 
     unlockRx();
@@ -734,59 +932,35 @@ ManagedString Serial::readUntil(ManagedString delimeters, SerialMode mode)
 
     lockRx();
 
-    int localTail = rxBuffTail;
     int preservedTail = rxBuffTail;
 
-    int foundIndex = -1;
-
-    //ASYNC mode just iterates through our stored characters checking for any matches.
-    while(localTail != rxBuffHead && foundIndex  == -1)
-    {
-        //we use localTail to prevent modification of the actual tail.
-        char c = rxBuff[localTail];
-
-        for(int delimeterIterator = 0; delimeterIterator < delimeters.length(); delimeterIterator++)
-            if(delimeters.charAt(delimeterIterator) == c)
-                foundIndex = localTail;
-
-        localTail = (localTail + 1) % rxBuffSize;
-    }
+    //have our receive interrupt track these delimeters. If they have changed, we need to search the whole buffer once.
+    bool changed = setDelimeterMap(delimeters);
+    int foundIndex = findDelimeter(changed);
 
     //if our mode is SYNC_SPINWAIT and we didn't see any matching characters in our buffer
     //spin until we find a match!
     if(mode == SYNC_SPINWAIT)
-    {
         while(foundIndex == -1)
-        {
-            while(localTail == rxBuffHead);
-
-            char c = rxBuff[localTail];
-
-            for(int delimeterIterator = 0; delimeterIterator < delimeters.length(); delimeterIterator++)
-                if(delimeters.charAt(delimeterIterator) == c)
-                    foundIndex = localTail;
-
-            localTail = (localTail + 1) % rxBuffSize;
-        }
-    }
+            foundIndex = findDelimeter(false);
 
-    //if our mode is SYNC_SLEEP, we set up an event to be fired when we see a
-    //matching character.
+    //if our mode is SYNC_SLEEP, we have our receive interrupt raise an event when it sees a
+    //matching character. Check again once the event is enabled, in case one arrived in the meantime.
+    //Any delimeters set by eventOn() are left as they are.
     if(mode == SYNC_SLEEP && foundIndex == -1)
     {
-        eventOn(delimeters, mode);
+        rxBuffDelimWait = true;
 
-        foundIndex = rxBuffHead - 1;
-        if (foundIndex < 0)
-            foundIndex += rxBuffSize;
+        while((foundIndex = findDelimeter(false)) == -1)
+            fiber_wait_for_event(this->id, CODAL_SERIAL_EVT_DELIM_MATCH);
 
-        this->delimeters = ManagedString();
+        rxBuffDelimWait = false;
     }
 
     if(foundIndex >= 0)
     {
         //calculate our local buffer size
-        int localBuffSize = (preservedTail > foundIndex) ? (rxBuffSize - preservedTail) + foundIndex : foundIndex - preservedTail;
+        int localBuffSize = (foundIndex - preservedTail) & (rxBuffSize - 1);
 
         uint8_t localBuff[localBuffSize + 1];
 
@@ -795,7 +969,13 @@ ManagedString Serial::readUntil(ManagedString delimeters, SerialMode mode)
         circularCopy(rxBuff, rxBuffSize, localBuff, preservedTail, foundIndex);
 
         //plus one for the character we listened for...
-        rxBuffTail = (rxBuffTail + localBuffSize + 1) % rxBuffSize;
+        rxBuffTail = (rxBuffTail + localBuffSize + 1) & (rxBuffSize - 1);
+
+        //if that was the most recent delimeter, there are no more in the buffer.
+        target_disable_irq();
+        if(rxBuffDelimMatch == foundIndex)
+            rxBuffDelimMatch = -1;
+        target_enable_irq();
 
         unlockRx();
 
@@ -807,6 +987,100 @@ ManagedString Serial::readUntil(ManagedString delimeters, SerialMode mode)
     return ManagedString();
 }
 
+/**
+ * Builds a bitmap of the given characters, indexed by character.
+ */
+static void buildDelimeterMap(uint32_t *map, ManagedString delimeters)
+{
+    memclr(map, 8 * sizeof(uint32_t));
+
+    for(int i = 0; i < delimeters.length(); i++)
+    {
+        uint8_t c = (uint8_t)delimeters.charAt(i);
+        map[c >> 5] |= 1UL << (c & 31);
+    }
+}
+
+/**
+ * Rebuilds the bitmap of delimeters tracked by our receive interrupt for readUntil(), if they have changed.
+ *
+ * @param delimeters the characters to track.
+ *
+ * @return true if the delimeters have changed, in which case the position of the last delimeter received is unknown.
+ */
+bool Serial::setDelimeterMap(ManagedString delimeters)
+{
+    uint32_t map[8];
+
+    buildDelimeterMap(map, delimeters);
+
+    if(memcmp(map, delimeterMap, sizeof(map)) == 0)
+        return false;
+
+    target_disable_irq();
+    memcpy(delimeterMap, map, sizeof(map));
+    rxBuffDelimMatch = -1;
+    target_enable_irq();
+
+    return true;
+}
+
+/**
+ * Finds the first delimeter in the rxBuff, without consuming any data.
+ *
+ * @param searchAll if true, search the whole buffer. Otherwise, use the position of the last delimeter recorded
+ *        by our receive interrupt to avoid searching when there is no delimeter, and to bound the search when there is.
+ *
+ * @return the index of the first delimeter in rxBuff, or -1 if there is none.
+ */
+int Serial::findDelimeter(bool searchAll)
+{
+    uint16_t mask = rxBuffSize - 1;
+    uint16_t tail = rxBuffTail;
+    int last = rxBuffDelimMatch;
+    int available = (rxBuffHead - tail) & mask;
+    int limit = available;
+
+    if(!searchAll)
+    {
+        // The last delimeter received is always in the buffer if any delimeter is, as it is the most recent.
+        if(last < 0 || ((last - tail) & mask) >= available)
+            return -1;
+
+        limit = ((last - tail) & mask) + 1;
+    }
+
+    int first = -1;
+
+    for(int i = 0; i < limit; i++)
+    {
+        uint16_t index = (tail + i) & mask;
+        uint8_t c = rxBuff[index];
+
+        if((delimeterMap[c >> 5] >> (c & 31)) & 1)
+        {
+            if(!searchAll)
+                return index;
+
+            if(first < 0)
+                first = index;
+
+            last = index;
+        }
+    }
+
+    // After a full search, record the last delimeter found, unless our receive interrupt has since seen a newer one.
+    if(searchAll && first >= 0)
+    {
+        target_disable_irq();
+        if(rxBuffDelimMatch < 0)
+            rxBuffDelimMatch = last;
+        target_enable_irq();
+    }
+
+    return first;
+}
+
 /**
  * A wrapper around the inherited method "baud" so we can trap the baud rate
  * as it changes and restore it if redirect() is called.
@@ -904,7 +1178,7 @@ int Serial::eventAfter(int len, SerialMode mode)
         fiber_wake_on_event(this->id, CODAL_SERIAL_EVT_HEAD_MATCH);
 
     //configure our head match...
-    this->rxBuffHeadMatch = (rxBuffHead + len) % rxBuffSize;
+    this->rxBuffHeadMatch = (rxBuffHead + len) & (rxBuffSize - 1);
 
     // Deschedule this fiber, if necessary
     if(mode == SYNC_SLEEP)
@@ -940,8 +1214,16 @@ int Serial::eventOn(ManagedString delimeters, SerialMode mode)
         return DEVICE_INVALID_PARAMETER;
 
     //configure our head match...
+    uint32_t map[8];
+
+    buildDelimeterMap(map, delimeters);
+
     this->delimeters = delimeters;
 
+    target_disable_irq();
+    memcpy(eventDelimeterMap, map, sizeof(map));
+    target_enable_irq();
+
     //block!
     if(mode == SYNC_SLEEP)
         fiber_wait_for_event(this->id, CODAL_SERIAL_EVT_DELIM_MATCH);
@@ -981,7 +1263,7 @@ int Serial::isReadable()
  */
 int Serial::isWriteable()
 {
-    return (txBuffHead != (txBuffTail - 1)) ? 1 : 0;
+    return (((txBuffHead + 1) & (txBuffSize - 1)) != txBuffTail) ? 1 : 0;
 }
 
 /**
@@ -992,18 +1274,15 @@ int Serial::isWriteable()
  * @return CODAL_SERIAL_IN_USE if another fiber is currently using this instance
  *         for reception, otherwise DEVICE_OK.
  */
-int Serial::setRxBufferSize(uint8_t size)
+int Serial::setRxBufferSize(uint16_t size)
 {
     if(rxInUse())
         return DEVICE_SERIAL_IN_USE;
 
     lockRx();
 
-    // + 1 so there is a usable buffer size, of the size the user requested.
-    if (size != 255)
-        size++;
-
-    this->rxBuffSize = size;
+    // Rounded up so there is a usable buffer size of at least the size the user requested.
+    this->rxBuffSize = ringBufferSize(size);
 
     int result = initialiseRx();
 
@@ -1020,18 +1299,15 @@ int Serial::setRxBufferSize(uint8_t size)
  * @return CODAL_SERIAL_IN_USE if another fiber is currently using this instance
  *         for transmission, otherwise DEVICE_OK.
  */
-int Serial::setTxBufferSize(uint8_t size)
+int Serial::setTxBufferSize(uint16_t size)
 {
     if(txInUse())
         return DEVICE_SERIAL_IN_USE;
 
     lockTx();
 
-    // + 1 so there is a usable buffer size, of the size the user requested.
-    if (size != 255)
-        size++;
-
-    this->txBuffSize = size;
+    // Rounded up so there is a usable buffer size of at least the size the user requested.
+    this->txBuffSize = ringBufferSize(size);
 
     int result = initialiseTx();
 
@@ -1075,6 +1351,7 @@ int Serial::clearRxBuffer()
     lockRx();
 
     rxBuffTail = rxBuffHead;
+    rxBuffDelimMatch = -1;
 
     unlockRx();
 
@@ -1095,7 +1372,11 @@ int Serial::clearTxBuffer()
 
     lockTx();
 
+    //ensure the TX interrupt isn't part way through a queued buffer as we discard it.
+    disableInterrupt(TxInterrupt);
+
     txBuffTail = txBuffHead;
+    discardTxBuffers();
 
     unlockTx();
 
@@ -1110,10 +1391,7 @@ int Serial::clearTxBuffer()
  */
 int Serial::rxBufferedSize()
 {
-    if(rxBuffTail > rxBuffHead)
-        return (rxBuffSize - rxBuffTail) + rxBuffHead;
-
-    return rxBuffHead - rxBuffTail;
+    return (rxBuffHead - rxBuffTail) & (rxBuffSize - 1);
 }
 
 /**
@@ -1124,10 +1402,25 @@ int Serial::rxBufferedSize()
  */
 int Serial::txBufferedSize()
 {
-    if(txBuffTail > txBuffHead)
-        return (txBuffSize - txBuffTail) + txBuffHead;
+    int size = (txBuffHead - txBuffTail) & (txBuffSize - 1);
 
-    return txBuffHead - txBuffTail;
+    for(uint8_t i = txQueueTail; i != txQueueHead; i++)
+    {
+        SerialTxBuffer &b = txQueue[i % CODAL_SERIAL_TX_QUEUE_SIZE];
+        size += b.buffer.length() - b.offset;
+    }
+
+    return size;
+}
+
+/**
+ * The number of received bytes that have been dropped because our rx buffer was full.
+ *
+ * @return The number of bytes dropped since this instance was created.
+ */
+uint32_t Serial::getRxOverflowCount()
+{
+    return rxOverflowCount;
 }
 
 /**
@@ -30,6 +30,7 @@ DEALINGS IN THE SOFTWARE.
   */
 
 #include "AnimatedDisplay.h"
+#include "GlyphCache.h"
 #include "CodalFiber.h"
 #include "NotifyEvents.h"
 #include "CodalDmesg.h"
@@ -116,47 +117,29 @@ void AnimatedDisplay::sendAnimationCompleteEvent()
 
 /**
   * Internal scrollText update method.
-  * Shift the screen image by one pixel to the left. If necessary, paste in the next char.
+  * Shift the screen image by one pixel to the left, and bring in the next column of the current character.
+  * Once the glyph has been shifted in, blank columns follow until it has scrolled off the display.
   */
 void AnimatedDisplay::updateScrollText()
 {
-    /**
-    display.image.shiftLeft(1);
-    scrollingPosition++;
-
-    if (scrollingPosition == display.getWidth() + DISPLAY_SPACING)
-    {
-        scrollingPosition = 0;
-
-        display.image.print(scrollingChar < scrollingText.length() ? scrollingText.charAt(scrollingChar) : ' ', display.getWidth(), 0);
-
-        if (scrollingChar > scrollingText.length())
-        {
-            animationMode = ANIMATION_MODE_NONE;
-            this->sendAnimationCompleteEvent();
-            return;
-        }
-        scrollingChar++;
-   }
-   **/
-
     display.image.shiftLeft(1);
 
     if (scrollingPosition < BITMAP_FONT_WIDTH && scrollingChar < scrollingText.length())
     {
-        const uint8_t *v = font.get(scrollingText.charAt(scrollingChar));
-        if (v == NULL) {
-            v = font.get(' ');
-        }
-        uint8_t mask = 1 << (BITMAP_FONT_WIDTH - scrollingPosition - 1);
-        uint8_t x = display.getWidth()-1;
+        // Copy the next column of the strip straight from its packed rows into the rightmost column of the display.
+        int column = scrollingChar * (BITMAP_FONT_WIDTH + DISPLAY_SPACING) + scrollingPosition;
+        int height = min(BITMAP_FONT_HEIGHT, display.image.getHeight());
+        uint32_t *in = scrollingGlyphs.getBitmap() + (column >> 5);
+        uint32_t mask = 1U << (column & 31);
+        uint8_t *out = display.image.getBitmap() + display.image.getWidth() - 1;
 
-        for (int y=0; y<BITMAP_FONT_HEIGHT; y++)
+        for (int y=0; y<height; y++)
         {
-            if (*v & mask)
-                display.image.setPixelValue(x, y, 255);
+            if (*in & mask)
+                *out = 255;
 
-            v++;
+            in += scrollingGlyphs.getStride();
+            out += display.image.getWidth();
         }
     }
 
@@ -166,8 +149,11 @@ void AnimatedDisplay::updateScrollText()
     {
         scrollingPosition = 0;
 
+        // Carry on until the last character has moved right off the display.
         if (scrollingChar >= scrollingText.length())
         {
+            scrollingText = ManagedString();
+            scrollingGlyphs = PackedImage();
             animationMode = ANIMATION_MODE_NONE;
             this->sendAnimationCompleteEvent();
             return;
@@ -567,16 +553,23 @@ int AnimatedDisplay::print(Image i, int x, int y, int alpha, int delay)
   */
 int AnimatedDisplay::scrollAsync(ManagedString s, int delay)
 {
-    //sanitise this value
-    if(delay <= 0)
+    //sanitise these values. The rendered text must fit in a PackedImage.
+    if(delay <= 0 || s.length() * (BITMAP_FONT_WIDTH + DISPLAY_SPACING) > INT16_MAX)
         return DEVICE_INVALID_PARAMETER;
 
     // If the display is free, it's our turn to display.
     if (animationMode == ANIMATION_MODE_NONE || animationMode == ANIMATION_MODE_STOPPED)
     {
-        scrollingPosition = 0;
-        scrollingChar = 0;
+        // Render the glyphs once, rather than looking them up as they scroll. The gaps between characters
+        // are added by updateScrollText(), so the strip only holds one glyph pitch per character.
+        GlyphCache cache(font, 1);
+
+        scrollingGlyphs = PackedImage(s.length() * (BITMAP_FONT_WIDTH + DISPLAY_SPACING), BITMAP_FONT_HEIGHT, 1);
+        cache.drawText(scrollingGlyphs, s, 0, 0, DISPLAY_SPACING);
+
         scrollingText = s;
+        scrollingChar = 0;
+        scrollingPosition = 0;
 
         animationDelay = delay;
         animationTick = 0;
@@ -651,8 +644,8 @@ int AnimatedDisplay::scrollAsync(Image image, int delay, int stride)
   */
 int AnimatedDisplay::scroll(ManagedString s, int delay)
 {
-    //sanitise this value
-    if(delay <= 0)
+    //sanitise these values
+    if(delay <= 0 || s.length() * (BITMAP_FONT_WIDTH + DISPLAY_SPACING) > INT16_MAX)
         return DEVICE_INVALID_PARAMETER;
 
     // If there's an ongoing animation, wait for our turn to display.
@@ -48,12 +48,17 @@ const int greyScaleTimings[LED_MATRIX_GREYSCALE_BIT_DEPTH] = {1, 23, 70, 163, 35
 LEDMatrix::LEDMatrix(const MatrixMap &map, uint16_t id) : Display(map.width, map.height, id), matrixMap(map)
 {
     this->rotation = MATRIX_DISPLAY_ROTATION_0;
-    this->greyscaleBitMsk = 0x01;
     this->timingCount = 0;
+    this->greyscaleSteps = 0;
+    this->columnsValid = false;
+    this->columnState = 0;
     this->setBrightness(LED_MATRIX_DEFAULT_BRIGHTNESS);
     this->mode = DISPLAY_MODE_BLACK_AND_WHITE;
     this->strobeRow = 0;
 
+    this->pixelMap = (uint16_t *)malloc(map.rows * map.columns * sizeof(uint16_t));
+    buildPixelMap();
+
     if(EventModel::defaultEventBus)
         EventModel::defaultEventBus->listen(id, LED_MATRIX_EVT_FRAME_TIMEOUT, this, &LEDMatrix::onTimeoutEvent, MESSAGE_BUS_LISTENER_IMMEDIATE);
 
@@ -82,11 +87,7 @@ void LEDMatrix::periodicCallback()
         render();
 
     if(mode == DISPLAY_MODE_GREYSCALE)
-    {
-        greyscaleBitMsk = 0x01;
-        timingCount = 0;
         renderGreyscale();
-    }
 }
 
 void LEDMatrix::renderFinish()
@@ -96,16 +97,61 @@ void LEDMatrix::renderFinish()
 
 void LEDMatrix::onTimeoutEvent(Event)
 {
+    if(mode == DISPLAY_MODE_GREYSCALE && timingCount < greyscaleSteps)
+    {
+        // Show the next bit plane.
+        writeColumns(greyscaleMasks[timingCount]);
+        system_timer_event_after_us(greyscaleTimes[timingCount++], id, LED_MATRIX_EVT_FRAME_TIMEOUT);
+        return;
+    }
+
     renderFinish();
 }
 
-void LEDMatrix::render()
+/**
+  * Rebuilds the table mapping each LED to its pixel in the image, for the current rotation.
+  * This keeps the rotation maths out of the refresh, which only needs to look pixels up.
+  */
+void LEDMatrix::buildPixelMap()
 {
-    // Simple optimisation.
-    // If display is at zero brightness, there's nothing to do.
-    if(brightness == 0)
-        return;
+    for (int row = 0; row < matrixMap.rows; row++)
+    {
+        for (int i = 0; i < matrixMap.columns; i++)
+        {
+            int index = (i * matrixMap.rows) + row;
+
+            int x = matrixMap.map[index].x;
+            int y = matrixMap.map[index].y;
+            int t = x;
+
+            if(rotation == MATRIX_DISPLAY_ROTATION_90)
+            {
+                    x = width - 1 - y;
+                    y = t;
+            }
+
+            if(rotation == MATRIX_DISPLAY_ROTATION_180)
+            {
+                    x = width - 1 - x;
+                    y = height - 1 - y;
+            }
+
+            if(rotation == MATRIX_DISPLAY_ROTATION_270)
+            {
+                    x = y;
+                    y = height - 1 - t;
+            }
+
+            pixelMap[row * matrixMap.columns + i] = y*width + x;
+        }
+    }
+}
 
+/**
+  * Moves on to the next row: turns off the current row, and returns the pixels of the next in the image.
+  */
+const uint16_t *LEDMatrix::nextRow()
+{
     // Turn off the previous row
     matrixMap.rowPins[strobeRow]->setDigitalValue(0);
     matrixMap.rowPins[strobeRow]->getDigitalValue();
@@ -115,39 +161,48 @@ void LEDMatrix::render()
     if(strobeRow == matrixMap.rows)
         strobeRow = 0;
 
-    // Calculate the bitpattern to write.
+    return pixelMap + strobeRow * matrixMap.columns;
+}
+
+/**
+  * Sets the column pins to the given pattern, only writing those that change.
+  * We sink current through the columns, so a lit column is driven low.
+  */
+void LEDMatrix::writeColumns(uint32_t mask)
+{
+    uint32_t changed = columnsValid ? mask ^ columnState : 0xffffffff;
+
     for (int i = 0; i < matrixMap.columns; i++)
     {
-        int index = (i * matrixMap.rows) + strobeRow;
+        if (changed & (1u << i))
+            matrixMap.columnPins[i]->setDigitalValue((mask & (1u << i)) ? 0 : 1);
+    }
 
-        int x = matrixMap.map[index].x;
-        int y = matrixMap.map[index].y;
-        int t = x;
+    columnState = mask;
+    columnsValid = true;
+}
 
-        if(rotation == MATRIX_DISPLAY_ROTATION_90)
-        {
-                x = width - 1 - y;
-                y = t;
-        }
+void LEDMatrix::render()
+{
+    // Simple optimisation.
+    // If display is at zero brightness, there's nothing to do.
+    if(brightness == 0)
+        return;
 
-        if(rotation == MATRIX_DISPLAY_ROTATION_180)
-        {
-                x = width - 1 - x;
-                y = height - 1 - y;
-        }
+    const uint8_t *bitmap = image.getBitmap();
+    const uint16_t *pixels = nextRow();
+    uint32_t mask = 0;
 
-        if(rotation == MATRIX_DISPLAY_ROTATION_270)
-        {
-                x = y;
-                y = height - 1 - t;
-        }
-        if (image.getBitmap()[y*width + x])
-            matrixMap.columnPins[i]->setDigitalValue(0);
-        else
-            matrixMap.columnPins[i]->setDigitalValue(1);
+    // Calculate the bitpattern to write.
+    for (int i = 0; i < matrixMap.columns; i++)
+    {
+        if (bitmap[pixels[i]])
+            mask |= 1u << i;
     }
 
-    // Turn off the previous row
+    writeColumns(mask);
+
+    // Turn on the new row
     matrixMap.rowPins[strobeRow]->setDigitalValue(1);
 
     //timer does not have enough resolution for brightness of 1. 23.53 us
@@ -169,6 +224,9 @@ void LEDMatrix::renderWithLightSense()
     {
         Event(id, LED_MATRIX_EVT_LIGHT_SENSE);
         strobeRow = 0;
+
+        // The light sensor borrows the column pins, so they must all be rewritten on the next pass.
+        columnsValid = false;
     }
     else
     {
@@ -179,60 +237,48 @@ void LEDMatrix::renderWithLightSense()
 
 void LEDMatrix::renderGreyscale()
 {
-/*
-    uint32_t row_data = 0x01 << (matrixMap.rowStart + strobeRow);
-    uint32_t col_data = 0;
+    // Drop anything left over from the previous row.
+    system_timer_cancel_event(id, LED_MATRIX_EVT_FRAME_TIMEOUT);
 
-    // Calculate the bitpattern to write.
+    const uint8_t *bitmap = image.getBitmap();
+    const uint16_t *pixels = nextRow();
+    uint32_t planes[LED_MATRIX_GREYSCALE_BIT_DEPTH];
+
+    memclr(planes, sizeof(planes));
+
+    // Split the row into bit planes, one bit per column in each.
     for (int i = 0; i < matrixMap.columns; i++)
     {
-        int index = (i * matrixMap.rows) + strobeRow;
+        int value = min(bitmap[pixels[i]], brightness);
 
-        int x = matrixMap.map[index].x;
-        int y = matrixMap.map[index].y;
-        int t = x;
+        for (int bit = 0; value; bit++, value >>= 1)
+            if (value & 1)
+                planes[bit] |= 1u << i;
+    }
 
-        if(rotation == MATRIX_DISPLAY_ROTATION_90)
-        {
-                x = width - 1 - y;
-                y = t;
-        }
+    // Show each plane for its weight, merging neighbouring planes that light the same columns,
+    // so a black and white image costs a single timer event.
+    greyscaleSteps = 0;
 
-        if(rotation == MATRIX_DISPLAY_ROTATION_180)
+    for (int bit = 0; bit < LED_MATRIX_GREYSCALE_BIT_DEPTH; bit++)
+    {
+        if (greyscaleSteps && greyscaleMasks[greyscaleSteps - 1] == planes[bit])
         {
-                x = width - 1 - x;
-                y = height - 1 - y;
+            greyscaleTimes[greyscaleSteps - 1] += greyScaleTimings[bit];
         }
-
-        if(rotation == MATRIX_DISPLAY_ROTATION_270)
+        else
         {
-                x = y;
-                y = height - 1 - t;
+            greyscaleMasks[greyscaleSteps] = planes[bit];
+            greyscaleTimes[greyscaleSteps] = greyScaleTimings[bit];
+            greyscaleSteps++;
         }
-
-        if(min(image.getBitmap()[y * width + x],brightness) & greyscaleBitMsk)
-            col_data |= (1 << i);
     }
 
-    // Invert column bits (as we're sinking not sourcing power), and mask off any unused bits.
-    col_data = ~col_data << matrixMap.columnStart & col_mask;
-
-    // Write the new bit pattern
-    *LEDMatrix = col_data | row_data;
-
-    if(timingCount > CODAL_DISPLAY_GREYSCALE_BIT_DEPTH-1)
-        return;
-
-    greyscaleBitMsk <<= 1;
+    writeColumns(greyscaleMasks[0]);
+    matrixMap.rowPins[strobeRow]->setDigitalValue(1);
 
-    if(timingCount < 3)
-    {
-        wait_us(greyScaleTimings[timingCount++]);
-        renderGreyscale();
-        return;
-    }
-    renderTimer.attach_us(this,&LEDMatrix::renderGreyscale, greyScaleTimings[timingCount++]);
-*/
+    timingCount = 1;
+    system_timer_event_after_us(greyscaleTimes[0], id, LED_MATRIX_EVT_FRAME_TIMEOUT);
 }
 
 /**
@@ -248,6 +294,9 @@ void LEDMatrix::renderGreyscale()
 void LEDMatrix::setDisplayMode(DisplayMode mode)
 {
     this->mode = mode;
+
+    // Don't trust the column pins across a change of mode, e.g. out of light sensing.
+    columnsValid = false;
 }
 
 /**
@@ -272,6 +321,7 @@ int LEDMatrix::getDisplayMode()
 void LEDMatrix::rotateTo(DisplayRotation rotation)
 {
     this->rotation = rotation;
+    buildPixelMap();
 }
 
 /**
@@ -290,6 +340,8 @@ void LEDMatrix::setEnable(bool enableDisplay)
 
     if (enableDisplay)
     {
+        // The pins may have been used for something else while we were disabled.
+        columnsValid = false;
         status |= DEVICE_COMPONENT_RUNNING;
     }
     else
@@ -367,4 +419,5 @@ int LEDMatrix::setBrightness(int b)
 LEDMatrix::~LEDMatrix()
 {
     this->status &= ~DEVICE_COMPONENT_STATUS_SYSTEM_TICK;
+    free(pixelMap);
 }
\ No newline at end of file
@@ -70,6 +70,12 @@ ST7735::ST7735(ScreenIO &io, Pin &cs, Pin &dc)
 {
     double16 = false;
     inSleepMode = false;
+    windowX = windowY = windowW = windowH = 0;
+    partialWindow = false;
+    bandHashes = NULL;
+    hashWidth = hashHeight = 0;
+    hashesValid = false;
+    changesSinceRefresh = 0;
 }
 
 #define DELAY 0x80
@@ -141,8 +147,16 @@ struct ST7735WorkBuffer
 {
     unsigned width;
     unsigned height;
-    uint8_t dataBuf[DATABUFSIZE];
+    // chunks are expanded into one buffer while the other is being sent
+    uint8_t dataBuf[2][DATABUFSIZE];
+    uint8_t cur;          // the buffer holding the next chunk to send
+    unsigned pending;     // size of the chunk already expanded into dataBuf[cur], if any
+    volatile bool expanding;
+    volatile bool transferDone;
     const uint8_t *srcPtr;
+    unsigned stride;      // bytes per column in the source image
+    unsigned rowBytes;    // bytes per column actually sent
+    unsigned columnsLeft; // columns still to send, after the current one
     unsigned x;
     volatile bool inProgress;
     uint32_t *paletteTable;
@@ -150,7 +164,7 @@ struct ST7735WorkBuffer
     uint32_t expPalette[256];
 };
 
-void ST7735::sendBytes(unsigned num)
+unsigned ST7735::expandBytes(uint8_t *buf, unsigned num)
 {
     assert(num > 0);
     if (num > work->srcLeft)
@@ -159,18 +173,18 @@ void ST7735::sendBytes(unsigned num)
 
     if (double16)
     {
-        uint32_t *dst = (uint32_t *)work->dataBuf;
+        uint32_t *dst = (uint32_t *)buf;
         while (num--)
         {
             uint8_t v = *work->srcPtr++;
             *dst++ = work->expPalette[v & 0xf];
             *dst++ = work->expPalette[v >> 4];
         }
-        startTransfer((uint8_t *)dst - work->dataBuf);
+        return (uint8_t *)dst - buf;
     }
     else
     {
-        uint8_t *dst = work->dataBuf;
+        uint8_t *dst = buf;
         while (num--)
         {
             uint32_t v = work->expPalette[*work->srcPtr++];
@@ -178,11 +192,11 @@ void ST7735::sendBytes(unsigned num)
             *dst++ = v >> 8;
             *dst++ = v >> 16;
         }
-        startTransfer(dst - work->dataBuf);
+        return dst - buf;
     }
 }
 
-void ST7735::sendWords(unsigned numBytes)
+unsigned ST7735::expandWords(uint8_t *buf, unsigned numBytes)
 {
     if (numBytes > work->srcLeft)
         numBytes = work->srcLeft & ~3;
@@ -191,7 +205,7 @@ void ST7735::sendWords(unsigned numBytes)
     uint32_t numWords = numBytes >> 2;
     const uint32_t *src = (const uint32_t *)work->srcPtr;
     uint32_t *tbl = work->expPalette;
-    uint32_t *dst = (uint32_t *)work->dataBuf;
+    uint32_t *dst = (uint32_t *)buf;
 
     if (double16)
         while (numWords--)
@@ -207,7 +221,30 @@ void ST7735::sendWords(unsigned numBytes)
             *dst++ = tbl[0xf & (v >> 28)];
         }
     else
-        while (numWords--)
+    {
+        // two source words (16 pixels) make six output words
+        while (numWords >= 2)
+        {
+            uint32_t s = *src++;
+            uint32_t o = tbl[s & 0xff];
+            uint32_t v = tbl[(s >> 8) & 0xff];
+            dst[0] = o | (v << 24);
+            o = tbl[(s >> 16) & 0xff];
+            dst[1] = (v >> 8) | (o << 16);
+            v = tbl[s >> 24];
+            dst[2] = (o >> 16) | (v << 8);
+            s = *src++;
+            o = tbl[s & 0xff];
+            v = tbl[(s >> 8) & 0xff];
+            dst[3] = o | (v << 24);
+            o = tbl[(s >> 16) & 0xff];
+            dst[4] = (v >> 8) | (o << 16);
+            v = tbl[s >> 24];
+            dst[5] = (o >> 16) | (v << 8);
+            dst += 6;
+            numWords -= 2;
+        }
+        if (numWords)
         {
             uint32_t s = *src++;
             uint32_t o = tbl[s & 0xff];
@@ -218,21 +255,82 @@ void ST7735::sendWords(unsigned numBytes)
             v = tbl[s >> 24];
             *dst++ = (o >> 16) | (v << 8);
         }
+    }
 
     work->srcPtr = (uint8_t *)src;
-    startTransfer((uint8_t *)dst - work->dataBuf);
+    return (uint8_t *)dst - buf;
+}
+
+unsigned ST7735::expandChunk(uint8_t *buf)
+{
+    if (double16 && work->srcLeft == 0 && work->x++ < (work->width << 1))
+    {
+        work->srcLeft = work->rowBytes;
+        if ((work->x & 1) == 0)
+        {
+            work->srcPtr -= work->srcLeft;
+        }
+        else
+        {
+            work->srcPtr += work->stride - work->rowBytes;
+        }
+    }
+    else if (!double16 && work->srcLeft == 0 && work->columnsLeft)
+    {
+        // move on to the next column of a region shorter than the image
+        work->columnsLeft--;
+        work->srcPtr += work->stride - work->rowBytes;
+        work->srcLeft = work->rowBytes;
+    }
+
+    // with the current image format in PXT the expandBytes cases never happen
+    unsigned align = (unsigned)work->srcPtr & 3;
+    if (work->srcLeft && align)
+        return expandBytes(buf, 4 - align);
+    else if (work->srcLeft < 4)
+        return work->srcLeft ? expandBytes(buf, work->srcLeft) : 0;
+    else if (double16)
+        return expandWords(buf, DATABUFSIZE / 8);
+    else
+        return expandWords(buf, (DATABUFSIZE / (3 * 4)) * 4);
+}
+
+// expand and send a single chunk of the image from the current buffer
+void ST7735::sendBytes(unsigned num)
+{
+    startTransfer(expandBytes(work->dataBuf[work->cur], num));
+}
+
+void ST7735::sendWords(unsigned numBytes)
+{
+    startTransfer(expandWords(work->dataBuf[work->cur], numBytes));
+}
+
+void ST7735::startTransfer(unsigned size)
+{
+    io.startSend(work->dataBuf[work->cur], size, (PVoidCallback)&ST7735::sendColorsStep, this);
 }
 
 void ST7735::sendColorsStep(ST7735 *st)
 {
     ST7735WorkBuffer *work = st->work;
 
+    // if the transfer finished before the next chunk was ready, leave it to be sent once it is
+    target_disable_irq();
+    if (work->expanding)
+    {
+        work->transferDone = true;
+        target_enable_irq();
+        return;
+    }
+    target_enable_irq();
+
     if (work->paletteTable)
     {
         auto palette = work->paletteTable;
         work->paletteTable = NULL;
-        memset(work->dataBuf, 0, sizeof(work->dataBuf));
-        uint8_t *base = work->dataBuf;
+        memset(work->dataBuf[0], 0, sizeof(work->dataBuf[0]));
+        uint8_t *base = work->dataBuf[0];
         for (int i = 0; i < 16; ++i)
         {
             base[i] = (palette[i] >> 18) & 0x3f;
@@ -240,7 +338,7 @@ void ST7735::sendColorsStep(ST7735 *st)
             base[i + 32 + 64] = (palette[i] >> 2) & 0x3f;
         }
         st->startRAMWR(0x2D);
-        st->io.send(work->dataBuf, 128);
+        st->io.send(work->dataBuf[0], 128);
         st->endCS();
     }
 
@@ -250,45 +348,34 @@ void ST7735::sendColorsStep(ST7735 *st)
         work->x++;
     }
 
-    if (st->double16 && work->srcLeft == 0 && work->x++ < (work->width << 1))
+    for (;;)
     {
-        work->srcLeft = (work->height + 1) >> 1;
-        if ((work->x & 1) == 0)
-        {
-            work->srcPtr -= work->srcLeft;
-        }
-    }
+        uint8_t *buf = work->dataBuf[work->cur];
+        unsigned size = work->pending ? work->pending : st->expandChunk(buf);
 
-    // with the current image format in PXT the sendBytes cases never happen
-    unsigned align = (unsigned)work->srcPtr & 3;
-    if (work->srcLeft && align)
-    {
-        st->sendBytes(4 - align);
-    }
-    else if (work->srcLeft < 4)
-    {
-        if (work->srcLeft == 0)
+        if (size == 0)
         {
             st->endCS();
             st->sendDone();
+            return;
         }
-        else
-        {
-            st->sendBytes(work->srcLeft);
-        }
-    }
-    else
-    {
-        if (st->double16)
-            st->sendWords(sizeof(work->dataBuf) / 8);
-        else
-            st->sendWords((sizeof(work->dataBuf) / (3 * 4)) * 4);
-    }
-}
 
-void ST7735::startTransfer(unsigned size)
-{
-    io.startSend(work->dataBuf, size, (PVoidCallback)&ST7735::sendColorsStep, this);
+        // start sending this chunk, and expand the next one into the other buffer meanwhile
+        work->cur ^= 1;
+        work->expanding = true;
+        work->transferDone = false;
+        st->io.startSend(buf, size, (PVoidCallback)&ST7735::sendColorsStep, st);
+        work->pending = st->expandChunk(work->dataBuf[work->cur]);
+
+        target_disable_irq();
+        work->expanding = false;
+        bool done = work->transferDone;
+        target_enable_irq();
+
+        // otherwise, the next completion callback carries on from here
+        if (!done)
+            return;
+    }
 }
 
 void ST7735::startRAMWR(int cmd)
@@ -341,6 +428,122 @@ int ST7735::setSleep(bool sleepMode)
 
 int ST7735::sendIndexedImage(const uint8_t *src, unsigned width, unsigned height, uint32_t *palette)
 {
+    hashesValid = false;
+    return sendRegion(src, width, height, palette, 0, 0, width, height);
+}
+
+int ST7735::sendIndexedImageRegion(const uint8_t *src, unsigned width, unsigned height,
+                                   uint32_t *palette, int x, int y, int w, int h)
+{
+    hashesValid = false;
+    return sendRegion(src, width, height, palette, x, y, w, h);
+}
+
+static uint32_t hashBytes(const uint8_t *p, unsigned len)
+{
+    // FNV-1a
+    uint32_t h = 0x811c9dc5;
+    while (len--)
+        h = (h ^ *p++) * 0x01000193;
+    return h;
+}
+
+int ST7735::sendIndexedImageChanges(const uint8_t *src, unsigned width, unsigned height,
+                                    uint32_t *palette)
+{
+    unsigned stride = (height + 1) >> 1;
+    unsigned bands = (stride + ST7735_CHANGE_BAND_BYTES - 1) / ST7735_CHANGE_BAND_BYTES;
+
+    if (!bandHashes || hashWidth != width || hashHeight != height)
+    {
+        free(bandHashes);
+        bandHashes = (uint32_t *)malloc(width * bands * sizeof(uint32_t));
+        hashWidth = width;
+        hashHeight = height;
+        hashesValid = false;
+
+        if (!bandHashes)
+            return sendIndexedImage(src, width, height, palette);
+    }
+
+    // a hash collision could hide a change, so send the whole image every so often regardless
+    if (++changesSinceRefresh >= ST7735_CHANGE_FULL_REFRESH)
+        hashesValid = false;
+    if (!hashesValid)
+        changesSinceRefresh = 0;
+
+    // find the rectangle bounding all the bands that have changed
+    int x0 = width, x1 = -1, b0 = bands, b1 = -1;
+    uint32_t *hp = bandHashes;
+
+    for (unsigned x = 0; x < width; ++x)
+    {
+        const uint8_t *col = src + x * stride;
+        for (unsigned b = 0; b < bands; ++b)
+        {
+            unsigned offset = b * ST7735_CHANGE_BAND_BYTES;
+            uint32_t h = hashBytes(col + offset, min(ST7735_CHANGE_BAND_BYTES, stride - offset));
+            if (!hashesValid || *hp != h)
+            {
+                *hp = h;
+                if ((int)x < x0)
+                    x0 = x;
+                x1 = x;
+                if ((int)b < b0)
+                    b0 = b;
+                if ((int)b > b1)
+                    b1 = b;
+            }
+            hp++;
+        }
+    }
+
+    // a new palette changes every pixel on the screen
+    if (palette)
+    {
+        x0 = b0 = 0;
+        x1 = width - 1;
+        b1 = bands - 1;
+    }
+
+    hashesValid = true;
+
+    if (x1 < 0)
+        return DEVICE_OK;
+
+    int r = sendRegion(src, width, height, palette, x0, b0 * ST7735_CHANGE_BAND_BYTES * 2, x1 - x0 + 1,
+                       (b1 - b0 + 1) * ST7735_CHANGE_BAND_BYTES * 2);
+    if (r != DEVICE_OK)
+        hashesValid = false;
+
+    return r;
+}
+
+int ST7735::sendRegion(const uint8_t *src, unsigned width, unsigned height, uint32_t *palette,
+                       int x, int y, int w, int h)
+{
+    if (x < 0)
+    {
+        w += x;
+        x = 0;
+    }
+    if (y < 0)
+    {
+        h += y;
+        y = 0;
+    }
+    w = min(w, (int)width - x);
+    h = min(h, (int)height - y);
+    if (w <= 0 || h <= 0)
+        return DEVICE_OK;
+
+    // two pixels are packed in each byte down a column, so only whole bytes can be sent
+    h += y & 1;
+    y &= ~1;
+
+    unsigned stride = (height + 1) >> 1;
+    unsigned rowBytes = (h + 1) >> 1;
+
     if (!work)
     {
         work = new ST7735WorkBuffer;
@@ -360,16 +563,45 @@ int ST7735::sendIndexedImage(const uint8_t *src, unsigned width, unsigned height
     if (inSleepMode)
         return DEVICE_BUSY;
 
+    int scale = double16 ? 2 : 1;
+    if (w == (int)width && rowBytes == stride)
+    {
+        if (partialWindow)
+        {
+            writeAddrWindow(windowX, windowY, windowW ? windowW : width * scale,
+                            windowH ? windowH : height * scale);
+            partialWindow = false;
+        }
+    }
+    else
+    {
+        // for an odd height, the last byte of each column only holds one row of the image
+        writeAddrWindow(windowX + x * scale, windowY + y * scale, w * scale,
+                        min((int)rowBytes * 2, (int)height - y) * scale);
+        partialWindow = true;
+    }
+
     work->paletteTable = palette;
     work->inProgress = true;
-    work->srcPtr = src;
-    work->width = width;
-    work->height = height;
-    work->srcLeft = (height + 1) >> 1;
-    // when not scaling up, we don't care about where lines end
+    work->srcPtr = src + x * stride + (y >> 1);
+    work->width = w;
+    work->height = h;
+    work->stride = stride;
+    work->rowBytes = rowBytes;
+    work->srcLeft = rowBytes;
+    work->columnsLeft = 0;
+    // when not scaling up, we don't care about where lines end, unless only part of each is sent
     if (!double16)
-        work->srcLeft *= width;
+    {
+        if (rowBytes == stride)
+            work->srcLeft *= w;
+        else
+            work->columnsLeft = w - 1;
+    }
     work->x = 0;
+    work->cur = 0;
+    work->pending = 0;
+    work->expanding = false;
 
     sendColorsStep(this);
 
@@ -413,6 +645,16 @@ void ST7735::sendCmdSeq(const uint8_t *buf)
 }
 
 void ST7735::setAddrWindow(int x, int y, int w, int h)
+{
+    windowX = x;
+    windowY = y;
+    windowW = w;
+    windowH = h;
+    partialWindow = false;
+    writeAddrWindow(x, y, w, h);
+}
+
+void ST7735::writeAddrWindow(int x, int y, int w, int h)
 {
     int x2 = x + w - 1;
     int y2 = y + h - 1;
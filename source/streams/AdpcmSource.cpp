@@ -0,0 +1,473 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AdpcmSource.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+// IMA-ADPCM quantizer step sizes.
+static const int16_t adpcmStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060,
+    1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
+    7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// IMA-ADPCM step index adjustment for each code.
+static const int8_t adpcmIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+/*
+ * Applies a single 4 bit code to the decoder state, returning the decoded sample.
+ */
+static inline int adpcmDecodeNibble(int code, int &predictor, int &index)
+{
+    int step = adpcmStepTable[index];
+    int diff = step >> 3;
+
+    if (code & 4)
+        diff += step;
+    if (code & 2)
+        diff += step >> 1;
+    if (code & 1)
+        diff += step >> 2;
+
+    predictor += (code & 8) ? -diff : diff;
+    predictor = predictor < -32768 ? -32768 : predictor > 32767 ? 32767 : predictor;
+
+    index += adpcmIndexTable[code];
+    index = index < 0 ? 0 : index > 88 ? 88 : index;
+
+    return predictor;
+}
+
+/**
+ * Default Constructor.
+ */
+AdpcmSource::AdpcmSource()
+{
+    this->downstream = NULL;
+    this->bytesToSend = 0;
+    this->count = 0;
+    this->blockingPlayout = false;
+    this->sampleRate = DATASTREAM_SAMPLE_RATE_UNKNOWN;
+    this->setFormat(DATASTREAM_FORMAT_16BIT_SIGNED);
+    this->setBufferSize(ADPCM_SOURCE_DEFAULT_MAX_BUFFER);
+    this->setBlockSize(CONFIG_ADPCM_SOURCE_DEFAULT_BLOCK_SIZE);
+    lock.wait();
+}
+
+/*
+ * Allow out downstream component to register itself with us
+ */
+void AdpcmSource::connect(DataSink &sink)
+{
+    this->downstream = &sink;
+}
+
+/**
+ * Determines if this source is connected to a downstream component
+ *
+ * @return true If a downstream is connected
+ * @return false If a downstream is not connected
+ */
+bool AdpcmSource::isConnected()
+{
+    return this->downstream != NULL;
+}
+
+/**
+ *  Determine the data format of the buffers streamed out of this component.
+ */
+int AdpcmSource::getFormat()
+{
+    return outputFormat;
+}
+
+/**
+ * Defines the data format of the buffers streamed out of this component.
+ * @param format One of DATASTREAM_FORMAT_8BIT_UNSIGNED, DATASTREAM_FORMAT_8BIT_SIGNED, DATASTREAM_FORMAT_16BIT_UNSIGNED or DATASTREAM_FORMAT_16BIT_SIGNED.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int AdpcmSource::setFormat(int format)
+{
+    if (format < DATASTREAM_FORMAT_8BIT_UNSIGNED || format > DATASTREAM_FORMAT_16BIT_SIGNED)
+        return DEVICE_INVALID_PARAMETER;
+
+    outputFormat = format;
+    return DEVICE_OK;
+}
+
+/**
+ * Determine the sample rate of the data being streamed.
+ * @return the sample rate defined by setSampleRate(), or DATASTREAM_SAMPLE_RATE_UNKNOWN.
+ */
+float AdpcmSource::getSampleRate()
+{
+    return sampleRate;
+}
+
+/**
+ * Defines the sample rate of the encoded data.
+ * @param sampleRate The sample rate, in Hz.
+ * @return DEVICE_OK on success.
+ */
+int AdpcmSource::setSampleRate(float sampleRate)
+{
+    this->sampleRate = sampleRate;
+    return DEVICE_OK;
+}
+
+/**
+ *  Determine the maximum size of the buffers streamed out of this component.
+ *  @return The maximum size of this component's output buffers, in bytes.
+ */
+int AdpcmSource::getBufferSize()
+{
+    return outputBufferSize;
+}
+
+/**
+ *  Defines the maximum size of the buffers streamed out of this component.
+ *  @param size the size of this component's output buffers, in bytes.
+ */
+int AdpcmSource::setBufferSize(int size)
+{
+    if (size <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    outputBufferSize = size;
+    return DEVICE_OK;
+}
+
+/**
+ * Determine the size of the encoded blocks being played.
+ * @return The block size, in bytes.
+ */
+int AdpcmSource::getBlockSize()
+{
+    return blockSize;
+}
+
+/**
+ * Defines the size of the encoded blocks to be played. This must match the block size used by the encoder.
+ * @param size The block size, in bytes. Must be greater than ADPCM_BLOCK_HEADER_SIZE.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int AdpcmSource::setBlockSize(int size)
+{
+    if (size <= ADPCM_BLOCK_HEADER_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    blockSize = size;
+    return DEVICE_OK;
+}
+
+/**
+ * Decodes a single IMA-ADPCM block.
+ *
+ * @param block The encoded block.
+ * @param length The length of the block, in bytes. Blocks shorter than the block size (at the end of a stream) are permitted.
+ * @param out Buffer to receive ADPCM_SAMPLES_PER_BLOCK(length) samples.
+ * @return The number of samples decoded.
+ */
+int AdpcmSource::decode(const uint8_t *block, int length, int16_t *out)
+{
+    int samples = blockSamples(block, length);
+
+    if (samples == 0)
+        return 0;
+
+    int predictor = (int16_t) (block[0] | (block[1] << 8));
+    int index = min((int)block[2], 88);
+    const uint8_t *end = block + length;
+
+    *out++ = predictor;
+    block += ADPCM_BLOCK_HEADER_SIZE;
+
+    while (block < end)
+    {
+        uint8_t b = *block++;
+
+        *out++ = adpcmDecodeNibble(b & 0x0F, predictor, index);
+
+        // The high nibble of the last byte may be padding, and must not be played.
+        if (block < end || (samples & 1))
+            *out++ = adpcmDecodeNibble(b >> 4, predictor, index);
+    }
+
+    return samples;
+}
+
+/**
+ * Determines the number of samples held in a single IMA-ADPCM block.
+ *
+ * @param block The encoded block.
+ * @param length The length of the block, in bytes.
+ * @return ADPCM_SAMPLES_PER_BLOCK(length), less one if the last nibble of the block is padding.
+ */
+int AdpcmSource::blockSamples(const uint8_t *block, int length)
+{
+    if (length < ADPCM_BLOCK_HEADER_SIZE)
+        return 0;
+
+    int samples = ADPCM_SAMPLES_PER_BLOCK(length);
+
+    if (length > ADPCM_BLOCK_HEADER_SIZE && (block[3] & ADPCM_BLOCK_FLAG_PADDED))
+        samples--;
+
+    return samples;
+}
+
+/**
+ * Determines the number of bytes needed to encode the given number of samples.
+ *
+ * @param sampleCount The number of samples to encode.
+ * @param blockSize The size of each encoded block, in bytes.
+ * @return The encoded length, in bytes.
+ */
+int AdpcmSource::encodedLength(int sampleCount, int blockSize)
+{
+    if (sampleCount <= 0 || blockSize <= ADPCM_BLOCK_HEADER_SIZE)
+        return 0;
+
+    int samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(blockSize);
+    int remainder = sampleCount % samplesPerBlock;
+
+    return (sampleCount / samplesPerBlock) * blockSize + (remainder ? ADPCM_BLOCK_HEADER_SIZE + remainder / 2 : 0);
+}
+
+/**
+ * Encodes 16 bit PCM samples as a sequence of IMA-ADPCM blocks suitable for playback with this class.
+ * Useful to compress audio recorded on the device, or to generate assets.
+ *
+ * @param samples The samples to encode.
+ * @param sampleCount The number of samples to encode.
+ * @param out Buffer to receive the encoded blocks. Must be at least encodedLength(sampleCount, blockSize) bytes.
+ * @param blockSize The size of each encoded block, in bytes.
+ * @return The number of bytes written, or DEVICE_INVALID_PARAMETER.
+ */
+int AdpcmSource::encode(const int16_t *samples, int sampleCount, uint8_t *out, int blockSize)
+{
+    if (samples == NULL || out == NULL || sampleCount < 0 || blockSize <= ADPCM_BLOCK_HEADER_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    int samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(blockSize);
+    uint8_t *start = out;
+    int index = 0;
+
+    while (sampleCount > 0)
+    {
+        int n = min(sampleCount, samplesPerBlock);
+        int predictor = *samples++;
+
+        // Each block starts afresh from its first sample, carrying the step index over from the previous block.
+        *out++ = predictor & 0xFF;
+        *out++ = (predictor >> 8) & 0xFF;
+        *out++ = index;
+        *out++ = (n & 1) ? 0 : ADPCM_BLOCK_FLAG_PADDED;
+
+        for (int i = 1; i < n; i++)
+        {
+            int diff = *samples++ - predictor;
+            int step = adpcmStepTable[index];
+            int code = 0;
+
+            if (diff < 0)
+            {
+                code = 8;
+                diff = -diff;
+            }
+
+            if (diff >= step)
+            {
+                code |= 4;
+                diff -= step;
+            }
+
+            step >>= 1;
+            if (diff >= step)
+            {
+                code |= 2;
+                diff -= step;
+            }
+
+            step >>= 1;
+            if (diff >= step)
+                code |= 1;
+
+            // Track the decoder's reconstruction, so that quantization errors don't accumulate.
+            adpcmDecodeNibble(code, predictor, index);
+
+            if (i & 1)
+                *out = code;
+            else
+                *out++ |= code << 4;
+        }
+
+        // Pad a final odd nibble.
+        if ((n & 1) == 0)
+            out++;
+
+        sampleCount -= n;
+    }
+
+    return out - start;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer AdpcmSource::pull()
+{
+    // Determine how many whole blocks fit into an output buffer, decoding at least one.
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(outputFormat);
+    int blocks = max(outputBufferSize / (ADPCM_SAMPLES_PER_BLOCK(blockSize) * bytesPerSample), 1);
+    int bytes = 0;
+    int samples = 0;
+
+    while (blocks-- && bytes < bytesToSend)
+    {
+        int l = min(blockSize, bytesToSend - bytes);
+
+        samples += blockSamples(in + bytes, l);
+        bytes += l;
+    }
+
+    // Decode directly into the output buffer. 16 bit samples are converted to 8 bit in place.
+    ManagedBuffer buffer(samples * 2);
+    int16_t *out = (int16_t *) &buffer[0];
+    int16_t *p = out;
+
+    for (int b = 0; b < bytes; b += blockSize)
+        p += decode(in + b, min(blockSize, bytes - b), p);
+
+    switch (outputFormat)
+    {
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            for (int i = 0; i < samples; i++)
+                out[i] ^= 0x8000;
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            for (int i = 0; i < samples; i++)
+                ((int8_t *)out)[i] = out[i] >> 8;
+            buffer.truncate(samples);
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            for (int i = 0; i < samples; i++)
+                ((uint8_t *)out)[i] = (out[i] >> 8) + 128;
+            buffer.truncate(samples);
+            break;
+    }
+
+    bytesToSend -= bytes;
+    in += bytes;
+
+    // If we've consumed the input data, see if we need to reload it
+    if (bytesToSend == 0)
+    {
+        if (count > 0)
+            count--;
+
+        if (count != 0)
+        {
+            bytesToSend = length;
+            in = data;
+        }
+    }
+
+    // If we still have data to send, indicate this to our downstream component
+    if (bytesToSend > 0)
+        downstream->pullRequest();
+
+    // If we have completed playback and blockingbehaviour was requested, wake the fiber that is blocked waiting.
+    if (bytesToSend == 0 && count == 0 && blockingPlayout)
+        lock.notify();
+
+    return buffer;
+}
+
+/**
+ * Perform a non-blocking playout of the encoded data.
+ * @param data pointer to the encoded data to playout
+ * @param length the length of the encoded data, in bytes.
+ * @param count if set, playback the data the given number of times. Defaults to 1. Set to a negative number to loop forever.
+ */
+void AdpcmSource::playAsync(const void *data, int length, int count)
+{
+    _play(data, length, count, false);
+}
+
+/**
+ * Perform a non-blocking playout of the encoded data.
+ * @param b the buffer of encoded data to playout
+ * @param count if set, playback the data the given number of times. Defaults to 1. Set to a negative number to loop forever.
+ */
+void AdpcmSource::playAsync(ManagedBuffer b, int count)
+{
+    this->playAsync(&b[0], b.length(), count);
+}
+
+/**
+ * Perform a blocking playout of the encoded data. Returns when all the data has been queued.
+ * @param data pointer to the encoded data to playout
+ * @param length the length of the encoded data, in bytes.
+ * @param count if set, playback the data the given number of times. Defaults to 1. Set to a negative number to loop forever.
+ */
+void AdpcmSource::play(const void *data, int length, int count)
+{
+    _play(data, length, count, true);
+}
+
+/**
+ * Perform a blocking playout of the encoded data. Returns when all the data has been queued.
+ * @param b the buffer of encoded data to playout
+ * @param count if set, playback the data the given number of times. Defaults to 1. Set to a negative number to loop forever.
+ */
+void AdpcmSource::play(ManagedBuffer b, int count)
+{
+    this->play(&b[0], b.length(), count);
+}
+
+void AdpcmSource::_play(const void *data, int length, int count, bool mode)
+{
+    if (downstream == NULL || length <= 0 || count == 0)
+        return;
+
+    this->data = this->in = (const uint8_t *)data;
+    this->length = this->bytesToSend = length;
+    this->count = count;
+    this->blockingPlayout = mode;
+
+    downstream->pullRequest();
+
+    if (this->blockingPlayout)
+        lock.wait();
+}
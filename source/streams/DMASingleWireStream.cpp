@@ -0,0 +1,319 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DMASingleWireStream.h"
+#include "ErrorNo.h"
+#include "CodalCompat.h"
+#include "MessageBus.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+// The stream currently receiving callbacks. The DMASingleWireSerial callback carries no context, so there can be only one.
+static DMASingleWireStream *activeStream = NULL;
+
+/*
+ * Simple internal helper function that forwards DMA completion callbacks to the active DMASingleWireStream.
+ */
+static void dma_single_wire_stream_irq(uint16_t event)
+{
+    if (activeStream)
+        activeStream->onDMAComplete(event);
+}
+
+DMASingleWireStream::DMASingleWireStream(DMASingleWireSerial &serial) : serial(serial)
+{
+    this->downstream = NULL;
+    this->state = DMA_SINGLE_WIRE_STREAM_STATE_STOPPED;
+    this->rxFill = 0;
+    this->rxRead = 0;
+    this->rxLastCount = 0;
+    this->rxIdleTicks = 0;
+    this->txHead = 0;
+    this->txTail = 0;
+    this->txFree = 0;
+    this->overflowCount = 0;
+    this->errorCount = 0;
+    this->rxEvent = allocateNotifyEvent();
+    this->txEvent = allocateNotifyEvent();
+
+    if (EventModel::defaultEventBus)
+    {
+        EventModel::defaultEventBus->listen(DEVICE_ID_NOTIFY, rxEvent, this, &DMASingleWireStream::onRxEvent);
+        EventModel::defaultEventBus->listen(DEVICE_ID_NOTIFY, txEvent, this, &DMASingleWireStream::onTxEvent);
+    }
+}
+
+int DMASingleWireStream::start()
+{
+    if (state != DMA_SINGLE_WIRE_STREAM_STATE_STOPPED)
+        return DEVICE_OK;
+
+    if (activeStream && activeStream != this)
+        activeStream->stop();
+
+    // Ensure the buffer to be filled, and all the free buffers after it, are ready for DMA.
+    // Buffers waiting to be pulled are left untouched.
+    for (uint8_t i = rxFill; i != (uint8_t)(rxRead + DMA_SINGLE_WIRE_STREAM_RX_BUFFERS); i++)
+        if (rxBuffers[i % DMA_SINGLE_WIRE_STREAM_RX_BUFFERS].length() != DMA_SINGLE_WIRE_STREAM_BUFFER_SIZE)
+            rxBuffers[i % DMA_SINGLE_WIRE_STREAM_RX_BUFFERS] = ManagedBuffer(DMA_SINGLE_WIRE_STREAM_BUFFER_SIZE, BufferInitialize::None);
+
+    activeStream = this;
+    serial.setIRQ(dma_single_wire_stream_irq);
+    status |= DEVICE_COMPONENT_STATUS_SYSTEM_TICK;
+
+    target_disable_irq();
+
+    if (txTail != txHead)
+        startTransmit();
+    else
+        startReceive();
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+void DMASingleWireStream::stop()
+{
+    target_disable_irq();
+
+    if (state != DMA_SINGLE_WIRE_STREAM_STATE_STOPPED)
+        serial.abortDMA();
+
+    state = DMA_SINGLE_WIRE_STREAM_STATE_STOPPED;
+    txTail = txHead;
+
+    target_enable_irq();
+
+    status &= ~DEVICE_COMPONENT_STATUS_SYSTEM_TICK;
+    serial.setMode(SingleWireDisconnected);
+    releaseTxBuffers();
+
+    if (activeStream == this)
+        activeStream = NULL;
+}
+
+int DMASingleWireStream::send(ManagedBuffer buffer)
+{
+    if (buffer.length() == 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    releaseTxBuffers();
+
+    if ((uint8_t)(txHead - txFree) >= DMA_SINGLE_WIRE_STREAM_TX_QUEUE_SIZE)
+        return DEVICE_NO_RESOURCES;
+
+    txQueue[txHead % DMA_SINGLE_WIRE_STREAM_TX_QUEUE_SIZE] = buffer;
+
+    // If we're transmitting, the DMA completion handler will pick this buffer up. Otherwise, stop receiving and send it now.
+    target_disable_irq();
+
+    txHead = txHead + 1;
+
+    if (state == DMA_SINGLE_WIRE_STREAM_STATE_RECEIVING)
+        startTransmit();
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+int DMASingleWireStream::getTxQueueLength()
+{
+    return (uint8_t)(txHead - txTail);
+}
+
+uint32_t DMASingleWireStream::getOverflowCount()
+{
+    return overflowCount;
+}
+
+uint32_t DMASingleWireStream::getErrorCount()
+{
+    return errorCount;
+}
+
+ManagedBuffer DMASingleWireStream::pull()
+{
+    if (rxRead == rxFill)
+        return ManagedBuffer();
+
+    // Hand the buffer over, and replace it with a fresh one before it can be reused for DMA.
+    ManagedBuffer b = rxBuffers[rxRead % DMA_SINGLE_WIRE_STREAM_RX_BUFFERS];
+    rxBuffers[rxRead % DMA_SINGLE_WIRE_STREAM_RX_BUFFERS] = ManagedBuffer(DMA_SINGLE_WIRE_STREAM_BUFFER_SIZE, BufferInitialize::None);
+    rxRead++;
+
+    return b;
+}
+
+void DMASingleWireStream::connect(DataSink &sink)
+{
+    downstream = &sink;
+}
+
+bool DMASingleWireStream::isConnected()
+{
+    return downstream != NULL;
+}
+
+void DMASingleWireStream::disconnect()
+{
+    downstream = NULL;
+}
+
+int DMASingleWireStream::getFormat()
+{
+    return DATASTREAM_FORMAT_8BIT_UNSIGNED;
+}
+
+float DMASingleWireStream::getSampleRate()
+{
+    return serial.getBaud() / 10.0f;
+}
+
+void DMASingleWireStream::periodicCallback()
+{
+    target_disable_irq();
+
+    if (state == DMA_SINGLE_WIRE_STREAM_STATE_RECEIVING)
+    {
+        int received = serial.getBytesReceived();
+
+        if (received == 0 || received != rxLastCount)
+        {
+            rxLastCount = received;
+            rxIdleTicks = 0;
+        }
+        else if (++rxIdleTicks >= DMA_SINGLE_WIRE_STREAM_IDLE_TICKS)
+        {
+            // Nothing has arrived for a while, so don't hold back what we have until the buffer fills.
+            serial.abortDMA();
+            completeReceive(serial.getBytesReceived());
+            startReceive();
+        }
+    }
+
+    target_enable_irq();
+}
+
+void DMASingleWireStream::onDMAComplete(uint16_t event)
+{
+    if (state == DMA_SINGLE_WIRE_STREAM_STATE_RECEIVING)
+    {
+        if (event == SWS_EVT_DATA_RECEIVED)
+            completeReceive(DMA_SINGLE_WIRE_STREAM_BUFFER_SIZE);
+        else
+            errorCount++;
+
+        startReceive();
+    }
+    else if (state == DMA_SINGLE_WIRE_STREAM_STATE_TRANSMITTING)
+    {
+        // A buffer that failed to send is dropped rather than retried, so a fault can't stall the queue.
+        if (event != SWS_EVT_DATA_SENT)
+            errorCount++;
+
+        txTail = txTail + 1;
+        Event(DEVICE_ID_NOTIFY, txEvent);
+
+        if (txTail != txHead)
+            startTransmit();
+        else
+            startReceive();
+    }
+}
+
+void DMASingleWireStream::startReceive()
+{
+    state = DMA_SINGLE_WIRE_STREAM_STATE_RECEIVING;
+    rxLastCount = 0;
+    rxIdleTicks = 0;
+    serial.setMode(SingleWireRx);
+    serial.receiveDMA(rxBuffers[rxFill % DMA_SINGLE_WIRE_STREAM_RX_BUFFERS].getBytes(), DMA_SINGLE_WIRE_STREAM_BUFFER_SIZE);
+}
+
+void DMASingleWireStream::completeReceive(int length)
+{
+    if (length <= 0)
+        return;
+
+    // Keep one buffer free for DMA. If the downstream component hasn't kept up, drop this data and reuse the buffer.
+    if ((uint8_t)(rxFill + 1 - rxRead) >= DMA_SINGLE_WIRE_STREAM_RX_BUFFERS)
+    {
+        overflowCount++;
+        return;
+    }
+
+    rxBuffers[rxFill % DMA_SINGLE_WIRE_STREAM_RX_BUFFERS].truncate(length);
+    rxFill = rxFill + 1;
+
+    Event(DEVICE_ID_NOTIFY, rxEvent);
+}
+
+void DMASingleWireStream::startTransmit()
+{
+    // Keep any data already received into a partially filled buffer.
+    if (state == DMA_SINGLE_WIRE_STREAM_STATE_RECEIVING)
+    {
+        serial.abortDMA();
+        completeReceive(serial.getBytesReceived());
+    }
+
+    ManagedBuffer &b = txQueue[txTail % DMA_SINGLE_WIRE_STREAM_TX_QUEUE_SIZE];
+
+    state = DMA_SINGLE_WIRE_STREAM_STATE_TRANSMITTING;
+    serial.setMode(SingleWireTx);
+    serial.sendDMA(b.getBytes(), b.length());
+}
+
+void DMASingleWireStream::onRxEvent(Event)
+{
+    if (downstream)
+        downstream->pullRequest();
+}
+
+void DMASingleWireStream::onTxEvent(Event)
+{
+    releaseTxBuffers();
+}
+
+void DMASingleWireStream::releaseTxBuffers()
+{
+    uint8_t tail = txTail;
+
+    while (txFree != tail)
+        txQueue[txFree++ % DMA_SINGLE_WIRE_STREAM_TX_QUEUE_SIZE] = ManagedBuffer();
+}
+
+DMASingleWireStream::~DMASingleWireStream()
+{
+    stop();
+
+    if (EventModel::defaultEventBus)
+    {
+        EventModel::defaultEventBus->ignore(DEVICE_ID_NOTIFY, rxEvent, this, &DMASingleWireStream::onRxEvent);
+        EventModel::defaultEventBus->ignore(DEVICE_ID_NOTIFY, txEvent, this, &DMASingleWireStream::onTxEvent);
+    }
+}
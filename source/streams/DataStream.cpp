@@ -84,6 +84,7 @@ DataSourceSink::DataSourceSink(DataSource &source) : upStream( source )
     downStream = NULL;
     source.connect( *this );
     dataWanted(DATASTREAM_DONT_CARE);
+    CODAL_STREAM_TRACE_INIT("DataSourceSink");
 }
 
 DataSourceSink::~DataSourceSink()
@@ -128,6 +129,8 @@ void DataSourceSink::dataWanted(int wanted)
 
 int DataSourceSink::pullRequest()
 {
+    CODAL_STREAM_TRACE_PULL_REQUEST();
+
     if( this->downStream != NULL )
         return this->downStream->pullRequest();
     return DEVICE_BUSY;
@@ -142,6 +145,7 @@ DataStream::DataStream(DataSource &upstream) : DataSourceSink(upstream)
     this->pullRequestEventCode = 0;
     this->isBlocking = true;
     this->hasPending = false;
+    CODAL_STREAM_TRACE_INIT("DataStream");
 }
 
 DataStream::~DataStream()
@@ -171,12 +175,26 @@ void DataStream::setBlocking(bool isBlocking)
 
 ManagedBuffer DataStream::pull()
 {
+    CODAL_STREAM_TRACE_PULL();
+
+    ManagedBuffer b;
+
     // Are we running in sync (blocking) mode?
     if( this->isBlocking )
-        return this->upStream.pull();
-    
-    this->hasPending = false;
-    return ManagedBuffer( this->nextBuffer ); // Deep copy!
+    {
+        b = this->upStream.pull();
+    }
+    else
+    {
+        // Hand our reference over to the caller, so the buffer is not held as shared.
+        b = this->nextBuffer;
+        this->nextBuffer = ManagedBuffer();
+        this->hasPending = false;
+    }
+
+    CODAL_STREAM_TRACE_BYTES(b.length());
+
+    return b;
 }
 
 void DataStream::onDeferredPullRequest(Event)
@@ -193,6 +211,8 @@ bool DataStream::canPull(int size)
 
 int DataStream::pullRequest()
 {
+    CODAL_STREAM_TRACE_PULL_REQUEST();
+
     // Are we running in async (non-blocking) mode?
     if( !this->isBlocking ) {
 
@@ -9,6 +9,7 @@ using namespace codal;
 EffectFilter::EffectFilter(DataSource &source, bool deepCopy) : DataSourceSink( source )
 {
     this->deepCopy = deepCopy;
+    CODAL_STREAM_TRACE_INIT("EffectFilter");
 }
 
 EffectFilter::~EffectFilter()
@@ -17,10 +18,14 @@ EffectFilter::~EffectFilter()
 
 ManagedBuffer EffectFilter::pull()
 {
+    CODAL_STREAM_TRACE_PULL();
+
     ManagedBuffer input = this->upStream.pull();
-    ManagedBuffer output = (deepCopy || input.isReadOnly()) ? ManagedBuffer(input.length()) : input;
+    ManagedBuffer output = (deepCopy || input.isShared()) ? ManagedBuffer(input.length()) : input;
 
     applyEffect(input, output, this->upStream.getFormat());
+    CODAL_STREAM_TRACE_BYTES(output.length());
+
     return output;
 }
 
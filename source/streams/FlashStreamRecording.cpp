@@ -0,0 +1,417 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FlashStreamRecording.h"
+#include "ErrorNo.h"
+#include "CodalCompat.h"
+#include "CodalFiber.h"
+#include "MessageBus.h"
+#include "CodalDmesg.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+/*
+ * Simple internal helper function that runs the background fiber of the given FlashStreamRecording.
+ */
+static void flash_recording_process(void *data)
+{
+    ((FlashStreamRecording *)data)->process();
+}
+
+FlashStreamRecording::FlashStreamRecording(DataSource &source, SPIFlash &flash, uint32_t start, uint32_t length) : DataSourceSink( source ), flash(flash), recordLock(0, FiberLockMode::MUTEX), playLock(0, FiberLockMode::MUTEX)
+{
+    this->flashStart = start & ~(SPIFLASH_SMALL_ROW_SIZE - 1);
+    this->flashLength = length & ~(SPIFLASH_SMALL_ROW_SIZE - 1);
+    this->state = REC_STATE_STOPPED;
+    this->totalBufferLength = 0;
+    this->readOffset = 0;
+    this->writeOffset = 0;
+    this->eraseOffset = 0;
+    this->queueHead = 0;
+    this->queueLength = 0;
+    this->overflowCount = 0;
+    this->pageLength = 0;
+    this->notifyEvent = allocateNotifyEvent();
+    this->workerActive = false;
+    this->flushPending = false;
+}
+
+ManagedBuffer FlashStreamRecording::pull()
+{
+    ManagedBuffer out;
+
+    if (state == REC_STATE_PLAYING)
+    {
+        // Take the prefetched buffer, if our background fiber has read it. This may be in interrupt context,
+        // so never read from flash here: if the buffer isn't ready yet, the downstream is told when it is.
+        target_disable_irq();
+        out = prefetch;
+        prefetch = ManagedBuffer();
+        target_enable_irq();
+    }
+
+    // Read the next buffer ahead of time. The downstream is told it is available once it has been read.
+    // Our background fiber also detects the end of the playback, and wakes any blocked threads.
+    if (out.length() != 0)
+        Event(DEVICE_ID_NOTIFY, notifyEvent);
+
+    return out;
+}
+
+int FlashStreamRecording::length()
+{
+    return this->totalBufferLength;
+}
+
+float FlashStreamRecording::duration( unsigned int sampleRate )
+{
+    return ((float)this->length() / (float) DATASTREAM_FORMAT_BYTES_PER_SAMPLE(this->getFormat()) ) / (float)sampleRate;
+}
+
+uint32_t FlashStreamRecording::getOverflowCount()
+{
+    return overflowCount;
+}
+
+int FlashStreamRecording::pullRequest()
+{
+    // Ignore incoming buffers if we aren't actively recording
+    if( this->state != REC_STATE_RECORDING )
+        return DEVICE_OK;
+
+    ManagedBuffer buffer = upStream.pull();
+
+    // Ignore any empty buffers (possibly because we're out of RAM!)
+    if(buffer.length() == 0)
+        return DEVICE_OK;
+
+    // Queue the buffer to be written to flash by our background fiber, as flash writes and erases are slow.
+    // If the queue is full, flash can't keep up with the incoming data, so drop the buffer rather than use more RAM.
+    // The queue is shared with our background fiber, so update it with interrupts disabled.
+    target_disable_irq();
+
+    if (queueLength < CODAL_FLASH_STREAM_RECORDING_QUEUE_SIZE)
+    {
+        queue[(queueHead + queueLength) % CODAL_FLASH_STREAM_RECORDING_QUEUE_SIZE] = buffer;
+        queueLength++;
+    }
+    else
+    {
+        overflowCount++;
+    }
+
+    target_enable_irq();
+
+    // Our background fiber always runs while recording. This may be in interrupt context, so just wake it.
+    Event(DEVICE_ID_NOTIFY, notifyEvent);
+
+    return DEVICE_OK;
+}
+
+void FlashStreamRecording::wake()
+{
+    if (!workerActive)
+    {
+        workerActive = true;
+        create_fiber(flash_recording_process, this);
+    }
+    else
+    {
+        Event(DEVICE_ID_NOTIFY, notifyEvent);
+    }
+}
+
+void FlashStreamRecording::process()
+{
+    while (true)
+    {
+        // Write any queued buffers to flash.
+        while (queueLength)
+        {
+            ManagedBuffer b;
+
+            // pullRequest() may add to the queue from interrupt context, so take the oldest buffer with interrupts disabled.
+            // Our reference to it is released when b goes out of scope, after interrupts are enabled again.
+            target_disable_irq();
+            b = queue[queueHead];
+            queue[queueHead] = ManagedBuffer();
+            queueHead = (queueHead + 1) % CODAL_FLASH_STREAM_RECORDING_QUEUE_SIZE;
+            queueLength--;
+            target_enable_irq();
+
+            write(b);
+        }
+
+        if (state == REC_STATE_RECORDING)
+        {
+            // Erase the next row ahead of the write head while we're otherwise idle, so that writes don't need to wait for it.
+            if (eraseOffset < flashLength && eraseOffset - writeOffset <= SPIFLASH_SMALL_ROW_SIZE)
+            {
+                if (flash.eraseSmallRow(flashStart + eraseOffset) != DEVICE_OK)
+                    stop();
+                else
+                    eraseOffset += SPIFLASH_SMALL_ROW_SIZE;
+
+                continue;
+            }
+        }
+        else if (flushPending)
+        {
+            // Recording has finished. Write out any partial page, and let any blocked threads know the data is safely stored.
+            if (pageLength)
+            {
+                writePage(page.getBytes(), pageLength);
+                pageLength = 0;
+            }
+
+            page = ManagedBuffer();
+            flushPending = false;
+            recordLock.notifyAll();
+        }
+
+        if (state == REC_STATE_PLAYING && prefetch.length() == 0)
+        {
+            if (readOffset < totalBufferLength)
+            {
+                ManagedBuffer b = read();
+
+                // pull() may take the prefetched buffer from interrupt context.
+                target_disable_irq();
+                prefetch = b;
+                target_enable_irq();
+
+                // Indicate to the downstream that another buffer is available.
+                if (downStream != NULL)
+                    downStream->pullRequest();
+
+                continue;
+            }
+
+            // We've reached the end of the recording.
+            state = REC_STATE_STOPPED;
+            playLock.notifyAll();
+        }
+
+        if (state == REC_STATE_STOPPED && queueLength == 0)
+            break;
+
+        if (queueLength == 0)
+            fiber_wait_for_event(DEVICE_ID_NOTIFY, notifyEvent);
+    }
+
+    workerActive = false;
+}
+
+void FlashStreamRecording::write(ManagedBuffer buffer)
+{
+    uint8_t *src = buffer.getBytes();
+    int length = buffer.length();
+    bool failed = false;
+
+    while (length > 0 && writeOffset + pageLength < flashLength)
+    {
+        if (pageLength == 0 && length >= SPIFLASH_PAGE_SIZE)
+        {
+            // A whole page can be written straight from the incoming buffer.
+            if (writePage(src, SPIFLASH_PAGE_SIZE) != DEVICE_OK)
+            {
+                failed = true;
+                break;
+            }
+
+            src += SPIFLASH_PAGE_SIZE;
+            length -= SPIFLASH_PAGE_SIZE;
+            continue;
+        }
+
+        // Otherwise, assemble a page in RAM.
+        if (page.length() != SPIFLASH_PAGE_SIZE)
+            page = ManagedBuffer(SPIFLASH_PAGE_SIZE);
+
+        int l = min(length, SPIFLASH_PAGE_SIZE - pageLength);
+        memcpy(page.getBytes() + pageLength, src, l);
+
+        src += l;
+        length -= l;
+        pageLength += l;
+        totalBufferLength = writeOffset + pageLength;
+
+        if (pageLength == SPIFLASH_PAGE_SIZE)
+        {
+            pageLength = 0;
+
+            if (writePage(page.getBytes(), SPIFLASH_PAGE_SIZE) != DEVICE_OK)
+            {
+                failed = true;
+                break;
+            }
+        }
+    }
+
+    // Stop once the flash area is full, or can't be written.
+    if (length > 0 || failed)
+        stop();
+}
+
+int FlashStreamRecording::writePage(const uint8_t *data, int length)
+{
+    // Make sure the row we're writing to has been erased. This is normally done ahead of time.
+    while (eraseOffset <= writeOffset)
+    {
+        if (flash.eraseSmallRow(flashStart + eraseOffset) != DEVICE_OK)
+            return DEVICE_SPI_ERROR;
+
+        eraseOffset += SPIFLASH_SMALL_ROW_SIZE;
+    }
+
+    if (flash.writeBytes(flashStart + writeOffset, data, length) != DEVICE_OK)
+        return DEVICE_SPI_ERROR;
+
+    writeOffset += SPIFLASH_PAGE_SIZE;
+    totalBufferLength = writeOffset - SPIFLASH_PAGE_SIZE + length;
+
+    return DEVICE_OK;
+}
+
+ManagedBuffer FlashStreamRecording::read()
+{
+    int l = min((int)(totalBufferLength - readOffset), CODAL_FLASH_STREAM_RECORDING_BUFFER_SIZE);
+    ManagedBuffer b(l);
+
+    if (flash.readBytes(flashStart + readOffset, b.getBytes(), l) != DEVICE_OK)
+        return ManagedBuffer();
+
+    readOffset += l;
+    return b;
+}
+
+int FlashStreamRecording::recordAsync()
+{
+    // If we're already recording, then treat as a NOP.
+    if(state != REC_STATE_RECORDING)
+    {
+        // We could be playing back. If so, stop first and erase our buffer.
+        stop();
+        erase();
+
+        state = REC_STATE_RECORDING;
+        upStream.dataWanted(DATASTREAM_WANTED);
+
+        // Start erasing ahead of the incoming data.
+        wake();
+    }
+
+    return DEVICE_OK;
+}
+
+void FlashStreamRecording::record()
+{
+    recordAsync();
+    recordLock.wait();
+}
+
+void FlashStreamRecording::erase()
+{
+    if( this->state != REC_STATE_STOPPED )
+        this->stop();
+
+    // Flash is erased a row at a time as the next recording is made.
+    totalBufferLength = 0;
+    readOffset = 0;
+    writeOffset = 0;
+    eraseOffset = 0;
+    pageLength = 0;
+    overflowCount = 0;
+}
+
+int FlashStreamRecording::playAsync()
+{
+    if( this->state != REC_STATE_PLAYING )
+    {
+        if (this->state == REC_STATE_RECORDING)
+            stop();
+
+        this->state = REC_STATE_PLAYING;
+        readOffset = 0;
+
+        target_disable_irq();
+        prefetch = ManagedBuffer();
+        target_enable_irq();
+
+        // Our background fiber writes out any data still queued, then prefetches the first buffer and notifies our downstream.
+        wake();
+    }
+
+    return DEVICE_OK;
+}
+
+void FlashStreamRecording::play()
+{
+    playAsync();
+
+    if (isPlaying())
+        playLock.wait();
+}
+
+int FlashStreamRecording::stop()
+{
+    if (this->state != REC_STATE_STOPPED)
+    {
+        if (this->state == REC_STATE_RECORDING)
+        {
+            upStream.dataWanted(DATASTREAM_DONT_CARE);
+            flushPending = workerActive;
+        }
+
+        this->state = REC_STATE_STOPPED;
+
+        // Our background fiber completes any outstanding writes, then releases any blocked threads.
+        if (workerActive)
+            wake();
+        else
+            recordLock.notifyAll();
+
+        playLock.notifyAll();
+    }
+
+    this->readOffset = 0;
+
+    return DEVICE_OK;
+}
+
+bool FlashStreamRecording::isPlaying()
+{
+    return this->state == REC_STATE_PLAYING;
+}
+
+bool FlashStreamRecording::isRecording()
+{
+    return this->state == REC_STATE_RECORDING;
+}
+
+bool FlashStreamRecording::isStopped()
+{
+    return this->state == REC_STATE_STOPPED;
+}
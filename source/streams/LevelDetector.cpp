@@ -37,6 +37,7 @@ LevelDetector::LevelDetector(DataSource &source, int highThreshold, int lowThres
     this->id = id;
     this->level = 0;
     this->sigma = 0;
+    CODAL_STREAM_TRACE_INIT("LevelDetector");
     this->windowPosition = 0;
     this->windowSize = LEVEL_DETECTOR_DEFAULT_WINDOW_SIZE;
     this->lowThreshold = lowThreshold;
@@ -53,11 +54,14 @@ LevelDetector::LevelDetector(DataSource &source, int highThreshold, int lowThres
  */
 int LevelDetector::pullRequest()
 {
+    CODAL_STREAM_TRACE_PULL_REQUEST();
+
     if( this->timeout - system_timer_current_time() > CODAL_STREAM_IDLE_TIMEOUT_MS && !activated ) {
         return DEVICE_BUSY;
     }
 
     ManagedBuffer b = upstream.pull();
+    CODAL_STREAM_TRACE_BYTES(b.length());
 
     int16_t *data = (int16_t *) &b[0];
 
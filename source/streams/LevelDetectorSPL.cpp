@@ -34,11 +34,65 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+// log2(1 + i/32) for i = 0..32, in 16.16 fixed point.
+static const uint32_t log2_table[33] = {
+    0, 2909, 5732, 8473, 11136, 13727, 16248, 18704, 21098, 23433, 25711, 27936, 30109, 32234, 34312, 36346,
+    38336, 40286, 42196, 44068, 45904, 47705, 49472, 51207, 52911, 54584, 56229, 57845, 59434, 60997, 62534, 64047,
+    65536
+};
+
+/**
+ * Integer approximation of 20.log10(x), in 24.8 fixed point, using a table of log2 values with linear interpolation.
+ * Accurate to approximately 0.02dB.
+ *
+ * @param x The value to convert. Must be nonzero.
+ */
+static uint32_t fast_db(uint32_t x)
+{
+    int e = 31 - __builtin_clz(x);
+    uint32_t m = x << (31 - e);                 // Normalise to 1.31 fixed point, in the range [1,2).
+    int i = (m >> 26) & 31;                     // Top five fractional bits select the table entry...
+    uint32_t f = (m >> 10) & 0xFFFF;            // ... and the next 16 bits interpolate between entries.
+    uint32_t l = ((uint32_t)e << 16) + log2_table[i] + (((log2_table[i + 1] - log2_table[i]) * f) >> 16);
+
+    // 20.log10(x) = 6.0206 * log2(x). 6.0206 * 256 = 1541.27
+    return (uint32_t)(((uint64_t)l * 1541) >> 16);
+}
+
+/**
+ * Integer square root, rounded down.
+ */
+static uint32_t isqrt(uint32_t x)
+{
+    uint32_t r = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > x)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (x >= r + bit)
+        {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else
+        {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return r;
+}
+
 LevelDetectorSPL::LevelDetectorSPL(DataSource &source, float highThreshold, float lowThreshold, float gain, float minValue, uint16_t id) : upstream(source), resourceLock(0)
 {
     this->id = id;
     this->level = 0;
     this->windowSize = LEVEL_DETECTOR_SPL_DEFAULT_WINDOW_SIZE;
+    CODAL_STREAM_TRACE_INIT("LevelDetectorSPL");
     this->lowThreshold = lowThreshold;
     this->highThreshold = highThreshold;
     this->minValue = minValue;
@@ -55,6 +109,13 @@ LevelDetectorSPL::LevelDetectorSPL(DataSource &source, float highThreshold, floa
     this->bufferCount = 0;
     this->listenerCount = 0;
 
+    this->window = NULL;
+    this->windowCapacity = 0;
+    this->windowPosition = 0;
+    this->dbOffset = 0;
+    this->dbGain = 0;
+    this->dbMultiplier = 0;
+
     // Request a periodic callback
     status |= DEVICE_COMPONENT_STATUS_SYSTEM_TICK;
 
@@ -92,6 +153,8 @@ void LevelDetectorSPL::periodicCallback()
 
 int LevelDetectorSPL::pullRequest()
 {
+    CODAL_STREAM_TRACE_PULL_REQUEST();
+
     //DMESG("LevelDetectorSPL: PR");
 
     // Ignore the first LEVEL_DETECTOR_SPL_MIN_BUFFERS buffers, as we wait for the microphone to level out
@@ -109,6 +172,7 @@ int LevelDetectorSPL::pullRequest()
 
     ManagedBuffer b = upstream.pull();
     uint8_t *data = &b[0];
+    CODAL_STREAM_TRACE_BYTES(b.length());
 
     int format = upstream.getFormat();
     int skip = 1;
@@ -117,199 +181,264 @@ int LevelDetectorSPL::pullRequest()
     windowSize = 256;
 
     if (format == DATASTREAM_FORMAT_16BIT_SIGNED || format == DATASTREAM_FORMAT_UNKNOWN){
+        format = DATASTREAM_FORMAT_16BIT_SIGNED;
         skip = 2;
         multiplier = 1;
         windowSize = 128;
     }
     else if (format == DATASTREAM_FORMAT_32BIT_SIGNED){
+        // 32 bit samples are scaled into 16 bits as they are read.
         skip = 4;
         windowSize = 64;
-        multiplier = (1/65536);
+        multiplier = 1;
     }
 
     int samples = b.length() / skip;
 
-    while(samples){
-        // ensure we use at least windowSize number of samples (128)
-        if(samples < windowSize)
-            break;
-
-        uint8_t *ptr, *end;
-
-        ptr = data;
-        end = data + windowSize;
+    // Ensure we have somewhere to hold windows that span more than one buffer.
+    if (windowCapacity < windowSize)
+    {
+        free(window);
+        window = (int16_t *) malloc(windowSize * sizeof(int16_t));
+        windowCapacity = window ? windowSize : 0;
+        windowPosition = 0;
 
-        float pref = 0.00002;
+        if (window == NULL)
+            return DEVICE_NO_RESOURCES;
+    }
 
-        /*******************************
-        *   GET MAX VALUE
-        ******************************/
-        int16_t maxVal = 0;
-        int16_t minVal = 32766;
-        int32_t v;
-        bool ignore;
+    windowPosition = min(windowPosition, windowSize);
 
-        struct Outlier
+    while (samples)
+    {
+        // Process complete windows of 16 bit data directly from the input buffer, where possible.
+        if (windowPosition == 0 && skip == 2 && samples >= windowSize)
         {
-            int32_t value;
-            bool    used;
-        };
-
-        Outlier outliers[LEVEL_DETECTOR_SPL_OUTLIER_REJECTION] = {0, false};
-
-        ptr = data;
-        while (ptr < end) {
-            v = (int32_t) StreamNormalizer::readSample[format](ptr);
-            if (v != 0) nonzero = true;
-
-            for (int i=0; i<LEVEL_DETECTOR_SPL_OUTLIER_REJECTION; i++)
-                if(!outliers[i].used || (outliers[i].used && v < outliers[i].value))
-                {
-                    for (int j=i+1; j<LEVEL_DETECTOR_SPL_OUTLIER_REJECTION; j++)
-                    {
-                        outliers[j].value = outliers[j-1].value;
-                        outliers[i+1].used = true;
-                    }
-
-                    outliers[i].value = v;
-                    outliers[i].used = true;
-                    break;
-                }
-
-            ptr += skip;
+            processWindow((int16_t *)data, multiplier, nonzero);
+            data += windowSize * skip;
+            samples -= windowSize;
+            continue;
         }
 
-        ptr = data;
+        // Otherwise, gather samples into the window buffer. Windows may span multiple input buffers.
+        int n = min(samples, windowSize - windowPosition);
+        int16_t *w = &window[windowPosition];
 
-        while (ptr < end) {
-            v = (int32_t) StreamNormalizer::readSample[format](ptr);
-            ignore = false;
+        samples -= n;
+        windowPosition += n;
 
-            for (int i=0; i<LEVEL_DETECTOR_SPL_OUTLIER_REJECTION; i++)
+        if (skip == 2)
+        {
+            memcpy(w, data, n * sizeof(int16_t));
+            data += n * sizeof(int16_t);
+        }
+        else if (skip == 4)
+        {
+            while (n--)
             {
-                if (v == outliers[i].value && outliers[i].used)
-                {
-                    outliers[i].used = false;
-                    ignore = true;
-                    break;
-                }
+                *w++ = (int16_t)(*(int32_t *)data >> 16);
+                data += 4;
             }
+        }
+        else
+        {
+            while (n--)
+                *w++ = (int16_t) StreamNormalizer::readSample[format](data++);
+        }
+
+        if (windowPosition == windowSize)
+        {
+            processWindow(window, multiplier, nonzero);
+            windowPosition = 0;
+        }
+    }
+
+    // Wake any sleeping fibers waiting for data.
+    if(this->resourceLock.getWaitCount() > 0 && nonzero)
+        this->resourceLock.notifyAll();
+
+    // If we're waiting for valid data, esure we don't timeout early.
+    if(!nonzero && (status & LEVEL_DETECTOR_SPL_DATA_REQUESTED))
+        this->timestamp = system_timer->getTime();
 
-            if (!ignore)
+    return DEVICE_OK;
+}
+
+/**
+ * Calculates the level of a single window of windowSize samples, and emits any resulting events.
+ *
+ * @param data The samples of the window.
+ * @param multiplier The scale of the samples, relative to 16 bit samples.
+ * @param nonzero Set to true if any sample in the window is nonzero.
+ */
+void LevelDetectorSPL::processWindow(const int16_t *data, float multiplier, bool &nonzero)
+{
+    int n = windowSize;
+
+    /*******************************
+    *   GET MAX VALUE
+    ******************************/
+    // Reject the LEVEL_DETECTOR_SPL_OUTLIER_REJECTION lowest samples, by keeping the lowest few samples sorted
+    // in a single pass. The minimum is then the last of them. Most samples are rejected by the first comparison.
+    static_assert(LEVEL_DETECTOR_SPL_OUTLIER_REJECTION >= 0 && LEVEL_DETECTOR_SPL_OUTLIER_REJECTION <= 16,
+                  "LEVEL_DETECTOR_SPL_OUTLIER_REJECTION must be in the range 0..16");
+
+    const int keep = LEVEL_DETECTOR_SPL_OUTLIER_REJECTION + 1;
+    int lowest[keep];
+    int maxSample = INT32_MIN;
+    int any = 0;
+
+    for (int i = 0; i < keep; i++)
+        lowest[i] = INT32_MAX;
+
+    for (int i = 0; i < n; i++)
+    {
+        int v = data[i];
+        any |= v;
+
+        if (v > maxSample)
+            maxSample = v;
+
+        if (v < lowest[keep - 1])
+        {
+            int j = keep - 1;
+
+            while (j > 0 && lowest[j - 1] > v)
             {
-                if (v > maxVal) maxVal = v;
-                if (v < minVal) minVal = v;
+                lowest[j] = lowest[j - 1];
+                j--;
             }
 
-            ptr += skip;
+            lowest[j] = v;
         }
+    }
 
-        if (maxVal < minVal + LEVEL_DETECTOR_SPL_NOISE_FLOOR)
-            maxVal = minVal + 1;
+    if (any)
+        nonzero = true;
 
-        maxVal = (maxVal - minVal) / 2;
+    int maxVal = max(maxSample, 0);
+    int minVal = min(lowest[LEVEL_DETECTOR_SPL_OUTLIER_REJECTION], 32766);
 
-        /*******************************
-        *   GET RMS AMPLITUDE FOR CLAP DETECTION
-        ******************************/
-        int sumSquares = 0;
-        int count = 0;
-        ptr = data;
-        while (ptr < end) {
-            count++;
-            v = (int32_t) StreamNormalizer::readSample[format](ptr) - minVal;   // need to sub minVal to avoid overflow
-            v = max(v - LEVEL_DETECTOR_SPL_NOISE_FLOOR, 0);
+    if (maxVal < minVal + LEVEL_DETECTOR_SPL_NOISE_FLOOR)
+        maxVal = minVal + 1;
 
-            sumSquares += v * v;
-            ptr += skip;
-        }
+    maxVal = (maxVal - minVal) / 2;
 
-        float rms = sqrtf(sumSquares / count);
+    /*******************************
+    *   GET RMS AMPLITUDE FOR CLAP DETECTION
+    ******************************/
+    // 64 bit accumulation of the squared samples above the noise floor, unrolled by four.
+    int floor = minVal + LEVEL_DETECTOR_SPL_NOISE_FLOOR;
+    uint64_t sumSquares = 0;
+    const int16_t *ptr = data;
+    int count = n;
 
-        /*******************************
-        *   CALCULATE SPL
-        ******************************/
-        float conv = ((float) maxVal * multiplier) / ((1 << 15) - 1) * gain;
-        conv = 20.0f * log10f(conv / pref);
+    while (count >= 4)
+    {
+        int v0 = max(ptr[0] - floor, 0);
+        int v1 = max(ptr[1] - floor, 0);
+        int v2 = max(ptr[2] - floor, 0);
+        int v3 = max(ptr[3] - floor, 0);
+
+        // Each square fits in 32 bits, but the sum of two may not.
+        sumSquares += (uint32_t)v0 * (uint32_t)v0;
+        sumSquares += (uint32_t)v1 * (uint32_t)v1;
+        sumSquares += (uint32_t)v2 * (uint32_t)v2;
+        sumSquares += (uint32_t)v3 * (uint32_t)v3;
+
+        ptr += 4;
+        count -= 4;
+    }
 
-        if (conv < minValue)
-            level = minValue;
-        else if (isfinite(conv))
-            level = conv;
-        else
-            level = minValue;
+    while (count--)
+    {
+        int v = max(*ptr++ - floor, 0);
+        sumSquares += (uint32_t)v * (uint32_t)v;
+    }
 
-        samples -= windowSize;
-        data += windowSize;
+    float rms = (float) isqrt((uint32_t)(sumSquares / n));
 
-        // Indicate that we have valid data.
-        this->status |= LEVEL_DETECTOR_SPL_DATA_VALID;
+    /*******************************
+    *   CALCULATE SPL
+    ******************************/
+    // 20.log10(maxVal * multiplier * gain / 32767 / pref) is split into 20.log10(maxVal), calculated with
+    // an integer approximation, and a constant offset that is only recalculated when the gain or scale changes.
+    if (dbGain != gain || dbMultiplier != multiplier)
+    {
+        float pref = 0.00002;
 
-        /*******************************
-        *   EMIT EVENTS
-        ******************************/
+        dbOffset = 20.0f * log10f(multiplier * gain / ((1 << 15) - 1) / pref);
+        dbGain = gain;
+        dbMultiplier = multiplier;
+    }
 
-        // HIGH THRESHOLD
-        if ((!(status & LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED)) && level > highThreshold)
-        {
-            Event(id, LEVEL_THRESHOLD_HIGH);
-            status |=  LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
-            status &= ~LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
-        }
+    if (maxVal > 0)
+    {
+        float conv = (float) fast_db((uint32_t) maxVal) / 256.0f + dbOffset;
+        level = (conv < minValue || !isfinite(conv)) ? minValue : conv;
+    }
+    else
+    {
+        level = minValue;
+    }
 
-        // LOW THRESHOLD
-        else if ((!(status & LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED)) && level < lowThreshold)
-        {
-            Event(id, LEVEL_THRESHOLD_LOW);
-            status |=  LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
-            status &= ~LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
-        }
+    // Indicate that we have valid data.
+    this->status |= LEVEL_DETECTOR_SPL_DATA_VALID;
 
-        // CLAP DETECTION HANDLING
-        if (this->inNoisyBlock && rms > this->maxRms) this->maxRms = rms;
-
-        if (
-            (       // if start of clap
-                    !this->inNoisyBlock &&
-                    rms > LEVEL_DETECTOR_SPL_BEGIN_POSS_CLAP_RMS &&
-                    this->quietBlockCount >= LEVEL_DETECTOR_SPL_CLAP_MIN_QUIET_BLOCKS
-            ) ||
-            (       // or if continuing a clap
-                    this->inNoisyBlock &&
-                    rms > LEVEL_DETECTOR_SPL_CLAP_OVER_RMS
-            )) {
-            // noisy block
-            if (!this->inNoisyBlock)
-                this->maxRms = rms;
-            this->quietBlockCount = 0;
-            this->noisyBlockCount += 1;
-            this->inNoisyBlock = true;
-
-        } else {
-            // quiet block
-            if (    // if not too long, not too short, and loud enough
-                    this->noisyBlockCount <= LEVEL_DETECTOR_SPL_CLAP_MAX_LOUD_BLOCKS &&
-                    this->noisyBlockCount >= LEVEL_DETECTOR_SPL_CLAP_MIN_LOUD_BLOCKS &&
-                    this->maxRms >= LEVEL_DETECTOR_SPL_MIN_IN_CLAP_RMS
-                    ) {
-                Event(id, LEVEL_DETECTOR_SPL_CLAP);
-            }
-            this->inNoisyBlock = false;
-            this->noisyBlockCount = 0;
-            this->quietBlockCount += 1;
-            this->maxRms = 0;
-        }
-    }
+    /*******************************
+    *   EMIT EVENTS
+    ******************************/
 
-    // Wake any sleeping fibers waiting for data.
-    if(this->resourceLock.getWaitCount() > 0 && nonzero)
-        this->resourceLock.notifyAll();
+    // HIGH THRESHOLD
+    if ((!(status & LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED)) && level > highThreshold)
+    {
+        Event(id, LEVEL_THRESHOLD_HIGH);
+        status |=  LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
+        status &= ~LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
+    }
 
-    // If we're waiting for valid data, esure we don't timeout early.
-    if(!nonzero && (status & LEVEL_DETECTOR_SPL_DATA_REQUESTED))
-        this->timestamp = system_timer->getTime();
+    // LOW THRESHOLD
+    else if ((!(status & LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED)) && level < lowThreshold)
+    {
+        Event(id, LEVEL_THRESHOLD_LOW);
+        status |=  LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
+        status &= ~LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
+    }
 
-    return DEVICE_OK;
+    // CLAP DETECTION HANDLING
+    if (this->inNoisyBlock && rms > this->maxRms) this->maxRms = rms;
+
+    if (
+        (       // if start of clap
+                !this->inNoisyBlock &&
+                rms > LEVEL_DETECTOR_SPL_BEGIN_POSS_CLAP_RMS &&
+                this->quietBlockCount >= LEVEL_DETECTOR_SPL_CLAP_MIN_QUIET_BLOCKS
+        ) ||
+        (       // or if continuing a clap
+                this->inNoisyBlock &&
+                rms > LEVEL_DETECTOR_SPL_CLAP_OVER_RMS
+        )) {
+        // noisy block
+        if (!this->inNoisyBlock)
+            this->maxRms = rms;
+        this->quietBlockCount = 0;
+        this->noisyBlockCount += 1;
+        this->inNoisyBlock = true;
+
+    } else {
+        // quiet block
+        if (    // if not too long, not too short, and loud enough
+                this->noisyBlockCount <= LEVEL_DETECTOR_SPL_CLAP_MAX_LOUD_BLOCKS &&
+                this->noisyBlockCount >= LEVEL_DETECTOR_SPL_CLAP_MIN_LOUD_BLOCKS &&
+                this->maxRms >= LEVEL_DETECTOR_SPL_MIN_IN_CLAP_RMS
+                ) {
+            Event(id, LEVEL_DETECTOR_SPL_CLAP);
+        }
+        this->inNoisyBlock = false;
+        this->noisyBlockCount = 0;
+        this->quietBlockCount += 1;
+        this->maxRms = 0;
+    }
 }
 
 float LevelDetectorSPL::getValue( int scale )
@@ -469,4 +598,5 @@ void LevelDetectorSPL::listenerRemoved()
 
 LevelDetectorSPL::~LevelDetectorSPL()
 {
+    free(window);
 }
@@ -7,6 +7,7 @@ LowPassFilter::LowPassFilter( DataSource &source, float beta, bool deepCopy) : E
 {
     this->lpf_value = 1.0;
     setBeta(beta);
+    CODAL_STREAM_TRACE_INIT("LowPassFilter");
 }
 
 LowPassFilter::~LowPassFilter()
@@ -28,10 +28,110 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+/**
+ * Sample readers used by the accumulating mixer.
+ * Each converts a raw sample into a signed 16 bit representation, which is then scaled by the channel volume.
+ */
+struct MixerReadU8  { typedef uint8_t  T; static inline int read(T v) { return ((int)v - 128) << 8; } };
+struct MixerReadS8  { typedef int8_t   T; static inline int read(T v) { return (int)v << 8; } };
+struct MixerReadU16 { typedef uint16_t T; static inline int read(T v) { return (int)v - 32768; } };
+struct MixerReadS16 { typedef int16_t  T; static inline int read(T v) { return (int)v; } };
+struct MixerReadU32 { typedef uint32_t T; static inline int read(T v) { return (int)(v >> 16) - 32768; } };
+struct MixerReadS32 { typedef int32_t  T; static inline int read(T v) { return (int)(v >> 16); } };
+struct MixerReadU10 { typedef uint16_t T; static inline int read(T v) { return ((int)v - 512) << 6; } };
+struct MixerReadS10 { typedef int16_t  T; static inline int read(T v) { return (int)v << 6; } };
+
+/**
+ * Adds n samples to the accumulator at a constant volume.
+ * The loop is unrolled, and free of data dependent branches, to allow the compiler to pipeline (or vectorise) it.
+ */
+template <class R>
+static void mixConstant(int32_t *acc, const uint8_t *in, int n, int volume)
+{
+    const typename R::T *d = (const typename R::T *) in;
+
+    while (n >= 4)
+    {
+        acc[0] += (R::read(d[0]) * volume) >> MIXER_HEADROOM_BITS;
+        acc[1] += (R::read(d[1]) * volume) >> MIXER_HEADROOM_BITS;
+        acc[2] += (R::read(d[2]) * volume) >> MIXER_HEADROOM_BITS;
+        acc[3] += (R::read(d[3]) * volume) >> MIXER_HEADROOM_BITS;
+        acc += 4;
+        d += 4;
+        n -= 4;
+    }
+
+    while (n--)
+        *acc++ += (R::read(*d++) * volume) >> MIXER_HEADROOM_BITS;
+}
+
+/**
+ * Adds n samples to the accumulator, linearly ramping the volume by step (16.16 fixed point) per sample.
+ */
+template <class R>
+static void mixRamp(int32_t *acc, const uint8_t *in, int n, uint32_t &gain, int32_t step)
+{
+    const typename R::T *d = (const typename R::T *) in;
+    uint32_t g = gain;
+
+    while (n--)
+    {
+        *acc++ += (R::read(*d++) * (int)(g >> 16)) >> MIXER_HEADROOM_BITS;
+        g += step;
+    }
+
+    gain = g;
+}
+
+/**
+ * Adds a buffer of the given format to the accumulator.
+ * The first rampLength samples follow the volume ramp, and the remainder are mixed at a constant volume.
+ */
+template <class R>
+static void mixFormat(int32_t *acc, const uint8_t *in, int n, int volume, int rampLength, uint32_t &gain, int32_t step)
+{
+    if (rampLength)
+        mixRamp<R>(acc, in, rampLength, gain, step);
+
+    mixConstant<R>(acc + rampLength, in + rampLength * sizeof(typename R::T), n - rampLength, volume);
+}
+
+int MixerChannel::setVolume(uint16_t volume, uint32_t rampSamples)
+{
+    if (volume > MIXER_MAX_VOLUME)
+        volume = MIXER_MAX_VOLUME;
+
+    target_disable_irq();
+
+    if (rampSamples == 0)
+    {
+        this->volume = volume;
+        this->rampSamples = 0;
+    }
+    else
+    {
+        // volume is public, so may have been set directly to more than MIXER_MAX_VOLUME.
+        int32_t start = min(this->volume, MIXER_MAX_VOLUME);
+
+        this->rampGain = (uint32_t)start << 16;
+        this->rampStep = (int32_t)(((int64_t)volume - start) * 65536 / (int64_t)rampSamples);
+        this->rampTarget = volume;
+        this->rampSamples = rampSamples;
+    }
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
 Mixer::Mixer()
 {
     channels = NULL;
     downStream = NULL;
+    outputFormat = DATASTREAM_FORMAT_UNKNOWN;
+    CODAL_STREAM_TRACE_INIT("Mixer");
+    accumulator = NULL;
+    accumulatorSize = 0;
 }
 
 Mixer::~Mixer()
@@ -43,6 +143,8 @@ Mixer::~Mixer()
         n->stream->disconnect();
         delete n;
     }
+
+    free(accumulator);
 }
 
 MixerChannel *Mixer::addChannel(DataStream &stream)
@@ -52,12 +154,21 @@ MixerChannel *Mixer::addChannel(DataStream &stream)
     c->next = channels;
     c->volume = 1024;
     c->isSigned = true;
+    c->rampGain = 0;
+    c->rampStep = 0;
+    c->rampSamples = 0;
+    c->rampTarget = 0;
     channels = c;
     stream.connect(*this);
     return c;
 }
 
 ManagedBuffer Mixer::pull() {
+    CODAL_STREAM_TRACE_PULL();
+
+    if (outputFormat != DATASTREAM_FORMAT_UNKNOWN)
+        return pullAccumulated();
+
     if (!channels)
         return ManagedBuffer(512);
 
@@ -67,7 +178,15 @@ ManagedBuffer Mixer::pull() {
     for (auto ch = channels; ch; ch = next) {
         next = ch->next; // save next in case the current channel gets deleted
         bool isSigned = ch->isSigned;
-        int vol = ch->volume;
+
+        // Volume ramps are not supported in legacy mode - just move to the final volume.
+        if (ch->rampSamples)
+        {
+            ch->volume = ch->rampTarget;
+            ch->rampSamples = 0;
+        }
+
+        int vol = min(ch->volume, MIXER_MAX_VOLUME);
         ManagedBuffer data = ch->stream->pull();
         if (sum.length() < data.length()) {
             ManagedBuffer newsum(data.length());
@@ -92,12 +211,166 @@ ManagedBuffer Mixer::pull() {
     auto len = sum.length() >> 1;
     while (len--)
         *s++ += 512;
-        
+
+    CODAL_STREAM_TRACE_BYTES(sum.length());
+
     return sum;
 }
 
+ManagedBuffer Mixer::pullAccumulated()
+{
+    int samples = channels ? 0 : MIXER_DEFAULT_BUFFER_SAMPLES;
+    MixerChannel *next;
+
+    if (accumulatorSize < samples)
+    {
+        accumulator = (int32_t *) realloc(accumulator, samples * sizeof(int32_t));
+        accumulatorSize = samples;
+    }
+
+    memset(accumulator, 0, samples * sizeof(int32_t));
+
+    for (auto ch = channels; ch; ch = next) {
+        next = ch->next; // save next in case the current channel gets deleted
+
+        int format = ch->stream->getFormat();
+        bool legacy = format == DATASTREAM_FORMAT_UNKNOWN;
+        ManagedBuffer data = ch->stream->pull();
+
+        if (legacy)
+            format = ch->isSigned ? DATASTREAM_FORMAT_16BIT_SIGNED : DATASTREAM_FORMAT_16BIT_UNSIGNED;
+
+        int len = data.length() / DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+        // Grow the accumulator if this channel provides more samples than we've seen so far.
+        if (len > samples)
+        {
+            if (len > accumulatorSize)
+            {
+                accumulator = (int32_t *) realloc(accumulator, len * sizeof(int32_t));
+                accumulatorSize = len;
+            }
+
+            memset(accumulator + samples, 0, (len - samples) * sizeof(int32_t));
+            samples = len;
+        }
+
+        // Determine how much of this buffer falls within a volume ramp, if any.
+        // Any samples beyond the end of the ramp are mixed at the target volume.
+        int rampLength = min(len, (int) ch->rampSamples);
+
+        if (rampLength)
+        {
+            ch->rampSamples -= rampLength;
+            if (ch->rampSamples == 0)
+                ch->volume = ch->rampTarget;
+        }
+
+        uint8_t *d = data.getBytes();
+        int volume = min(ch->volume, MIXER_MAX_VOLUME);
+
+        switch (format)
+        {
+            case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+                mixFormat<MixerReadU8>(accumulator, d, len, volume, rampLength, ch->rampGain, ch->rampStep);
+                break;
+
+            case DATASTREAM_FORMAT_8BIT_SIGNED:
+                mixFormat<MixerReadS8>(accumulator, d, len, volume, rampLength, ch->rampGain, ch->rampStep);
+                break;
+
+            case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+                if (legacy)
+                    mixFormat<MixerReadU10>(accumulator, d, len, volume, rampLength, ch->rampGain, ch->rampStep);
+                else
+                    mixFormat<MixerReadU16>(accumulator, d, len, volume, rampLength, ch->rampGain, ch->rampStep);
+                break;
+
+            case DATASTREAM_FORMAT_16BIT_SIGNED:
+                if (legacy)
+                    mixFormat<MixerReadS10>(accumulator, d, len, volume, rampLength, ch->rampGain, ch->rampStep);
+                else
+                    mixFormat<MixerReadS16>(accumulator, d, len, volume, rampLength, ch->rampGain, ch->rampStep);
+                break;
+
+            case DATASTREAM_FORMAT_32BIT_UNSIGNED:
+                mixFormat<MixerReadU32>(accumulator, d, len, volume, rampLength, ch->rampGain, ch->rampStep);
+                break;
+
+            case DATASTREAM_FORMAT_32BIT_SIGNED:
+                mixFormat<MixerReadS32>(accumulator, d, len, volume, rampLength, ch->rampGain, ch->rampStep);
+                break;
+
+            default:
+                // 24 bit streams are not supported by the mixer - skip the channel.
+                break;
+        }
+
+        if (ch->rampSamples)
+            ch->volume = ch->rampGain >> 16;
+    }
+
+    // Single saturation pass from the accumulator into the output format.
+    // Accumulated values are signed 16 bit samples, scaled by MIXER_UNITY_VOLUME >> MIXER_HEADROOM_BITS.
+    const int shift = 10 - MIXER_HEADROOM_BITS;
+    ManagedBuffer out(samples * DATASTREAM_FORMAT_BYTES_PER_SAMPLE(outputFormat));
+    int32_t *acc = accumulator;
+    int n = samples;
+
+    switch (outputFormat)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+        {
+            uint8_t *o = out.getBytes();
+            int bias = outputFormat == DATASTREAM_FORMAT_8BIT_UNSIGNED ? 128 : 0;
+            while (n--)
+            {
+                int v = *acc++ >> (shift + 8);
+                v = v < -128 ? -128 : v > 127 ? 127 : v;
+                *o++ = (uint8_t)(v + bias);
+            }
+            break;
+        }
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+        case DATASTREAM_FORMAT_16BIT_SIGNED:
+        {
+            uint16_t *o = (uint16_t *) out.getBytes();
+            int bias = outputFormat == DATASTREAM_FORMAT_16BIT_UNSIGNED ? 32768 : 0;
+            while (n--)
+            {
+                int v = *acc++ >> shift;
+                v = v < -32768 ? -32768 : v > 32767 ? 32767 : v;
+                *o++ = (uint16_t)(v + bias);
+            }
+            break;
+        }
+
+        case DATASTREAM_FORMAT_32BIT_UNSIGNED:
+        case DATASTREAM_FORMAT_32BIT_SIGNED:
+        {
+            uint32_t *o = (uint32_t *) out.getBytes();
+            uint32_t bias = outputFormat == DATASTREAM_FORMAT_32BIT_UNSIGNED ? 0x80000000 : 0;
+            while (n--)
+            {
+                int v = *acc++ >> shift;
+                v = v < -32768 ? -32768 : v > 32767 ? 32767 : v;
+                *o++ = ((uint32_t)v << 16) ^ bias;
+            }
+            break;
+        }
+    }
+
+    CODAL_STREAM_TRACE_BYTES(out.length());
+
+    return out;
+}
+
 int Mixer::pullRequest()
 {
+    CODAL_STREAM_TRACE_PULL_REQUEST();
+
     // we might call it too much if we have more than one channel, but we
     // assume the downStream is only going to call pull() as much as it needs
     // and not more
@@ -111,6 +384,21 @@ void Mixer::connect(DataSink &sink)
     this->downStream = &sink;
 }
 
+int Mixer::getFormat()
+{
+    return outputFormat;
+}
+
+int Mixer::setFormat(int format)
+{
+    if (format == DATASTREAM_FORMAT_24BIT_UNSIGNED || format == DATASTREAM_FORMAT_24BIT_SIGNED ||
+        format < DATASTREAM_FORMAT_UNKNOWN || format > DATASTREAM_FORMAT_32BIT_SIGNED)
+        return DEVICE_INVALID_PARAMETER;
+
+    outputFormat = format;
+    return DEVICE_OK;
+}
+
 bool Mixer::isConnected()
 {
     return this->downStream != NULL;
@@ -23,9 +23,28 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "SerialStreamer.h"
+#include "CodalFormat.h"
 
 using namespace codal;
 
+// CRC-16/CCITT-FALSE (polynomial 0x1021), processed a nibble at a time to keep the table small.
+static const uint16_t crc16Table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static uint16_t crc16(const uint8_t *data, int length, uint16_t crc)
+{
+    while (length--)
+    {
+        uint8_t b = *data++;
+        crc = (crc << 4) ^ crc16Table[(crc >> 12) ^ (b >> 4)];
+        crc = (crc << 4) ^ crc16Table[(crc >> 12) ^ (b & 0x0F)];
+    }
+
+    return crc;
+}
+
 /**
  * Creates a simple component that logs a stream of signed 16 bit data as signed 8-bit data over serial.
  * @param source a DataSource to measure the level of.
@@ -36,6 +55,8 @@ SerialStreamer::SerialStreamer(DataSource &source, int mode, Serial *output) : u
 {
     this->mode = mode;
     this->serial = output;
+    this->sequence = 0;
+    this->dropped = 0;
 
     // Register with our upstream component
     source.connect(*this);
@@ -76,6 +97,14 @@ int SerialStreamer::pullRequest()
     return DEVICE_OK;
 }
 
+/**
+ * Determines the number of buffers, frames or lines of text dropped because the serial port was in use by another fiber.
+ */
+uint32_t SerialStreamer::getDropCount()
+{
+    return dropped;
+}
+
 /**
     * returns the last buffer processed by this component
     */
@@ -93,71 +122,114 @@ void SerialStreamer::streamBuffer(ManagedBuffer buffer)
     if (serial == NULL)
         return;
 
-    int CRLF = 0;
     int bps = upstream.getFormat();
 
     // If a BINARY mode is requested, simply output all the bytes to the serial port.
-    if( mode == SERIAL_STREAM_MODE_BINARY )
-    {
-        uint8_t *p = &buffer[0];
-        uint8_t *end = p + buffer.length();
+    if( mode == SERIAL_STREAM_MODE_BINARY && buffer.length() > 0 && serial->send(buffer) == DEVICE_SERIAL_IN_USE )
+        dropped++;
 
-        while(p < end)
-            serial->putc(*p++);
-    }
+    if( mode == SERIAL_STREAM_MODE_FRAMED )
+        streamFrame(buffer, bps);
 
-    // if a HEX mode is requested, format using printf, framed by sample size..
     if( mode == SERIAL_STREAM_MODE_HEX || mode == SERIAL_STREAM_MODE_DECIMAL )
-    {
-        uint8_t *d = &buffer[0];
-        uint8_t *end = d+buffer.length();
-        uint32_t data;
+        streamText(buffer, bps);
+}
 
-        while(d < end)
-        {
-            data = *d++;
-
-            if (bps > DATASTREAM_FORMAT_8BIT_SIGNED)
-                data |= (*d++) << 8;
-            if (bps > DATASTREAM_FORMAT_16BIT_SIGNED)
-                data |= (*d++) << 16;
-            if (bps > DATASTREAM_FORMAT_24BIT_SIGNED)
-                data |= (*d++) << 24;
-
-            if (mode == SERIAL_STREAM_MODE_HEX) {
-                serial->printf("%x ", data);
-            } else {
-                // SERIAL_STREAM_MODE_DECIMAL
-                if (bps == DATASTREAM_FORMAT_8BIT_SIGNED) {
-                    serial->printf("%d ", (int8_t)(data & 0xFF));
-                } else if (bps == DATASTREAM_FORMAT_16BIT_SIGNED) {
-                    serial->printf("%d ", (int16_t)(data & 0xFFFF));
-                } else if (bps == DATASTREAM_FORMAT_24BIT_SIGNED) {
-                    // Move the sign bit to the most significant bit
-                    int32_t signed_data = data & 0x7FFFFF;
-                    if (data & (1 << 23)) {
-                        signed_data |= 1 << 31;
-                    }
-                    serial->printf("%d ", signed_data);
-                } else {
-                    // Cannot print uint32_t correctly as serial.printf
-                    // does not support "%u"
-                    serial->printf("%d ", data);
-                }
-            }
-
-            CRLF++;
-
-            if (CRLF >= 16){
-                serial->putc('\r');
-                serial->putc('\n');
-                CRLF = 0;
-            }
+/**
+ * Sends a buffer as a single frame, in SERIAL_STREAM_MODE_FRAMED.
+ */
+void SerialStreamer::streamFrame(ManagedBuffer buffer, int format)
+{
+    ManagedBuffer frame[2] = { ManagedBuffer(SERIAL_STREAM_FRAME_HEADER_SIZE), buffer };
+    uint8_t *header = frame[0].getBytes();
+    uint32_t sampleRate = (uint32_t) (upstream.getSampleRate() + 0.5f);
+    int length = buffer.length();
+
+    header[0] = SERIAL_STREAM_FRAME_SYNC & 0xFF;
+    header[1] = SERIAL_STREAM_FRAME_SYNC >> 8;
+    header[2] = format;
+    header[3] = SERIAL_STREAM_FRAME_VERSION;
+    header[4] = sampleRate;
+    header[5] = sampleRate >> 8;
+    header[6] = sampleRate >> 16;
+    header[7] = sampleRate >> 24;
+    header[8] = sequence;
+    header[9] = sequence >> 8;
+    header[10] = length;
+    header[11] = length >> 8;
+
+    uint16_t crc = crc16(header, 12, 0xFFFF);
+    crc = crc16(buffer.getBytes(), length, crc);
+
+    header[12] = crc;
+    header[13] = crc >> 8;
+
+    // The sequence number moves on even if the frame is dropped, so the receiver can see the gap.
+    sequence++;
+
+    // Send the header and payload as one transmission, so another fiber can't write between them.
+    if (serial->send(frame, 2) == DEVICE_SERIAL_IN_USE)
+        dropped++;
+}
+
+/**
+ * Sends a buffer as lines of text, in SERIAL_STREAM_MODE_DECIMAL or SERIAL_STREAM_MODE_HEX.
+ * Each line is formatted into a local buffer and sent in one call, rather than formatting each sample with printf.
+ */
+void SerialStreamer::streamText(ManagedBuffer buffer, int bps)
+{
+    // Up to 11 characters and a space for each sample, followed by CRLF.
+    char line[SERIAL_STREAM_SAMPLES_PER_LINE * 12 + 2];
+    char *p = line;
+    int samples = 0;
+
+    uint8_t *d = &buffer[0];
+    uint8_t *end = d+buffer.length();
+    uint32_t data;
+
+    while(d < end)
+    {
+        data = *d++;
+
+        if (bps > DATASTREAM_FORMAT_8BIT_SIGNED)
+            data |= (*d++) << 8;
+        if (bps > DATASTREAM_FORMAT_16BIT_SIGNED)
+            data |= (*d++) << 16;
+        if (bps > DATASTREAM_FORMAT_24BIT_SIGNED)
+            data |= (*d++) << 24;
+
+        if (mode == SERIAL_STREAM_MODE_HEX) {
+            p += format_hex(p, data);
+        } else {
+            // SERIAL_STREAM_MODE_DECIMAL. Sign extend signed formats.
+            int32_t value = (int32_t) data;
+
+            if (bps == DATASTREAM_FORMAT_8BIT_SIGNED)
+                value = (int8_t)(data & 0xFF);
+            else if (bps == DATASTREAM_FORMAT_16BIT_SIGNED)
+                value = (int16_t)(data & 0xFFFF);
+            else if (bps == DATASTREAM_FORMAT_24BIT_SIGNED)
+                value = ((int32_t)(data << 8)) >> 8;
+
+            if (bps == DATASTREAM_FORMAT_32BIT_UNSIGNED)
+                p += format_unsigned(p, data);
+            else
+                p += format_decimal(p, value);
         }
 
-        if (CRLF > 0) {
-            serial->putc( '\r' );
-            serial->putc( '\n' );
+        *p++ = ' ';
+
+        samples++;
+
+        if (samples >= SERIAL_STREAM_SAMPLES_PER_LINE || d >= end){
+            *p++ = '\r';
+            *p++ = '\n';
+
+            if (serial->send((uint8_t *)line, p - line) == DEVICE_SERIAL_IN_USE)
+                dropped++;
+
+            p = line;
+            samples = 0;
         }
     }
 }
@@ -0,0 +1,496 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "CodalCompat.h"
+#include "SpectrumAnalyzer.h"
+#include "StreamNormalizer.h"
+#include "Event.h"
+#include "ErrorNo.h"
+#include "CodalDmesg.h"
+
+using namespace codal;
+
+/**
+ * In place, scaled, radix-2 decimation in time FFT of n complex values (interleaved real, imaginary).
+ * Each stage halves its output to avoid overflow, so the result is scaled by 1/n.
+ *
+ * @param z The data to transform.
+ * @param n The number of complex values (a power of two).
+ * @param tw Interleaved twiddle factors W_N^k for k = 0..N/2-1, where N = 2n.
+ */
+static void spectrum_fft(int16_t *z, int n, const int16_t *tw)
+{
+    // Bit reversal permutation.
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if (i < j)
+        {
+            int16_t t;
+            t = z[2*i]; z[2*i] = z[2*j]; z[2*j] = t;
+            t = z[2*i+1]; z[2*i+1] = z[2*j+1]; z[2*j+1] = t;
+        }
+    }
+
+    // Butterflies. The twiddle factor for position k of a block of a given size is W_size^k = W_N^(k*2n/size).
+    for (int size = 2; size <= n; size <<= 1)
+    {
+        int half = size >> 1;
+        int step = 2 * (2 * n / size);
+
+        for (int k = 0; k < half; k++)
+        {
+            int wr = tw[k * step];
+            int wi = tw[k * step + 1];
+
+            for (int start = k; start < n; start += size)
+            {
+                int16_t *a = &z[2 * start];
+                int16_t *b = &z[2 * (start + half)];
+
+                int tr = (b[0] * wr - b[1] * wi) >> 15;
+                int ti = (b[0] * wi + b[1] * wr) >> 15;
+                int ar = a[0];
+                int ai = a[1];
+
+                a[0] = (ar + tr) >> 1;
+                a[1] = (ai + ti) >> 1;
+                b[0] = (ar - tr) >> 1;
+                b[1] = (ai - ti) >> 1;
+            }
+        }
+    }
+}
+
+/**
+  * Creates a component that calculates the frequency spectrum of a stream.
+  *
+  * @param source a DataSource to analyze.
+  * @param fftSize The number of samples per frame. Must be a power of two between SPECTRUM_ANALYZER_MIN_FFT_SIZE and SPECTRUM_ANALYZER_MAX_FFT_SIZE.
+  * @param bands The number of logarithmically spaced frequency bands to report.
+  * @param id The id to use for the message bus when transmitting events.
+  */
+SpectrumAnalyzer::SpectrumAnalyzer(DataSource &source, int fftSize, int bands, uint16_t id) : upstream(source)
+{
+    this->id = id;
+    this->frame = NULL;
+    this->work = NULL;
+    this->twiddles = NULL;
+    this->window = NULL;
+    this->power = NULL;
+    this->fftSize = 0;
+    this->bands = 0;
+    this->bandState = 0;
+    this->frames = 0;
+
+    memset(bandThreshold, 0, sizeof(bandThreshold));
+    memset(bandEnergy, 0, sizeof(bandEnergy));
+
+    setFFTSize(fftSize);
+    setBands(bands);
+
+    source.connect(*this);
+    source.dataWanted(DATASTREAM_WANTED);
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int SpectrumAnalyzer::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    if (frame == NULL)
+        return DEVICE_OK;
+
+    int format = upstream.getFormat();
+    if (format == DATASTREAM_FORMAT_UNKNOWN)
+        format = DATASTREAM_FORMAT_16BIT_SIGNED;
+
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int samples = b.length() / bytesPerSample;
+    uint8_t *data = b.getBytes();
+    SampleReadFn readSample = StreamNormalizer::readSample[format];
+
+    // Determine how to bring each sample into a signed 16 bit range.
+    int bias = 0;
+    int shift = 0;
+
+    switch (format)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED: bias = 128; shift = -8; break;
+        case DATASTREAM_FORMAT_8BIT_SIGNED: shift = -8; break;
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED: bias = 32768; break;
+        case DATASTREAM_FORMAT_24BIT_UNSIGNED: bias = 1 << 23; shift = 8; break;
+        case DATASTREAM_FORMAT_24BIT_SIGNED: shift = 8; break;
+        case DATASTREAM_FORMAT_32BIT_UNSIGNED:
+        case DATASTREAM_FORMAT_32BIT_SIGNED: shift = 16; break;
+    }
+
+    while (samples--)
+    {
+        int s = readSample(data);
+        data += bytesPerSample;
+
+        if (format == DATASTREAM_FORMAT_32BIT_UNSIGNED)
+            s = (int)((uint32_t)s ^ 0x80000000);
+        else
+            s -= bias;
+
+        frame[fill++] = shift < 0 ? s << -shift : s >> shift;
+
+        if (fill == fftSize)
+        {
+            processFrame();
+
+            // Retain the overlapping portion of the frame for the next one.
+            memmove(frame, frame + hopSize, (fftSize - hopSize) * sizeof(int16_t));
+            fill = fftSize - hopSize;
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Calculates the spectrum of the current frame, and raises any events.
+ */
+void SpectrumAnalyzer::processFrame()
+{
+    int n = fftSize / 2;
+    int16_t *z = work;
+
+    // Apply the window, and pack the real input into n complex values (even samples real, odd samples imaginary).
+    for (int i = 0; i < n; i++)
+    {
+        z[i] = (frame[i] * window[i]) >> 15;
+        z[fftSize - 1 - i] = (frame[fftSize - 1 - i] * window[i]) >> 15;
+    }
+
+    spectrum_fft(z, n, twiddles);
+
+    // Separate the spectrum of the real input from the packed complex result, and take the power of each bin.
+    // X[k] = Fe[k] + W_N^k * Fo[k], where Fe and Fo are the transforms of the even and odd samples.
+    uint32_t maxPower = 0;
+    dominantBin = 0;
+
+    for (int k = 0; k < n; k++)
+    {
+        int c = (n - k) & (n - 1);
+        int zr = z[2*k], zi = z[2*k+1];
+        int cr = z[2*c], ci = z[2*c+1];
+
+        int fer = (zr + cr) >> 1;
+        int fei = (zi - ci) >> 1;
+        int for_ = (zi + ci) >> 1;
+        int foi = (cr - zr) >> 1;
+
+        int wr = twiddles[2*k];
+        int wi = twiddles[2*k+1];
+
+        int xr = fer + ((for_ * wr - foi * wi) >> 15);
+        int xi = fei + ((for_ * wi + foi * wr) >> 15);
+
+        // |xr| and |xi| can exceed 16 bits, so square in 64 bits and saturate into the power array.
+        int64_t p64 = (int64_t)xr * xr + (int64_t)xi * xi;
+        uint32_t p = p64 > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)p64;
+        power[k] = p;
+
+        if (k > 0 && p > maxPower)
+        {
+            maxPower = p;
+            dominantBin = k;
+        }
+    }
+
+    // Calculate band energies, and raise events for any that have crossed their threshold.
+    for (int band = 0; band < bands; band++)
+    {
+        uint64_t sum = 0;
+        for (int k = bandEdges[band]; k < bandEdges[band + 1]; k++)
+            sum += power[k];
+
+        uint32_t energy = (uint32_t)(sum / (bandEdges[band + 1] - bandEdges[band]));
+        uint16_t mask = 1 << band;
+
+        bandEnergy[band] = energy;
+
+        if (bandThreshold[band])
+        {
+            if (!(bandState & mask) && energy > bandThreshold[band])
+            {
+                bandState |= mask;
+                Event(id, SPECTRUM_ANALYZER_EVT_BAND_HIGH(band));
+            }
+            else if ((bandState & mask) && energy < bandThreshold[band])
+            {
+                bandState &= ~mask;
+                Event(id, SPECTRUM_ANALYZER_EVT_BAND_LOW(band));
+            }
+        }
+    }
+
+    frames++;
+    Event(id, SPECTRUM_ANALYZER_EVT_FRAME);
+}
+
+/**
+ * Defines the frame size, and reallocates the FFT tables.
+ *
+ * @param fftSize The number of samples per frame. Must be a power of two between SPECTRUM_ANALYZER_MIN_FFT_SIZE and SPECTRUM_ANALYZER_MAX_FFT_SIZE.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the size is not supported, or DEVICE_NO_RESOURCES.
+ */
+int SpectrumAnalyzer::setFFTSize(int fftSize)
+{
+    if (fftSize < SPECTRUM_ANALYZER_MIN_FFT_SIZE || fftSize > SPECTRUM_ANALYZER_MAX_FFT_SIZE || (fftSize & (fftSize - 1)))
+        return DEVICE_INVALID_PARAMETER;
+
+    if (fftSize == this->fftSize)
+        return DEVICE_OK;
+
+    releaseTables();
+
+    int n = fftSize / 2;
+
+    frame = (int16_t *) malloc(fftSize * sizeof(int16_t));
+    work = (int16_t *) malloc(fftSize * sizeof(int16_t));
+    twiddles = (int16_t *) malloc(fftSize * sizeof(int16_t));
+    window = (int16_t *) malloc(n * sizeof(int16_t));
+    power = (uint32_t *) malloc(n * sizeof(uint32_t));
+
+    if (!frame || !work || !twiddles || !window || !power)
+    {
+        releaseTables();
+        return DEVICE_NO_RESOURCES;
+    }
+
+    // Precompute the twiddle factors W_N^k = cos(2.pi.k/N) - j.sin(2.pi.k/N), and the Hann window.
+    for (int k = 0; k < n; k++)
+    {
+        float a = 2.0f * (float)PI * (float)k / (float)fftSize;
+        twiddles[2*k] = (int16_t)(cosf(a) * 32767.0f);
+        twiddles[2*k+1] = (int16_t)(-sinf(a) * 32767.0f);
+        window[k] = (int16_t)((0.5f - 0.5f * cosf(2.0f * (float)PI * (float)k / (float)(fftSize - 1))) * 32767.0f);
+    }
+
+    memset(power, 0, n * sizeof(uint32_t));
+
+    this->fftSize = fftSize;
+    this->hopSize = n;
+    this->fill = 0;
+    this->dominantBin = 0;
+
+    // Recalculate the band layout for the new number of bins.
+    if (bands)
+        setBands(bands);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the frame size currently in use.
+ * @return the number of samples per frame.
+ */
+int SpectrumAnalyzer::getFFTSize()
+{
+    return fftSize;
+}
+
+/**
+ * Defines the number of new samples consumed between consecutive frames.
+ * A value of half the FFT size (the default) gives 50% overlap.
+ *
+ * @param hop The number of samples, in the range 1..fftSize.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SpectrumAnalyzer::setHopSize(int hop)
+{
+    if (hop < 1 || hop > fftSize)
+        return DEVICE_INVALID_PARAMETER;
+
+    hopSize = hop;
+    fill = min(fill, fftSize - hopSize);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the number of logarithmically spaced bands into which the spectrum is divided.
+ *
+ * @param bands The number of bands, in the range 1..SPECTRUM_ANALYZER_MAX_BANDS. This is limited to the number of available bins.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SpectrumAnalyzer::setBands(int bands)
+{
+    int n = fftSize / 2;
+
+    if (bands < 1 || bands > SPECTRUM_ANALYZER_MAX_BANDS)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Each band needs at least one bin, excluding DC.
+    bands = min(bands, n - 1);
+    if (bands < 1)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Space the bands logarithmically between bin 1 and the Nyquist frequency.
+    bandEdges[0] = 1;
+    for (int b = 1; b < bands; b++)
+    {
+        int edge = (int)(powf((float)n, (float)b / (float)bands) + 0.5f);
+        edge = max(edge, bandEdges[b-1] + 1);
+        edge = min(edge, n - (bands - b));
+        bandEdges[b] = edge;
+    }
+    bandEdges[bands] = n;
+
+    this->bands = bands;
+    this->bandState = 0;
+    memset(bandEnergy, 0, sizeof(bandEnergy));
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of bands in use.
+ * @return the number of bands.
+ */
+int SpectrumAnalyzer::getBands()
+{
+    return bands;
+}
+
+/**
+ * Defines the energy threshold of a band. SPECTRUM_ANALYZER_EVT_BAND_HIGH and SPECTRUM_ANALYZER_EVT_BAND_LOW
+ * events are raised when the band's energy crosses this value. A threshold of zero disables events for the band.
+ *
+ * @param band The band to configure.
+ * @param threshold The energy threshold, in the same units as getBandEnergy().
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SpectrumAnalyzer::setBandThreshold(int band, uint32_t threshold)
+{
+    if (band < 0 || band >= SPECTRUM_ANALYZER_MAX_BANDS)
+        return DEVICE_INVALID_PARAMETER;
+
+    bandThreshold[band] = threshold;
+    bandState &= ~(1 << band);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the energy of a band in the most recent frame.
+ *
+ * @param band The band to query.
+ * @return The mean power per bin of the band, or 0 if the band is invalid.
+ */
+uint32_t SpectrumAnalyzer::getBandEnergy(int band)
+{
+    if (band < 0 || band >= bands)
+        return 0;
+
+    return bandEnergy[band];
+}
+
+/**
+ * Determines the frequency range covered by a band.
+ *
+ * @param band The band to query.
+ * @param low Set to the lowest frequency in the band, in Hz.
+ * @param high Set to the highest frequency in the band, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SpectrumAnalyzer::getBandFrequencies(int band, float &low, float &high)
+{
+    if (band < 0 || band >= bands)
+        return DEVICE_INVALID_PARAMETER;
+
+    float binWidth = upstream.getSampleRate() / (float) fftSize;
+
+    low = bandEdges[band] * binWidth;
+    high = bandEdges[band + 1] * binWidth;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the frequency with the highest power in the most recent frame (excluding DC).
+ * @return The centre frequency of the dominant bin, in Hz.
+ */
+float SpectrumAnalyzer::getDominantFrequency()
+{
+    return (float) dominantBin * upstream.getSampleRate() / (float) fftSize;
+}
+
+/**
+ * Provides the power of each frequency bin in the most recent frame.
+ * Bin k covers the frequency k * sampleRate / fftSize.
+ *
+ * @return A pointer to fftSize / 2 power values, valid until the next frame is processed.
+ */
+const uint32_t *SpectrumAnalyzer::getPowerSpectrum()
+{
+    return power;
+}
+
+/**
+ * Determines the number of frames processed since creation.
+ * @return the number of frames.
+ */
+uint32_t SpectrumAnalyzer::getFrameCount()
+{
+    return frames;
+}
+
+/**
+ * Releases the memory held by the FFT tables.
+ */
+void SpectrumAnalyzer::releaseTables()
+{
+    free(frame);
+    free(work);
+    free(twiddles);
+    free(window);
+    free(power);
+
+    frame = NULL;
+    work = NULL;
+    twiddles = NULL;
+    window = NULL;
+    power = NULL;
+    fftSize = 0;
+}
+
+/**
+ * Destructor.
+ */
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+    releaseTables();
+}
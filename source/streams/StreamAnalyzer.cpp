@@ -8,8 +8,103 @@
 
 using namespace codal;
 
+// Sample readers for each supported format. 32 bit samples are reduced to 24 bits, so that every format
+// can be quantized exactly using a 64 bit reciprocal multiply.
+struct AnalyzerReadU8  { static inline int read(const uint8_t *p) { return *p; } };
+struct AnalyzerReadS8  { static inline int read(const uint8_t *p) { return *(const int8_t *)p; } };
+struct AnalyzerReadU16 { static inline int read(const uint8_t *p) { return *(const uint16_t *)p; } };
+struct AnalyzerReadS16 { static inline int read(const uint8_t *p) { return *(const int16_t *)p; } };
+struct AnalyzerReadU24 { static inline int read(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16); } };
+struct AnalyzerReadS24 { static inline int read(const uint8_t *p) { return ((int32_t)((p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24))) >> 8; } };
+struct AnalyzerReadU32 { static inline int read(const uint8_t *p) { return (int)(*(const uint32_t *)p >> 8); } };
+struct AnalyzerReadS32 { static inline int read(const uint8_t *p) { return *(const int32_t *)p >> 8; } };
+
+#define STREAM_ANALYZER_RECIPROCAL_BITS     48
+
+/**
+ * Parameters of a single histogram pass, derived once per buffer.
+ */
+struct AnalyzerPass
+{
+    int         mask;           // Value and'ed with each sample.
+    int         offset;         // Offset added to each sample to make it unsigned.
+    int         range;          // The range of the (offset) samples.
+    int         shift;          // Right shift that quantizes a sample, if the range and levels are both powers of two, or -1.
+    uint64_t    reciprocal;     // levels / range, in 16.48 fixed point (rounded up), when shift is -1.
+    uint32_t    *histogram;     // The histogram to update.
+    int         minimum;
+    int         maximum;
+    int64_t     sum;
+};
+
+/**
+ * Adds a buffer of samples in the format read by R to the histogram, optionally gathering statistics.
+ * Quantization uses either a shift or an exact reciprocal multiply, so there are no divisions in the loop.
+ */
+template <class R, int STEP, bool SHIFT, bool STATS>
+static void analyze(const uint8_t *p, int samples, AnalyzerPass &a)
+{
+    int mn = a.minimum;
+    int mx = a.maximum;
+    int64_t sum = a.sum;
+
+    while (samples--)
+    {
+        int v = R::read(p) & a.mask;
+        p += STEP;
+
+        if (STATS)
+        {
+            mn = v < mn ? v : mn;
+            mx = v > mx ? v : mx;
+            sum += v;
+        }
+
+        // Clamp into the configured range, to protect the histogram from out of range samples.
+        int s = v + a.offset;
+        s = s < 0 ? 0 : s;
+        s = s > a.range ? a.range : s;
+
+        if (SHIFT)
+            a.histogram[s >> a.shift]++;
+        else
+            a.histogram[((uint64_t)s * a.reciprocal) >> STREAM_ANALYZER_RECIPROCAL_BITS]++;
+    }
+
+    a.minimum = mn;
+    a.maximum = mx;
+    a.sum = sum;
+}
+
+template <class R, int STEP>
+static void analyzeFormat(const uint8_t *p, int samples, AnalyzerPass &a, bool stats)
+{
+    if (a.shift >= 0)
+        stats ? analyze<R, STEP, true, true>(p, samples, a) : analyze<R, STEP, true, false>(p, samples, a);
+    else
+        stats ? analyze<R, STEP, false, true>(p, samples, a) : analyze<R, STEP, false, false>(p, samples, a);
+}
+
+/**
+ * Determines the offset used to make samples of the given format unsigned, and the full range of the resulting values.
+ * 32 bit formats are analyzed at 24 bit precision.
+ */
+static void formatRange(int format, int &offset, int &range, int &scale)
+{
+    int bits = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format) * 8;
+    bool isSigned = (format & 1) == 0;
+
+    scale = bits > 24 ? 8 : 0;
+    bits = min(bits, 24);
+
+    range = 1 << bits;
+    offset = isSigned ? range >> 1 : 0;
+}
+
 StreamAnalyzer::StreamAnalyzer(DataSource &source) : DataSourceSink( source )
 {   
+    this->sampleRange = 0;
+    this->statisticsEnabled = false;
     this->setQuantization(CONFIG_STREAM_ANALYZER_DEFAULT_QUANTIZATION);
     this->setAndMask(0);
     this->pullRequests = 0;
@@ -34,56 +129,51 @@ int StreamAnalyzer::pullRequest()
 
         //DMESG("buffer: %p", buffer.getBytes());
 
-        // Update our recorded data.
-        if (upStream.getFormat() == DATASTREAM_FORMAT_8BIT_UNSIGNED)
-        {
-            for (int i=0; i<buffer.length(); i++)
-            {
-                int s = ((int)buffer[i]);
-                s &= mask;
-                s = s * quantizationLevels / sampleRange;
-                uint32_t *value = (uint32_t *) &quantizationData[s*4];
-                (*value)++;
-            }
-        }
+        int format = upStream.getFormat();
 
-        if (upStream.getFormat() == DATASTREAM_FORMAT_8BIT_SIGNED)
+        if (format != DATASTREAM_FORMAT_UNKNOWN)
         {
-            for (int i=0; i<buffer.length(); i++)
-            {
-                int s = ((int) ((int8_t)buffer[i]));
-                s &= mask;
-                s = s + 128;
-                s = s * quantizationLevels / sampleRange;
+            AnalyzerPass a;
+            int scale;
+            int samples = buffer.length() / DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+            uint8_t *data = buffer.getBytes();
 
-                uint32_t *value = (uint32_t *) &quantizationData[s*4];
-                (*value)++;
-            }
-        }
+            formatRange(format, a.offset, a.range, scale);
 
-        if (upStream.getFormat() == DATASTREAM_FORMAT_16BIT_UNSIGNED)
-        {
-            for (int i=0; i<buffer.length(); i+=2)
-            {
-                int s = (int)(*((uint16_t*) &buffer[i]));
-                s &= mask;
-                s = s * quantizationLevels / sampleRange;
-                uint32_t *value = (uint32_t *) &quantizationData[s*4];
-                (*value)++;
-            }
-        }
+            // Use the configured range if there is one (scaled as the samples are, for 32 bit data).
+            if (sampleRange > 0)
+                a.range = max(sampleRange >> scale, 1);
 
-        if (upStream.getFormat() == DATASTREAM_FORMAT_16BIT_SIGNED)
-        {
-            for (int i=0; i<buffer.length(); i+=2)
+            a.mask = mask;
+            a.histogram = (uint32_t *) quantizationData.getBytes();
+            a.minimum = minimum;
+            a.maximum = maximum;
+            a.sum = sum;
+
+            // Quantize with a shift if both the range and number of levels are powers of two, otherwise with a reciprocal.
+            a.shift = -1;
+            if ((a.range & (a.range - 1)) == 0 && (quantizationLevels & (quantizationLevels - 1)) == 0 && a.range >= quantizationLevels)
+                a.shift = __builtin_ctz(a.range) - __builtin_ctz(quantizationLevels);
+
+            uint64_t r = (uint64_t)quantizationLevels << STREAM_ANALYZER_RECIPROCAL_BITS;
+            a.reciprocal = r / a.range + (r % a.range ? 1 : 0);
+
+            switch (format)
             {
-                int s = ((int) ((int16_t)buffer[i]));
-                s &= mask;
-                s = s + 32768;
-                s = s * quantizationLevels / sampleRange;
-                uint32_t *value = (uint32_t *) &quantizationData[s*4];
-                (*value)++;
+                case DATASTREAM_FORMAT_8BIT_UNSIGNED:   analyzeFormat<AnalyzerReadU8, 1>(data, samples, a, statisticsEnabled); break;
+                case DATASTREAM_FORMAT_8BIT_SIGNED:     analyzeFormat<AnalyzerReadS8, 1>(data, samples, a, statisticsEnabled); break;
+                case DATASTREAM_FORMAT_16BIT_UNSIGNED:  analyzeFormat<AnalyzerReadU16, 2>(data, samples, a, statisticsEnabled); break;
+                case DATASTREAM_FORMAT_16BIT_SIGNED:    analyzeFormat<AnalyzerReadS16, 2>(data, samples, a, statisticsEnabled); break;
+                case DATASTREAM_FORMAT_24BIT_UNSIGNED:  analyzeFormat<AnalyzerReadU24, 3>(data, samples, a, statisticsEnabled); break;
+                case DATASTREAM_FORMAT_24BIT_SIGNED:    analyzeFormat<AnalyzerReadS24, 3>(data, samples, a, statisticsEnabled); break;
+                case DATASTREAM_FORMAT_32BIT_UNSIGNED:  analyzeFormat<AnalyzerReadU32, 4>(data, samples, a, statisticsEnabled); break;
+                case DATASTREAM_FORMAT_32BIT_SIGNED:    analyzeFormat<AnalyzerReadS32, 4>(data, samples, a, statisticsEnabled); break;
             }
+
+            minimum = a.minimum;
+            maximum = a.maximum;
+            sum = a.sum;
+            count += samples;
         }
 
         if (downStream)
@@ -99,6 +189,10 @@ int StreamAnalyzer::pullRequest()
 void StreamAnalyzer::reset()
 {
     quantizationData.fill(0);
+    minimum = INT32_MAX;
+    maximum = INT32_MIN;
+    sum = 0;
+    count = 0;
 }
 
 /**
@@ -124,7 +218,7 @@ int StreamAnalyzer::getQuantization()
  */
 int StreamAnalyzer::setQuantization(int quantization)
 {
-    if (quantization <= 0)
+    if (quantization <= 0 || quantization > 0x7FFF)
         return DEVICE_INVALID_PARAMETER;
 
     quantizationLevels = quantization;
@@ -133,6 +227,7 @@ int StreamAnalyzer::setQuantization(int quantization)
     // We add one here as the fast-path maths can be inclusive when presented with a 
     // maximum sample. It's easier to accomdate it than to remove it.
     quantizationData = ManagedBuffer((1+quantizationLevels)*4);
+    reset();
 
     DMESG("Quantizations levels to: %d", quantizationLevels);
 
@@ -150,7 +245,8 @@ int StreamAnalyzer::getRange()
 
 /**
  * Defines the sample range used by this analyzer.
- * @param range A positive integer value defining the maximum allowable value.
+ * @param range A positive integer value defining the maximum allowable value, or zero (the default) to use
+ * the full range of the upstream format.
  */
 void StreamAnalyzer::setRange(int range)
 {
@@ -158,6 +254,98 @@ void StreamAnalyzer::setRange(int range)
     DMESG("SampleRange set to: %d", sampleRange);
 }
 
+/**
+ * Enables or disables the calculation of minimum, maximum and mean sample values.
+ * These are gathered in the same pass as the histogram.
+ *
+ * @param enable true to gather statistics, false otherwise.
+ */
+void StreamAnalyzer::enableStatistics(bool enable)
+{
+    statisticsEnabled = enable;
+}
+
+/**
+ * Determines the lowest sample value seen since the last reset. Requires statistics to be enabled.
+ * @return the lowest sample value, in the representation of the upstream format.
+ */
+int StreamAnalyzer::getMinimum()
+{
+    int offset, range, scale;
+    formatRange(upStream.getFormat(), offset, range, scale);
+
+    return count ? minimum * (1 << scale) : 0;
+}
+
+/**
+ * Determines the highest sample value seen since the last reset. Requires statistics to be enabled.
+ * @return the highest sample value, in the representation of the upstream format.
+ */
+int StreamAnalyzer::getMaximum()
+{
+    int offset, range, scale;
+    formatRange(upStream.getFormat(), offset, range, scale);
+
+    return count ? maximum * (1 << scale) : 0;
+}
+
+/**
+ * Determines the mean sample value seen since the last reset. Requires statistics to be enabled.
+ * @return the mean sample value, in the representation of the upstream format.
+ */
+int StreamAnalyzer::getMean()
+{
+    int offset, range, scale;
+    formatRange(upStream.getFormat(), offset, range, scale);
+
+    return count ? (int)(sum / count) * (1 << scale) : 0;
+}
+
+/**
+ * Determines the number of samples analyzed since the last reset.
+ * @return the number of samples.
+ */
+uint32_t StreamAnalyzer::getSampleCount()
+{
+    return count;
+}
+
+/**
+ * Estimates a percentile of the samples seen since the last reset, from the histogram.
+ *
+ * @param percentile The percentile to calculate, in the range 0..100.
+ * @return The lower bound of the histogram level containing the requested percentile, in the representation
+ * of the upstream format, or DEVICE_INVALID_PARAMETER.
+ */
+int StreamAnalyzer::getPercentile(int percentile)
+{
+    if (percentile < 0 || percentile > 100)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (count == 0)
+        return 0;
+
+    int offset, range, scale;
+    formatRange(upStream.getFormat(), offset, range, scale);
+
+    if (sampleRange > 0)
+        range = max(sampleRange >> scale, 1);
+
+    uint32_t *histogram = (uint32_t *) quantizationData.getBytes();
+    uint64_t target = ((uint64_t)count * percentile + 99) / 100;
+    uint64_t total = 0;
+    int level = 0;
+
+    for (level = 0; level < quantizationLevels; level++)
+    {
+        total += histogram[level];
+        if (total >= target && total > 0)
+            break;
+    }
+
+    return (int)(((int64_t)level * range / quantizationLevels - offset) * (1 << scale));
+}
+
 /** 
  * Defines a value that is and'ed with each sample before analysis
  * Useful to mask off unwanted bit in the sample data.
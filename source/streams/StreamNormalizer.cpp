@@ -127,6 +127,7 @@ SampleWriteFn StreamNormalizer::writeSample[] = {write_sample_1, write_sample_1,
  */
 StreamNormalizer::StreamNormalizer(DataSource &source, float gain, bool normalize, int format, int stabilisation) : DataSourceSink(source), output(*this)
 {
+    CODAL_STREAM_TRACE_INIT("StreamNormalizer");
     setFormat(format);
     setGain(gain);
     setNormalize(normalize);
@@ -142,6 +143,8 @@ StreamNormalizer::StreamNormalizer(DataSource &source, float gain, bool normaliz
  */
 ManagedBuffer StreamNormalizer::pull()
 {
+    CODAL_STREAM_TRACE_PULL();
+
     int samples;                // Number of samples in the input buffer.
     int s;                      // The sample being processed, encpasulated inside a 32 bit number.
     uint8_t *data;              // Input buffer read pointer.
@@ -169,7 +172,8 @@ ManagedBuffer StreamNormalizer::pull()
     samples = inputBuffer.length() / bytesPerSampleIn;
 
     // Use in place processing where possible, but allocate a new buffer when needed.
-    if (DATASTREAM_FORMAT_BYTES_PER_SAMPLE(inputFormat) == DATASTREAM_FORMAT_BYTES_PER_SAMPLE(outputFormat))
+    // Buffers shared with other components (e.g. by a StreamSplitter) are never modified in place.
+    if (DATASTREAM_FORMAT_BYTES_PER_SAMPLE(inputFormat) == DATASTREAM_FORMAT_BYTES_PER_SAMPLE(outputFormat) && !inputBuffer.isShared())
         buffer = inputBuffer;
     else
         buffer = ManagedBuffer(samples * bytesPerSampleOut);
@@ -215,6 +219,7 @@ ManagedBuffer StreamNormalizer::pull()
 
     // Ensure output buffer is the correct size;
     buffer.truncate(samples * bytesPerSampleOut);
+    CODAL_STREAM_TRACE_BYTES(buffer.length());
 
     return buffer;
 }
@@ -224,6 +229,8 @@ ManagedBuffer StreamNormalizer::pull()
  */
 int StreamNormalizer::pullRequest()
 {
+    CODAL_STREAM_TRACE_PULL_REQUEST();
+
     return output.pullRequest();
 }
 
@@ -0,0 +1,303 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "CodalCompat.h"
+#include "StreamResampler.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "CodalDmesg.h"
+
+using namespace codal;
+
+// The range of sample values that can be written in each format, as read by StreamNormalizer::readSample.
+static const int32_t resamplerMinimum[] = {0, 0, -128, 0, -32768, 0, -8388608, INT32_MIN, INT32_MIN};
+static const int32_t resamplerMaximum[] = {0, 255, 127, 65535, 32767, 16777215, 8388607, INT32_MAX, INT32_MAX};
+
+/**
+ * Computes the FIR dot product of a phase's coefficients with the sample history, saturated to the given range.
+ * ACC is the accumulator type: 32 bit is sufficient for samples of up to 16 bits, 64 bit is used for wider samples.
+ */
+template <typename ACC>
+static inline int resampler_dot(const int16_t *c, const int32_t *h, int n, int32_t minimum, int32_t maximum)
+{
+    ACC acc = 0;
+
+    while (n >= 4)
+    {
+        acc += (ACC)c[0] * h[0];
+        acc += (ACC)c[1] * h[1];
+        acc += (ACC)c[2] * h[2];
+        acc += (ACC)c[3] * h[3];
+        c += 4;
+        h += 4;
+        n -= 4;
+    }
+
+    while (n--)
+        acc += (ACC)*c++ * *h++;
+
+    acc = (acc + (1 << (RESAMPLER_COEFFICIENT_BITS - 1))) >> RESAMPLER_COEFFICIENT_BITS;
+
+    // The filter overshoots on sharp transients, which would otherwise wrap around when written.
+    if (acc < minimum)
+        return minimum;
+
+    if (acc > maximum)
+        return maximum;
+
+    return (int)acc;
+}
+
+/**
+ * Resamples a buffer, returning the number of output samples written.
+ */
+template <typename ACC>
+static int resampler_process(uint8_t *in, int samples, int bytesPerSample, uint8_t *out, int format, const int16_t *coefficients,
+                             int32_t *history, int &historyPosition, int &phase, int taps, int interpolation, int decimation)
+{
+    SampleReadFn readSample = StreamNormalizer::readSample[format];
+    SampleWriteFn writeSample = StreamNormalizer::writeSample[format];
+    int32_t minimum = resamplerMinimum[format];
+    int32_t maximum = resamplerMaximum[format];
+    uint8_t *start = out;
+    int position = historyPosition;
+    int p = phase;
+
+    for (int i = 0; i < samples; i++)
+    {
+        // Append the sample to both halves of the history, so the newest samples are always contiguous at history[position]...
+        int s = readSample(in);
+        in += bytesPerSample;
+
+        history[position] = s;
+        history[position + taps] = s;
+        position = position + 1 == taps ? 0 : position + 1;
+
+        // Generate all output samples that fall between this input sample and the next.
+        while (p < interpolation)
+        {
+            writeSample(out, resampler_dot<ACC>(&coefficients[p * taps], &history[position], taps, minimum, maximum));
+            out += bytesPerSample;
+            p += decimation;
+        }
+
+        p -= interpolation;
+    }
+
+    historyPosition = position;
+    phase = p;
+
+    return (out - start) / bytesPerSample;
+}
+
+/**
+  * Creates a component that converts the sample rate of a stream by the ratio interpolation / decimation.
+  *
+  * @param source a DataSource to receive data from
+  * @param interpolation The numerator of the ratio by which to change the sample rate. (default: 1)
+  * @param decimation The denominator of the ratio by which to change the sample rate. (default: 1)
+  */
+StreamResampler::StreamResampler(DataSource &source, int interpolation, int decimation) : DataSourceSink(source)
+{
+    this->coefficients = NULL;
+    this->history = NULL;
+    this->taps = 0;
+    this->interpolation = 1;
+    this->decimation = 1;
+    CODAL_STREAM_TRACE_INIT("StreamResampler");
+
+    setRatio(interpolation, decimation);
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer StreamResampler::pull()
+{
+    CODAL_STREAM_TRACE_PULL();
+
+    ManagedBuffer input = upStream.pull();
+
+    // Fast path - no conversion required.
+    if (interpolation == 1 && decimation == 1)
+    {
+        CODAL_STREAM_TRACE_BYTES(input.length());
+        return input;
+    }
+
+    int format = upStream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int samples = input.length() / bytesPerSample;
+
+    if (format == DATASTREAM_FORMAT_UNKNOWN || coefficients == NULL)
+        return ManagedBuffer();
+
+    // Allocate space for the largest number of output samples this input could produce.
+    ManagedBuffer output((samples * interpolation / decimation + 1) * bytesPerSample);
+    int outputSamples;
+
+    if (bytesPerSample <= 2)
+        outputSamples = resampler_process<int32_t>(input.getBytes(), samples, bytesPerSample, output.getBytes(), format, coefficients, history, historyPosition, phase, taps, interpolation, decimation);
+    else
+        outputSamples = resampler_process<int64_t>(input.getBytes(), samples, bytesPerSample, output.getBytes(), format, coefficients, history, historyPosition, phase, taps, interpolation, decimation);
+
+    output.truncate(outputSamples * bytesPerSample);
+    CODAL_STREAM_TRACE_BYTES(output.length());
+
+    return output;
+}
+
+/**
+ * Determine the sample rate of the buffers streamed out of this component.
+ * @return the upstream sample rate, scaled by interpolation / decimation.
+ */
+float StreamResampler::getSampleRate()
+{
+    return upStream.getSampleRate() * interpolation / decimation;
+}
+
+/**
+ * Defines the resampling ratio of this component. The ratio is reduced to its simplest form,
+ * and the anti-aliasing filter recalculated.
+ *
+ * @param interpolation The numerator of the ratio by which to change the sample rate.
+ * @param decimation The denominator of the ratio by which to change the sample rate.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the reduced numerator exceeds CONFIG_RESAMPLER_MAX_PHASES,
+ * or DEVICE_NO_RESOURCES if the filter could not be allocated.
+ */
+int StreamResampler::setRatio(int interpolation, int decimation)
+{
+    if (interpolation <= 0 || decimation <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Reduce the ratio to its simplest form.
+    int a = interpolation;
+    int b = decimation;
+    while (b)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    interpolation /= a;
+    decimation /= a;
+
+    if (interpolation > CONFIG_RESAMPLER_MAX_PHASES)
+        return DEVICE_INVALID_PARAMETER;
+
+    // When decimating, widen the filter so that it spans the same number of output sample periods.
+    int tapsPerPhase = CONFIG_RESAMPLER_TAPS_PER_PHASE * ((decimation + interpolation - 1) / interpolation);
+    int taps = interpolation * tapsPerPhase;
+    int16_t *c = (int16_t *) malloc(taps * sizeof(int16_t));
+    int32_t *history = (int32_t *) malloc(2 * tapsPerPhase * sizeof(int32_t));
+
+    if (c == NULL || history == NULL)
+    {
+        free(c);
+        free(history);
+        return DEVICE_NO_RESOURCES;
+    }
+
+    // Design a Blackman windowed-sinc low pass filter at the interpolated sample rate, with its cutoff just below
+    // the lower of the input and output Nyquist frequencies. This is only calculated when the ratio changes.
+    float cutoff = 0.45f / (float) max(interpolation, decimation);
+    float centre = (float)(taps - 1) * 0.5f;
+    float scale = 0.0f;
+    float *h = (float *) malloc(taps * sizeof(float));
+
+    if (h == NULL)
+    {
+        free(c);
+        free(history);
+        return DEVICE_NO_RESOURCES;
+    }
+
+    for (int i = 0; i < taps; i++)
+    {
+        float x = (float)i - centre;
+        float w = 0.42f - 0.5f * cosf(2.0f * (float)PI * (float)i / (float)(taps - 1)) + 0.08f * cosf(4.0f * (float)PI * (float)i / (float)(taps - 1));
+        float sinc = x == 0.0f ? 2.0f * cutoff : sinf(2.0f * (float)PI * cutoff * x) / ((float)PI * x);
+
+        h[i] = sinc * w;
+        scale += h[i];
+    }
+
+    // Normalise for unity gain at DC. Each phase sees 1/L of the taps, so the filter as a whole has a gain of L.
+    scale = (float) interpolation * (float)(1 << RESAMPLER_COEFFICIENT_BITS) / scale;
+
+    // Store the coefficients grouped by phase, in order of oldest to newest sample, so each output sample
+    // is a single contiguous dot product with the history.
+    for (int p = 0; p < interpolation; p++)
+        for (int j = 0; j < tapsPerPhase; j++)
+        {
+            float v = h[p + (tapsPerPhase - 1 - j) * interpolation] * scale;
+            c[p * tapsPerPhase + j] = (int16_t)(v < 0 ? v - 0.5f : v + 0.5f);
+        }
+
+    free(h);
+    memset(history, 0, 2 * tapsPerPhase * sizeof(int32_t));
+
+    target_disable_irq();
+    free(this->coefficients);
+    free(this->history);
+    this->coefficients = c;
+    this->history = history;
+    this->taps = tapsPerPhase;
+    this->interpolation = interpolation;
+    this->decimation = decimation;
+    this->phase = 0;
+    this->historyPosition = 0;
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the sample rate of the buffers streamed out of this component, relative to the current upstream sample rate.
+ * Both rates are rounded to the nearest Hz before the ratio is derived.
+ *
+ * @param sampleRate The output sample rate, in Hz.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the rates cannot be expressed as a supported ratio,
+ * or DEVICE_NOT_SUPPORTED if the upstream sample rate is unknown.
+ */
+int StreamResampler::setSampleRate(float sampleRate)
+{
+    float inputRate = upStream.getSampleRate();
+
+    if (inputRate == DATASTREAM_SAMPLE_RATE_UNKNOWN)
+        return DEVICE_NOT_SUPPORTED;
+
+    return setRatio((int)(sampleRate + 0.5f), (int)(inputRate + 0.5f));
+}
+
+/**
+ * Destructor.
+ */
+StreamResampler::~StreamResampler()
+{
+    free(coefficients);
+    free(history);
+}
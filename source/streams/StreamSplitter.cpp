@@ -35,6 +35,7 @@ SplitterChannel::SplitterChannel( StreamSplitter * parent, DataSink * output = N
 {
     this->parent = parent;
     this->downStream = output;
+    CODAL_STREAM_TRACE_INIT("SplitterChannel");
 }
 
 SplitterChannel::~SplitterChannel()
@@ -80,16 +81,53 @@ ManagedBuffer SplitterChannel::resample( ManagedBuffer _in, uint8_t *buffer, int
 
 uint8_t * SplitterChannel::pullInto( uint8_t * rawBuffer, int length )
 {
-    ManagedBuffer inData = parent->getBuffer();
-    ManagedBuffer result = this->resample( inData, rawBuffer, length );
+    ManagedBuffer result = this->pull();
+    int l = min(length, result.length());
 
-    return rawBuffer + result.length();
+    memcpy(rawBuffer, result.getBytes(), l);
+    return rawBuffer + l;
 }
 
 ManagedBuffer SplitterChannel::pull()
 {
+    CODAL_STREAM_TRACE_PULL();
+
     ManagedBuffer inData = parent->getBuffer();
-    return this->resample( inData ); // Autocreate the output buffer
+
+    // No other channel needs this buffer once the last one has it, so drop the splitter's reference.
+    // A consumer that is the only holder can then modify it in place rather than taking a copy.
+    if (parent->finalChannel == this && !parent->bufferReleased)
+    {
+        parent->lastBuffer = ManagedBuffer();
+        parent->bufferReleased = true;
+    }
+
+    ManagedBuffer result = this->resample( inData ); // Autocreate the output buffer
+
+    // Count the offered buffer as pulled, whenever our consumer gets round to it.
+    if (pending)
+    {
+        pending = false;
+        stats.pulled++;
+        stats.lag = 0;
+
+        if (result.getBytes() == inData.getBytes())
+            stats.shared++;
+    }
+
+    CODAL_STREAM_TRACE_BYTES(result.length());
+
+    return result;
+}
+
+SplitterChannelStatistics SplitterChannel::getStatistics()
+{
+    return stats;
+}
+
+void SplitterChannel::resetStatistics()
+{
+    memset(&stats, 0, sizeof(stats));
 }
 
 int SplitterChannel::getFormat()
@@ -133,6 +171,9 @@ StreamSplitter::StreamSplitter(DataSource &source, uint16_t id) : upstream(sourc
     this->id = id;
     this->channels = 0;
     this->filterFlag = NULL;
+    this->finalChannel = NULL;
+    this->bufferReleased = false;
+    CODAL_STREAM_TRACE_INIT("StreamSplitter");
 
     // init array to NULL.
     for (int i = 0; i < CONFIG_MAX_CHANNELS; i++)
@@ -161,7 +202,8 @@ void StreamSplitter::dataWanted(int wanted)
 
 ManagedBuffer StreamSplitter::getBuffer()
 {
-    if(lastBuffer == ManagedBuffer())
+    // Once the buffer has been handed over, there is no more data until the next pullRequest().
+    if(lastBuffer == ManagedBuffer() && !bufferReleased)
         lastBuffer = upstream.pull();
 
     return lastBuffer;
@@ -172,18 +214,45 @@ ManagedBuffer StreamSplitter::getBuffer()
  */
 int StreamSplitter::pullRequest()
 {
+    CODAL_STREAM_TRACE_PULL_REQUEST();
+
     // Ingress filter if we've been asked to do so.
     if (filterFlag != NULL && *filterFlag == false)
         return DEVICE_OK;
 
-    // For each downstream channel that exists in array outputChannels - make a pullRequest
+    // For each downstream channel that exists in array outputChannels - make a pullRequest.
+    // Every channel that doesn't resample shares the same lastBuffer, so the upstream data is only pulled once.
     for (int i = 0; i < CONFIG_MAX_CHANNELS; i++)
     {
-        if (outputChannels[i] != NULL)
-            outputChannels[i]->pullRequest();
+        SplitterChannel *c = outputChannels[i];
+
+        if (c != NULL)
+        {
+            // Only the last channel may take the buffer over, as no later channel will ask for it.
+            finalChannel = c;
+            for (int j = i + 1; j < CONFIG_MAX_CHANNELS; j++)
+                if (outputChannels[j] != NULL)
+                    finalChannel = NULL;
+
+            // A buffer is only dropped if it's replaced by this one before the consumer pulled it.
+            if (c->pending)
+            {
+                c->stats.dropped++;
+                if (c->stats.lag < 0xFFFF)
+                    c->stats.lag++;
+                if (c->stats.lag > c->stats.maxLag)
+                    c->stats.maxLag = c->stats.lag;
+            }
+
+            c->pending = true;
+            c->stats.offered++;
+            c->pullRequest();
+        }
     }
     
     lastBuffer = ManagedBuffer();
+    finalChannel = NULL;
+    bufferReleased = false;
 
     return DEVICE_BUSY;
 }
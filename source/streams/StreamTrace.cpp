@@ -0,0 +1,184 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "StreamTrace.h"
+
+#if CONFIG_ENABLED(CODAL_STREAM_TRACE)
+
+#include "Timer.h"
+#include "CodalCompat.h"
+#include "CodalDmesg.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+static StreamTraceStage *stages = NULL;
+static StreamTraceScope *currentScope = NULL;
+
+StreamTraceStage::StreamTraceStage()
+{
+    memclr(&stats, sizeof(stats));
+    stats.name = "?";
+    requestTime = 0;
+    requestPending = false;
+    next = NULL;
+
+    // Append, so stages are reported in the order they were created.
+    target_disable_irq();
+
+    StreamTraceStage **p = &stages;
+    while (*p)
+        p = &(*p)->next;
+    *p = this;
+
+    target_enable_irq();
+}
+
+StreamTraceStage::~StreamTraceStage()
+{
+    target_disable_irq();
+
+    for (StreamTraceStage **p = &stages; *p; p = &(*p)->next)
+    {
+        if (*p == this)
+        {
+            *p = next;
+            break;
+        }
+    }
+
+    target_enable_irq();
+}
+
+void StreamTraceStage::setName(const char *name)
+{
+    stats.name = name;
+}
+
+StreamTraceScope::StreamTraceScope(StreamTraceStage &stage, bool isPull) : stage(stage)
+{
+    start = (uint32_t) system_timer_current_time_us();
+    childTimeUs = 0;
+    parent = currentScope;
+    currentScope = this;
+
+    if (isPull)
+    {
+        stage.stats.pulls++;
+
+        // Record how long the data waited for us since we were told it was available.
+        if (stage.requestPending)
+        {
+            uint32_t age = start - stage.requestTime;
+
+            stage.stats.ageUs += age;
+            if (age > stage.stats.maxAgeUs)
+                stage.stats.maxAgeUs = age;
+            stage.requestPending = false;
+        }
+    }
+    else
+    {
+        stage.stats.pullRequests++;
+
+        if (!stage.requestPending)
+        {
+            stage.requestTime = start;
+            stage.requestPending = true;
+        }
+    }
+}
+
+StreamTraceScope::~StreamTraceScope()
+{
+    uint32_t elapsed = (uint32_t) system_timer_current_time_us() - start;
+    uint32_t own = elapsed > childTimeUs ? elapsed - childTimeUs : 0;
+
+    stage.stats.timeUs += own;
+    if (own > stage.stats.maxTimeUs)
+        stage.stats.maxTimeUs = own;
+
+    if (parent)
+        parent->childTimeUs += elapsed;
+
+    currentScope = parent;
+}
+
+int StreamTrace::getStageCount()
+{
+    int count = 0;
+
+    for (StreamTraceStage *s = stages; s; s = s->next)
+        count++;
+
+    return count;
+}
+
+int StreamTrace::snapshot(StreamTraceStats *stats, int count)
+{
+    int i = 0;
+
+    target_disable_irq();
+
+    for (StreamTraceStage *s = stages; s && i < count; s = s->next)
+        stats[i++] = s->stats;
+
+    target_enable_irq();
+
+    return i;
+}
+
+void StreamTrace::reset()
+{
+    target_disable_irq();
+
+    for (StreamTraceStage *s = stages; s; s = s->next)
+    {
+        const char *name = s->stats.name;
+
+        memclr(&s->stats, sizeof(s->stats));
+        s->stats.name = name;
+        s->requestPending = false;
+    }
+
+    target_enable_irq();
+}
+
+void StreamTrace::dmesg()
+{
+    StreamTraceStats stats;
+
+    for (StreamTraceStage *s = stages; s; s = s->next)
+    {
+        // Take a consistent copy, as the pipeline may be running in interrupt context.
+        target_disable_irq();
+        stats = s->stats;
+        target_enable_irq();
+
+        DMESG("%s: pull %d req %d bytes %d us %d max %d age %d max %d", stats.name, stats.pulls, stats.pullRequests, stats.bytes,
+            stats.timeUs, stats.maxTimeUs, stats.pulls ? stats.ageUs / stats.pulls : 0, stats.maxAgeUs);
+    }
+}
+
+#endif
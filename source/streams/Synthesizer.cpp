@@ -24,6 +24,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include "Synthesizer.h"
 #include "CodalFiber.h"
+#include "CodalCompat.h"
 #include "ErrorNo.h"
 
 using namespace codal;
@@ -91,6 +92,103 @@ uint16_t Synthesizer::CustomTone(void *arg, int position) {
     return ((uint16_t*)arg)[position];
 }
 
+// Wavetables, shared between all Synthesizer instances and created on first use.
+// Each holds a single period of SYNTHESIZER_WAVETABLE_SIZE signed samples in Q15.
+static int16_t *sineTable = NULL;
+static int16_t *triangleTable = NULL;
+static int16_t *sawtoothTables = NULL;
+static int16_t *squareTables = NULL;
+
+/*
+ * Creates the sine wavetable, if it doesn't already exist.
+ */
+static int16_t *createSineTable()
+{
+    if (sineTable == NULL)
+    {
+        int16_t *t = (int16_t *) malloc(SYNTHESIZER_WAVETABLE_SIZE * sizeof(int16_t));
+        if (t == NULL)
+            return NULL;
+
+        for (int i = 0; i < SYNTHESIZER_WAVETABLE_SIZE; i++)
+            t[i] = (int16_t) (sinf(2.0f * (float)PI * (float)i / (float)SYNTHESIZER_WAVETABLE_SIZE) * 32767.0f);
+
+        sineTable = t;
+    }
+
+    return sineTable;
+}
+
+/*
+ * Creates the triangle wavetable, if it doesn't already exist.
+ * Harmonics of a triangle wave fall away quickly, so a single table is sufficient.
+ * Like TriangleTone, the waveform begins at its minimum.
+ */
+static int16_t *createTriangleTable()
+{
+    if (triangleTable == NULL)
+    {
+        int16_t *t = (int16_t *) malloc(SYNTHESIZER_WAVETABLE_SIZE * sizeof(int16_t));
+        if (t == NULL)
+            return NULL;
+
+        for (int i = 0; i < SYNTHESIZER_WAVETABLE_SIZE; i++)
+        {
+            int p = i < SYNTHESIZER_WAVETABLE_SIZE / 2 ? i : SYNTHESIZER_WAVETABLE_SIZE - i;
+            t[i] = (int16_t) (((p * 65534) >> (SYNTHESIZER_WAVETABLE_BITS - 1)) - 32767);
+        }
+
+        triangleTable = t;
+    }
+
+    return triangleTable;
+}
+
+/*
+ * Creates a set of band-limited wavetables by additive synthesis, one per octave.
+ * Table n holds harmonics up to (SYNTHESIZER_WAVETABLE_SIZE / 2) >> n, each normalised to full scale.
+ *
+ * @param oddOnly true to sum only odd harmonics (square), false to sum all harmonics (sawtooth).
+ * @param sign The sign of the waveform, such that it begins rising (sawtooth) or high (square), like the equivalent tone prints.
+ */
+static int16_t *createBandLimitedTables(bool oddOnly, int sign)
+{
+    int16_t *sine = createSineTable();
+    int16_t *tables = (int16_t *) malloc(CONFIG_SYNTHESIZER_BANDLIMITED_TABLES * SYNTHESIZER_WAVETABLE_SIZE * sizeof(int16_t));
+
+    if (sine == NULL || tables == NULL)
+    {
+        free(tables);
+        return NULL;
+    }
+
+    for (int n = 0; n < CONFIG_SYNTHESIZER_BANDLIMITED_TABLES; n++)
+    {
+        int16_t *t = tables + n * SYNTHESIZER_WAVETABLE_SIZE;
+        int harmonics = max((SYNTHESIZER_WAVETABLE_SIZE / 2 - 1) >> n, 1);
+        int32_t peak = 1;
+
+        // Two passes: the first finds the peak (including Gibbs overshoot), the second writes the normalised table.
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (int i = 0; i < SYNTHESIZER_WAVETABLE_SIZE; i++)
+            {
+                int32_t s = 0;
+
+                for (int k = 1; k <= harmonics; k += (oddOnly ? 2 : 1))
+                    s += sine[(k * i) & (SYNTHESIZER_WAVETABLE_SIZE - 1)] * (4096 / k);
+
+                if (pass == 0)
+                    peak = max(peak, abs(s));
+                else
+                    t[i] = (int16_t) (sign * (int32_t)(((int64_t)s * 32767) / peak));
+            }
+        }
+    }
+
+    return tables;
+}
+
 /*
  * Simple internal helper funtion that creates a fiber within the givien Synthesizer to handle playback
  */
@@ -113,8 +211,14 @@ Synthesizer::Synthesizer(int sampleRate, bool isSigned) : output(*this)
     this->synchronous = false;
     this->bytesWritten = 0;
     this->setTone(Synthesizer::TriangleTone);
-    this->position = 0;
+    this->phase = 0;
+    this->newPeriodNs = 0;
+    this->voicesEnabled = false;
     this->status |= DEVICE_COMPONENT_STATUS_IDLE_TICK;
+
+    memset(voices, 0, sizeof(voices));
+    for (int i = 0; i < CONFIG_SYNTHESIZER_VOICES; i++)
+        voices[i].volume = 1024;
 }
 
 /**
@@ -183,21 +287,29 @@ Synthesizer::~Synthesizer()
 {
 }
 
+/**
+ * Calculates the phase increment per sample for a waveform of the given period.
+ */
+uint32_t Synthesizer::phaseIncrement(int periodNs)
+{
+    if (periodNs <= 0)
+        return 0;
+
+    // Frequencies above the sample rate alias, exactly as they would if the phase were allowed to wrap.
+    float rate = (float)samplePeriodNs / (float)periodNs;
+    rate -= (float)(int)rate;
+
+    return (uint32_t) (rate * 4294967296.0f);
+}
+
 /**
  * Creates the next audio buffer, and attmepts to queue this on the output stream.
  */
 void Synthesizer::generate(int playoutTimeUs, int envelopeStart, int envelopeEnd)
 {
     int periodNs = newPeriodNs;
+    uint32_t toneIncrement = phaseIncrement(periodNs);  // the phase increment within our tone print for each playout sample.
 
-    int toneDelta;          // the number of samples within our tone print that we increment for each playout sample.
-    int toneSigma;          // the fraction of samples within our tone print (*1000) that we increment for each playout sample.
-
-    float toneRate = periodNs == 0 ? 0 : ((float)samplePeriodNs * (float) TONE_WIDTH) / (float) periodNs;
-    toneDelta = (int) toneRate;
-    toneSigma = (int) ((toneRate - (float)toneDelta) * 1000.0f);
-
-    int sigma = 0;
     int playoutSamples = determineSampleCount(playoutTimeUs);
 
     int localAmplitude = (amplitude * envelopeStart) << 10;
@@ -215,53 +327,65 @@ void Synthesizer::generate(int playoutTimeUs, int envelopeStart, int envelopeEnd
         else
             localAmplitude += localAmplitudeDelta;
 
-        while(bytesWritten < bufferSize)
+        // A silent synthesizer has no waveform period to wait for, so start any new tone immediately.
+        if (periodNs <= 0 && newPeriodNs > 0)
+        {
+            periodNs = newPeriodNs;
+            toneIncrement = phaseIncrement(periodNs);
+            phase = 0;
+        }
+
+        if (periodNs <= 0)
+        {
+            // No tone print is playing, so render the wavetable voices a buffer at a time.
+            int samples = (bufferSize - bytesWritten) / 2;
+
+            if (playoutSamples >= 0 && playoutSamples < samples)
+                samples = playoutSamples;
+
+            renderVoices(ptr, samples, localAmplitude >> 20);
+            bytesWritten += samples * 2;
+
+            if (playoutSamples >= 0)
+                playoutSamples -= samples;
+
+            if (playoutSamples == 0)
+                return;
+        }
+
+        while(bytesWritten < bufferSize && periodNs > 0)
         {
-            if (periodNs <= 0)
-                *ptr = 0;
-            else if (isSigned)
+            int position = phase >> (32 - TONE_WIDTH_BITS);
+
+            if (isSigned)
                 *ptr = (((int)tonePrint(tonePrintArg, position) - 512) * (localAmplitude >> 20)) >> 10;
             else
                 *ptr = (tonePrint(tonePrintArg, position) * (localAmplitude >> 20)) >> 10;
             bytesWritten += 2;
             ptr++;
 
-            position += toneDelta;
-            sigma += toneSigma;
-
             if (playoutSamples >= 0)
                 playoutSamples--;
 
-            if (sigma > 1000)
-            {
-                sigma -= 1000;
-                position++;
-            }
+            phase += toneIncrement;
 
-            while (position >= TONE_WIDTH) // most likely at most one iteration
+            // At the end of each waveform period, apply any change of frequency.
+            // A zero increment means the period divides the sample period exactly, so every sample ends a period.
+            if ((phase < toneIncrement || toneIncrement == 0) && periodNs != newPeriodNs)
             {
-                position -= TONE_WIDTH;
-#ifdef SYNTHESIZER_SIGMA_RESET
-                sigma = 0;
-#endif
-                if (periodNs != newPeriodNs)
-                {
-                    periodNs = newPeriodNs;
-
-                    toneRate = periodNs == 0 ? 0 : ((float)samplePeriodNs * (float) TONE_WIDTH) / (float) periodNs;
-                    toneDelta = (int) toneRate;
-                    toneSigma = (int) ((toneRate - (float)toneDelta) * 1000.0f);
-                    playoutSamples = determineSampleCount(playoutTimeUs);
-
-                    position = 0;
-                    sigma = 0;
-                }
+                periodNs = newPeriodNs;
+                toneIncrement = phaseIncrement(periodNs);
+                playoutSamples = determineSampleCount(playoutTimeUs);
+                phase = 0;
             }
 
             if (playoutSamples == 0)
                 return;
         }
 
+        if (bytesWritten < bufferSize)
+            continue;
+
         bytesWritten = 0;
         output.pullRequest();
 
@@ -274,6 +398,241 @@ void Synthesizer::generate(int playoutTimeUs, int envelopeStart, int envelopeEnd
     }
 }
 
+/**
+ * Renders a single wavetable voice, using linear interpolation between table entries.
+ * The first voice rendered overwrites the buffer, and subsequent voices are added to it.
+ */
+template <bool ACCUMULATE>
+static inline void renderVoice(int16_t *out, int samples, SynthesizerVoice &v, int gain)
+{
+    const int16_t *table = v.table;
+    uint32_t phase = v.phase;
+    uint32_t increment = v.increment;
+
+    while (samples--)
+    {
+        uint32_t i = phase >> (32 - SYNTHESIZER_WAVETABLE_BITS);
+        int32_t f = (phase >> (17 - SYNTHESIZER_WAVETABLE_BITS)) & 0x7FFF;
+        int32_t a = table[i];
+        int32_t b = table[(i + 1) & (SYNTHESIZER_WAVETABLE_SIZE - 1)];
+
+        // Interpolate with a Q15 fraction, so (b - a) * f fits in 32 bits for any pair of 16 bit entries,
+        // then scale to the 10 bit range used by tone prints.
+        int32_t s = ((a + (((b - a) * f) >> 15)) * gain) >> 16;
+
+        *out = ACCUMULATE ? *out + s : s;
+        out++;
+        phase += increment;
+    }
+
+    v.phase = phase;
+}
+
+/**
+ * Renders the sum of all wavetable voices into the given buffer.
+ *
+ * @param out The buffer to write to.
+ * @param samples The number of samples to render.
+ * @param gain The overall gain to apply, in the range 0..1024.
+ */
+void Synthesizer::renderVoices(uint16_t *out, int samples, int gain)
+{
+    int16_t *mix = (int16_t *) out;
+    bool first = true;
+
+    for (int i = 0; i < CONFIG_SYNTHESIZER_VOICES; i++)
+    {
+        SynthesizerVoice &v = voices[i];
+
+        if (!v.on || v.table == NULL)
+            continue;
+
+        int voiceGain = (v.volume * gain) >> 10;
+
+        if (first)
+            renderVoice<false>(mix, samples, v, voiceGain);
+        else
+            renderVoice<true>(mix, samples, v, voiceGain);
+
+        first = false;
+    }
+
+    if (first)
+    {
+        // Nothing is playing. Output silence, centred for unsigned output once voices are in use.
+        uint16_t silence = (voicesEnabled && !isSigned) ? 512 : 0;
+        for (int i = 0; i < samples; i++)
+            out[i] = silence;
+
+        return;
+    }
+
+    // Saturate the mix to the same 10 bit range as tone prints.
+    int offset = isSigned ? 0 : 512;
+    for (int i = 0; i < samples; i++)
+    {
+        int s = mix[i];
+        s = s < -512 ? -512 : s > 511 ? 511 : s;
+        out[i] = (uint16_t) (s + offset);
+    }
+}
+
+/**
+ * Calculates the phase increment and wavetable for a voice, based on its frequency and waveform.
+ */
+void Synthesizer::updateVoice(SynthesizerVoice &v)
+{
+    // Limit the increment to the Nyquist frequency, as the sample rate may have changed since the note was started.
+    float increment = v.frequency * (float)samplePeriodNs * 4.294967296f;
+    v.increment = increment < 2147483648.0f ? (uint32_t) increment : 0x80000000;
+
+    // Select the band-limited table with as many harmonics as possible below the Nyquist frequency.
+    // Table n holds harmonics up to (SYNTHESIZER_WAVETABLE_SIZE / 2) >> n, which is safe while increment < 2^(32 - SYNTHESIZER_WAVETABLE_BITS + n).
+    int n = v.increment ? (32 - __builtin_clz(v.increment)) - (32 - SYNTHESIZER_WAVETABLE_BITS) : 0;
+    n = min(max(n, 0), CONFIG_SYNTHESIZER_BANDLIMITED_TABLES - 1);
+
+    switch (v.waveform)
+    {
+        case SYNTHESIZER_WAVEFORM_SINE:
+            v.table = sineTable;
+            break;
+
+        case SYNTHESIZER_WAVEFORM_TRIANGLE:
+            v.table = triangleTable;
+            break;
+
+        case SYNTHESIZER_WAVEFORM_SAWTOOTH:
+            v.table = sawtoothTables + n * SYNTHESIZER_WAVETABLE_SIZE;
+            break;
+
+        case SYNTHESIZER_WAVEFORM_SQUARE:
+            v.table = squareTables + n * SYNTHESIZER_WAVETABLE_SIZE;
+            break;
+
+        default:
+            v.table = v.custom;
+    }
+}
+
+/**
+ * Defines the waveform played by a wavetable voice.
+ * Sawtooth and square waveforms are band-limited, to avoid aliasing at high frequencies.
+ *
+ * @param voice The voice to configure, in the range 0..CONFIG_SYNTHESIZER_VOICES-1.
+ * @param waveform One of the SYNTHESIZER_WAVEFORM constants.
+ * @param table For SYNTHESIZER_WAVEFORM_CUSTOM, a table of SYNTHESIZER_WAVETABLE_SIZE signed 16 bit samples
+ * describing a single period. The table is not copied, and must remain valid while in use.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if the wavetable could not be allocated.
+ */
+int Synthesizer::setWaveform(int voice, int waveform, const int16_t *table)
+{
+    if (voice < 0 || voice >= CONFIG_SYNTHESIZER_VOICES)
+        return DEVICE_INVALID_PARAMETER;
+
+    switch (waveform)
+    {
+        case SYNTHESIZER_WAVEFORM_SINE:
+            if (createSineTable() == NULL)
+                return DEVICE_NO_RESOURCES;
+            break;
+
+        case SYNTHESIZER_WAVEFORM_TRIANGLE:
+            if (createTriangleTable() == NULL)
+                return DEVICE_NO_RESOURCES;
+            break;
+
+        case SYNTHESIZER_WAVEFORM_SAWTOOTH:
+            if (sawtoothTables == NULL)
+                sawtoothTables = createBandLimitedTables(false, -1);
+            if (sawtoothTables == NULL)
+                return DEVICE_NO_RESOURCES;
+            break;
+
+        case SYNTHESIZER_WAVEFORM_SQUARE:
+            if (squareTables == NULL)
+                squareTables = createBandLimitedTables(true, 1);
+            if (squareTables == NULL)
+                return DEVICE_NO_RESOURCES;
+            break;
+
+        case SYNTHESIZER_WAVEFORM_CUSTOM:
+            if (table == NULL)
+                return DEVICE_INVALID_PARAMETER;
+            break;
+
+        default:
+            return DEVICE_INVALID_PARAMETER;
+    }
+
+    voices[voice].waveform = waveform;
+    voices[voice].custom = table;
+    updateVoice(voices[voice]);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Starts a wavetable voice playing, or changes the frequency and volume of a voice already playing.
+ * Wavetable voices are mixed together, and played whenever no tonePrint frequency is set via setFrequency().
+ *
+ * @param voice The voice to play, in the range 0..CONFIG_SYNTHESIZER_VOICES-1.
+ * @param frequency The frequency, in Hz to generate. Must be below half the sample rate.
+ * @param volume The volume of this voice, in the range 0..1024.
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Synthesizer::noteOn(int voice, float frequency, int volume)
+{
+    if (voice < 0 || voice >= CONFIG_SYNTHESIZER_VOICES || volume < 0 || volume > 1024)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Only frequencies below the Nyquist frequency can be represented (this also rejects NaN).
+    if (!(frequency >= 0.0f && frequency * (float)samplePeriodNs < 500000000.0f))
+        return DEVICE_INVALID_PARAMETER;
+
+    SynthesizerVoice &v = voices[voice];
+
+    // Voices default to a sine wave.
+    if (v.table == NULL && v.waveform == SYNTHESIZER_WAVEFORM_SINE)
+    {
+        int result = setWaveform(voice, SYNTHESIZER_WAVEFORM_SINE);
+        if (result != DEVICE_OK)
+            return result;
+    }
+
+    v.frequency = frequency;
+    v.volume = volume;
+    updateVoice(v);
+    v.on = true;
+    voicesEnabled = true;
+
+    // Voices play in the background, in the same way as setFrequency() with no period.
+    if (!active && !synchronous)
+    {
+        active = true;
+        create_fiber(begin_playback, this);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops a wavetable voice playing.
+ *
+ * @param voice The voice to stop, in the range 0..CONFIG_SYNTHESIZER_VOICES-1.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int Synthesizer::noteOff(int voice)
+{
+    if (voice < 0 || voice >= CONFIG_SYNTHESIZER_VOICES)
+        return DEVICE_INVALID_PARAMETER;
+
+    voices[voice].on = false;
+
+    return DEVICE_OK;
+}
+
 /**
 * Define the volume of the wave to generate.
 * @param volume The new output volume, in the range 0..1024
@@ -329,6 +688,10 @@ float Synthesizer::getSampleRate()
 int Synthesizer::setSampleRate(int sampleRate)
 {
     this->samplePeriodNs = 1000000000 / sampleRate;
+
+    for (int i = 0; i < CONFIG_SYNTHESIZER_VOICES; i++)
+        updateVoice(voices[i]);
+
     return DEVICE_OK;
 }
 
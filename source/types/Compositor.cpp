@@ -0,0 +1,415 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "Compositor.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+static inline int area(const CompositorRegion &r)
+{
+    return r.width * r.height;
+}
+
+static CompositorRegion unite(const CompositorRegion &a, const CompositorRegion &b)
+{
+    CompositorRegion r;
+    r.x = min(a.x, b.x);
+    r.y = min(a.y, b.y);
+    r.width = max(a.x + a.width, b.x + b.width) - r.x;
+    r.height = max(a.y + a.height, b.y + b.height) - r.y;
+    return r;
+}
+
+static bool intersect(const CompositorRegion &a, const CompositorRegion &b, CompositorRegion &r)
+{
+    r.x = max(a.x, b.x);
+    r.y = max(a.y, b.y);
+    r.width = min(a.x + a.width, b.x + b.width) - r.x;
+    r.height = min(a.y + a.height, b.y + b.height) - r.y;
+    return r.width > 0 && r.height > 0;
+}
+
+/**
+  * Constructor.
+  *
+  * @param image The image to show.
+  * @param x The x co-ordinate of the top left of the sprite.
+  * @param y The y co-ordinate of the top left of the sprite.
+  * @param z The z-order of the sprite.
+  */
+Sprite::Sprite(Image image, int x, int y, int z) : image(image)
+{
+    this->x = x;
+    this->y = y;
+    this->z = z;
+    this->colorKey = SPRITE_NO_COLOR_KEY;
+    this->transform = SPRITE_TRANSFORM_NONE;
+    this->visible = true;
+    this->changed = true;
+    this->drawn = false;
+}
+
+void Sprite::setImage(Image image)
+{
+    this->image = image;
+    changed = true;
+}
+
+void Sprite::setPosition(int x, int y)
+{
+    if (x == this->x && y == this->y)
+        return;
+
+    this->x = x;
+    this->y = y;
+    changed = true;
+}
+
+void Sprite::move(int dx, int dy)
+{
+    setPosition(x + dx, y + dy);
+}
+
+void Sprite::setZ(int z)
+{
+    if (z == this->z)
+        return;
+
+    this->z = z;
+    changed = true;
+}
+
+void Sprite::setTransform(uint8_t transform)
+{
+    if (transform == this->transform)
+        return;
+
+    this->transform = transform;
+    changed = true;
+}
+
+void Sprite::setColorKey(int key)
+{
+    if (key == colorKey)
+        return;
+
+    colorKey = key;
+    changed = true;
+}
+
+void Sprite::setVisible(bool visible)
+{
+    if (visible == this->visible)
+        return;
+
+    this->visible = visible;
+    changed = true;
+}
+
+/**
+  * Constructor.
+  *
+  * @param target The image to composite into.
+  */
+Compositor::Compositor(Image target) : target(target), background()
+{
+    backgroundColor = 0;
+    sprites = NULL;
+    spriteCount = 0;
+    spriteCapacity = 0;
+    dirtyCount = 0;
+    updatedCount = 0;
+
+    invalidate();
+}
+
+/**
+  * Destructor.
+  */
+Compositor::~Compositor()
+{
+    free(sprites);
+}
+
+int Compositor::add(Sprite &sprite)
+{
+    for (int i = 0; i < spriteCount; i++)
+        if (sprites[i] == &sprite)
+            return DEVICE_INVALID_PARAMETER;
+
+    if (spriteCount == spriteCapacity)
+    {
+        spriteCapacity = spriteCapacity ? spriteCapacity * 2 : 4;
+        sprites = (Sprite **)realloc(sprites, spriteCapacity * sizeof(Sprite *));
+    }
+
+    sprites[spriteCount++] = &sprite;
+    sprite.drawn = false;
+    sprite.changed = true;
+
+    return DEVICE_OK;
+}
+
+int Compositor::remove(Sprite &sprite)
+{
+    for (int i = 0; i < spriteCount; i++)
+    {
+        if (sprites[i] == &sprite)
+        {
+            if (sprite.drawn)
+                addDirtyRegion(sprite.drawnRegion);
+
+            memmove(&sprites[i], &sprites[i + 1], (spriteCount - i - 1) * sizeof(Sprite *));
+            spriteCount--;
+            sprite.drawn = false;
+
+            return DEVICE_OK;
+        }
+    }
+
+    return DEVICE_INVALID_PARAMETER;
+}
+
+void Compositor::setBackground(uint8_t color)
+{
+    background = Image();
+    backgroundColor = color;
+    invalidate();
+}
+
+void Compositor::setBackground(Image image)
+{
+    background = image;
+    invalidate();
+}
+
+void Compositor::invalidate()
+{
+    invalidate(0, 0, target.getWidth(), target.getHeight());
+}
+
+void Compositor::invalidate(int x, int y, int width, int height)
+{
+    CompositorRegion r;
+    r.x = x;
+    r.y = y;
+    r.width = width;
+    r.height = height;
+
+    addDirtyRegion(r);
+}
+
+/**
+  * Adds a region to be recomposited, merging it with any it overlaps.
+  */
+void Compositor::addDirtyRegion(CompositorRegion r)
+{
+    CompositorRegion bounds = {0, 0, (int16_t)target.getWidth(), (int16_t)target.getHeight()};
+    CompositorRegion overlap;
+
+    if (!intersect(r, bounds, r))
+        return;
+
+    // Merge with any region that overlaps this one, or that it fits with without covering more pixels than the two alone.
+    // Merging can make the result overlap regions already passed over, so start again after each one.
+    for (int i = 0; i < dirtyCount; i++)
+    {
+        CompositorRegion u = unite(r, dirty[i]);
+
+        if (intersect(r, dirty[i], overlap) || area(u) <= area(r) + area(dirty[i]))
+        {
+            r = u;
+            dirty[i] = dirty[--dirtyCount];
+            i = -1;
+        }
+    }
+
+    if (dirtyCount < COMPOSITOR_MAX_DIRTY_REGIONS)
+    {
+        dirty[dirtyCount++] = r;
+        return;
+    }
+
+    // Out of regions, so merge with the one that grows the least.
+    int best = 0;
+    int bestGrowth = INT32_MAX;
+
+    for (int i = 0; i < dirtyCount; i++)
+    {
+        int growth = area(unite(r, dirty[i])) - area(dirty[i]);
+
+        if (growth < bestGrowth)
+        {
+            best = i;
+            bestGrowth = growth;
+        }
+    }
+
+    dirty[best] = unite(r, dirty[best]);
+}
+
+/**
+  * Redraws the background and sprites within one region of the target.
+  */
+void Compositor::composite(const CompositorRegion &r)
+{
+    int stride = target.getWidth();
+    uint8_t *out = target.getBitmap() + r.y * stride + r.x;
+
+    // Background first.
+    CompositorRegion bg = {0, 0, (int16_t)background.getWidth(), (int16_t)background.getHeight()};
+    CompositorRegion bgPart;
+    bool hasBackground = background.getBitmap() != Image::EmptyImage.getBitmap() && intersect(r, bg, bgPart);
+
+    for (int row = 0; row < r.height; row++)
+    {
+        uint8_t *p = out + row * stride;
+        int py = r.y + row;
+
+        if (hasBackground && py >= bgPart.y && py < bgPart.y + bgPart.height)
+        {
+            int left = bgPart.x - r.x;
+            int right = r.x + r.width - (bgPart.x + bgPart.width);
+
+            memset(p, backgroundColor, left);
+            memcpy(p + left, background.getBitmap() + py * background.getWidth() + bgPart.x, bgPart.width);
+            memset(p + left + bgPart.width, backgroundColor, right);
+        }
+        else
+        {
+            memset(p, backgroundColor, r.width);
+        }
+    }
+
+    // Then each sprite, lowest z first.
+    for (int i = 0; i < spriteCount; i++)
+    {
+        Sprite *s = sprites[i];
+        CompositorRegion clip;
+
+        if (!s->drawn || !intersect(r, s->drawnRegion, clip))
+            continue;
+
+        int w = s->image.getWidth();
+        int h = s->image.getHeight();
+        bool flipX = s->transform & SPRITE_TRANSFORM_FLIP_X;
+        bool flipY = s->transform & SPRITE_TRANSFORM_FLIP_Y;
+
+        // Work out where the top left pixel on screen comes from, and how far through the source image
+        // each step to the right (du) and down (dv) on screen moves. This covers all eight orientations.
+        int base, du, dv;
+
+        if (s->transform & SPRITE_TRANSFORM_ROTATE_90)
+        {
+            base = (flipX ? 0 : (h - 1) * w) + (flipY ? w - 1 : 0);
+            du = flipX ? w : -w;
+            dv = flipY ? -1 : 1;
+        }
+        else
+        {
+            base = (flipY ? (h - 1) * w : 0) + (flipX ? w - 1 : 0);
+            du = flipX ? -1 : 1;
+            dv = flipY ? -w : w;
+        }
+
+        const uint8_t *src = s->image.getBitmap() + base + (clip.x - s->x) * du + (clip.y - s->y) * dv;
+        uint8_t *dst = target.getBitmap() + clip.y * stride + clip.x;
+
+        for (int row = 0; row < clip.height; row++)
+        {
+            if (s->colorKey == SPRITE_NO_COLOR_KEY && du == 1)
+            {
+                memcpy(dst, src, clip.width);
+            }
+            else
+            {
+                const uint8_t *p = src;
+
+                for (int col = 0; col < clip.width; col++, p += du)
+                    if (*p != s->colorKey)
+                        dst[col] = *p;
+            }
+
+            src += dv;
+            dst += stride;
+        }
+    }
+}
+
+/**
+  * Recomposites every region affected by changes since the last render.
+  *
+  * @return The number of regions updated.
+  */
+int Compositor::render()
+{
+    // Keep the sprites in z order. This is a single pass when nothing has changed.
+    for (int i = 1; i < spriteCount; i++)
+    {
+        Sprite *s = sprites[i];
+        int j = i;
+
+        while (j > 0 && sprites[j - 1]->z > s->z)
+        {
+            sprites[j] = sprites[j - 1];
+            j--;
+        }
+
+        sprites[j] = s;
+    }
+
+    // Both where a changed sprite was, and where it is now, need redrawing.
+    for (int i = 0; i < spriteCount; i++)
+    {
+        Sprite *s = sprites[i];
+
+        if (!s->changed)
+            continue;
+
+        if (s->drawn)
+            addDirtyRegion(s->drawnRegion);
+
+        s->drawnRegion.x = s->x;
+        s->drawnRegion.y = s->y;
+        s->drawnRegion.width = s->getWidth();
+        s->drawnRegion.height = s->getHeight();
+        s->drawn = s->visible;
+        s->changed = false;
+
+        if (s->drawn)
+            addDirtyRegion(s->drawnRegion);
+    }
+
+    for (int i = 0; i < dirtyCount; i++)
+        composite(dirty[i]);
+
+    memcpy(updated, dirty, dirtyCount * sizeof(CompositorRegion));
+    updatedCount = dirtyCount;
+    dirtyCount = 0;
+
+    return updatedCount;
+}
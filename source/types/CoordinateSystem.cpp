@@ -27,6 +27,66 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+/**
+ * Determines which input axis, and with which sign, provides each axis of a transformed sample.
+ * This applies the same inversion, rotation and coordinate system steps as CoordinateSpace::transform(),
+ * to a mapping rather than to a sample.
+ */
+static void getAxisMapping(const CoordinateSpace &space, CoordinateSystem system, int *axis, int *sign)
+{
+    int temp;
+
+    for (int i = 0; i < 3; i++)
+    {
+        axis[i] = i;
+        sign[i] = 1;
+    }
+
+    if (system == RAW)
+        return;
+
+    if (space.upsidedown)
+    {
+        sign[1] = -sign[1];
+        sign[2] = -sign[2];
+    }
+
+    switch (space.rotated)
+    {
+        case COORDINATE_SPACE_ROTATED_90:
+            temp = axis[0]; axis[0] = axis[1]; axis[1] = temp;
+            temp = sign[0]; sign[0] = sign[1]; sign[1] = -temp;
+            break;
+
+        case COORDINATE_SPACE_ROTATED_180:
+            sign[0] = -sign[0];
+            sign[1] = -sign[1];
+            break;
+
+        case COORDINATE_SPACE_ROTATED_270:
+            temp = axis[0]; axis[0] = axis[1]; axis[1] = temp;
+            temp = sign[0]; sign[0] = -sign[1]; sign[1] = temp;
+            break;
+    }
+
+    switch (system)
+    {
+        case NORTH_EAST_DOWN:
+            sign[1] = -sign[1];
+            sign[2] = -sign[2];
+            break;
+
+        case SIMPLE_CARTESIAN:
+            temp = axis[0]; axis[0] = axis[1]; axis[1] = temp;
+            temp = sign[0]; sign[0] = sign[1]; sign[1] = temp;
+            sign[2] = -sign[2];
+            break;
+
+        default:                    // EAST_NORTH_UP
+            break;
+    }
+}
+
 /**
  * Constructor.
  *
@@ -124,3 +184,41 @@ Sample3D CoordinateSpace::transform(Sample3D s, CoordinateSystem system)
 
 }
 
+/**
+ * Transforms an array of 3D x,y,z tuples from ENU format into the format defined in this instance.
+ * The transformation is determined once for the whole array, then applied to every sample without branching.
+ *
+ * @param in the sample points to convert, in ENU format.
+ * @param out the array to store the converted samples. May be the same as in.
+ * @param count the number of samples to convert.
+ * @param system The coordinate system to use in the result.
+ */
+void CoordinateSpace::transform(const Sample3D *in, Sample3D *out, int count, CoordinateSystem system)
+{
+    int axis[3];
+    int sign[3];
+
+    getAxisMapping(*this, system, axis, sign);
+
+    for (int i = 0; i < count; i++)
+    {
+        int v[3] = { in[i].x, in[i].y, in[i].z };
+
+        out[i].x = sign[0] * v[axis[0]];
+        out[i].y = sign[1] * v[axis[1]];
+        out[i].z = sign[2] * v[axis[2]];
+    }
+}
+
+/**
+ * Transforms an array of 3D x,y,z tuples from ENU format into the format defined in this instance.
+ *
+ * @param in the sample points to convert, in ENU format.
+ * @param out the array to store the converted samples. May be the same as in.
+ * @param count the number of samples to convert.
+ */
+void CoordinateSpace::transform(const Sample3D *in, Sample3D *out, int count)
+{
+    transform(in, out, count, system);
+}
+
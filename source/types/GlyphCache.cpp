@@ -0,0 +1,223 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "GlyphCache.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+#define GLYPH_ROW_MASK ((1 << BITMAP_FONT_WIDTH) - 1)
+
+/**
+  * Constructor.
+  *
+  * @param font The font to render.
+  *
+  * @param bpp The pixel format to render into: 8 for an Image, or 1, 2 or 4 for a PackedImage of that depth.
+  */
+GlyphCache::GlyphCache(BitmapFont font, int bpp) : font(font)
+{
+    if (bpp != 1 && bpp != 2 && bpp != 4)
+        bpp = 8;
+
+    bitsPerPixel = bpp;
+    rowWords = (BITMAP_FONT_WIDTH * bpp + 31) >> 5;
+    rows = (uint32_t *)malloc((1 << BITMAP_FONT_WIDTH) * rowWords * 4);
+
+    // Expand every possible row pattern. In the font, the leftmost column is the most significant bit.
+    uint32_t max = bpp == 8 ? 0xff : (1 << bpp) - 1;
+
+    for (int r = 0; r < (1 << BITMAP_FONT_WIDTH); r++)
+    {
+        uint32_t *row = rows + r * rowWords;
+        memclr(row, rowWords * 4);
+
+        for (int col = 0; col < BITMAP_FONT_WIDTH; col++)
+        {
+            if (r & ((1 << (BITMAP_FONT_WIDTH - 1)) >> col))
+            {
+                if (bpp == 8)
+                    ((uint8_t *)row)[col] = max;
+                else
+                    row[0] |= max << (col * bpp);
+            }
+        }
+    }
+}
+
+/**
+  * Destructor.
+  */
+GlyphCache::~GlyphCache()
+{
+    free(rows);
+}
+
+/**
+  * Changes the font used for rendering.
+  *
+  * @param font The font to render.
+  */
+void GlyphCache::setFont(BitmapFont font)
+{
+    this->font = font;
+}
+
+/**
+  * Look up the glyph for the given character.
+  */
+const uint8_t *GlyphCache::getGlyph(char c)
+{
+    if (c < BITMAP_FONT_ASCII_START || c > font.asciiEnd)
+        return NULL;
+
+    return font.get(c);
+}
+
+/**
+  * Draws a character into an Image, clipped to the bounds of the image.
+  */
+int GlyphCache::drawChar(Image &image, char c, int x, int y)
+{
+    const uint8_t *v = getGlyph(c);
+
+    if (v == NULL || bitsPerPixel != 8)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Clip the glyph cell to the image.
+    int x0 = max(x, 0);
+    int x1 = min(x + BITMAP_FONT_WIDTH, image.getWidth());
+    int y0 = max(y, 0);
+    int y1 = min(y + BITMAP_FONT_HEIGHT, image.getHeight());
+
+    if (x0 >= x1)
+        return DEVICE_OK;
+
+    uint8_t *pOut = image.getBitmap() + y0 * image.getWidth() + x0;
+    v += y0 - y;
+
+    // Each row is a straight copy of the pre-expanded pattern.
+    for (int row = y0; row < y1; row++)
+    {
+        memcpy(pOut, (uint8_t *)(rows + (*v++ & GLYPH_ROW_MASK) * rowWords) + (x0 - x), x1 - x0);
+        pOut += image.getWidth();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Draws a character into a PackedImage, clipped to the bounds of the image.
+  */
+int GlyphCache::drawChar(PackedImage &image, char c, int x, int y)
+{
+    const uint8_t *v = getGlyph(c);
+    int bpp = bitsPerPixel;
+
+    if (v == NULL || image.getBitsPerPixel() != bpp)
+        return DEVICE_INVALID_PARAMETER;
+
+    int x0 = max(x, 0);
+    int x1 = min(x + BITMAP_FONT_WIDTH, image.getWidth());
+    int y0 = max(y, 0);
+    int y1 = min(y + BITMAP_FONT_HEIGHT, image.getHeight());
+
+    if (x0 >= x1)
+        return DEVICE_OK;
+
+    // A glyph row is at most BITMAP_FONT_WIDTH * 4 bits, so it spans at most two words of the image.
+    int skip = (x0 - x) * bpp;
+    int bits = (x1 - x0) * bpp;
+    uint32_t mask = (1U << bits) - 1;
+    int bit = x0 * bpp;
+    int s = bit & 31;
+    uint32_t *pOut = image.getBitmap() + y0 * image.getStride() + (bit >> 5);
+    v += y0 - y;
+
+    for (int row = y0; row < y1; row++)
+    {
+        uint32_t pattern = (rows[*v++ & GLYPH_ROW_MASK] >> skip) & mask;
+
+        pOut[0] = (pOut[0] & ~(mask << s)) | (pattern << s);
+
+        if (s + bits > 32)
+            pOut[1] = (pOut[1] & ~(mask >> (32 - s))) | (pattern >> (32 - s));
+
+        pOut += image.getStride();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Draws a string into an Image, one character every BITMAP_FONT_WIDTH + spacing pixels.
+  */
+int GlyphCache::drawText(Image &image, ManagedString s, int x, int y, int spacing)
+{
+    if (bitsPerPixel != 8)
+        return DEVICE_INVALID_PARAMETER;
+
+    for (int i = 0; i < s.length() && x < image.getWidth(); i++, x += BITMAP_FONT_WIDTH + spacing)
+    {
+        if (x + BITMAP_FONT_WIDTH > 0 && drawChar(image, s.charAt(i), x, y) != DEVICE_OK)
+            drawChar(image, ' ', x, y);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Draws a string into a PackedImage, one character every BITMAP_FONT_WIDTH + spacing pixels.
+  */
+int GlyphCache::drawText(PackedImage &image, ManagedString s, int x, int y, int spacing)
+{
+    if (image.getBitsPerPixel() != bitsPerPixel)
+        return DEVICE_INVALID_PARAMETER;
+
+    for (int i = 0; i < s.length() && x < image.getWidth(); i++, x += BITMAP_FONT_WIDTH + spacing)
+    {
+        if (x + BITMAP_FONT_WIDTH > 0 && drawChar(image, s.charAt(i), x, y) != DEVICE_OK)
+            drawChar(image, ' ', x, y);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Gets the shared 8 bit per pixel cache for the current system font.
+  */
+GlyphCache &GlyphCache::getSystemCache()
+{
+    static GlyphCache *systemCache = NULL;
+
+    if (systemCache == NULL)
+        systemCache = new GlyphCache(BitmapFont::getSystemFont());
+
+    // The system font may have been changed since we were last called.
+    systemCache->setFont(BitmapFont::getSystemFont());
+
+    return *systemCache;
+}
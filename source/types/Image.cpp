@@ -32,6 +32,7 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 #include "Image.h"
 #include "BitmapFont.h"
+#include "GlyphCache.h"
 #include "CodalCompat.h"
 #include "ManagedString.h"
 #include "ErrorNo.h"
@@ -577,35 +578,14 @@ int Image::paste(const Image &image, int16_t x, int16_t y, uint8_t alpha)
   */
 int Image::print(char c, int16_t x, int16_t y)
 {
-    const uint8_t *v;
-    int x1, y1;
-
     BitmapFont font = BitmapFont::getSystemFont();
 
     // Sanity check. Silently ignore anything out of bounds.
     if (x >= getWidth() || y >= getHeight() || c < BITMAP_FONT_ASCII_START || c > font.asciiEnd)
         return DEVICE_INVALID_PARAMETER;
 
-    // Paste.
-    v = font.get(c);
-
-    for (int row=0; row<BITMAP_FONT_HEIGHT; row++)
-    {
-        // Update our Y co-ord write position
-        y1 = y+row;
-
-        for (int col = 0; col < BITMAP_FONT_WIDTH; col++)
-        {
-            // Update our X co-ord write position
-            x1 = x+col;
-
-            if (x1 < getWidth() && y1 < getHeight())
-                this->getBitmap()[y1*getWidth()+x1] = ((*v) & (0x10 >> col)) ? 255 : 0;
-        }
-        v++;
-    }
-
-    return DEVICE_OK;
+    // Paste, a whole row of the glyph at a time.
+    return GlyphCache::getSystemCache().drawChar(*this, c, x, y);
 }
 
 
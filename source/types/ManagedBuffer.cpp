@@ -35,6 +35,25 @@ REF_COUNTED_DEF_EMPTY(0, 0)
 using namespace std;
 using namespace codal;
 
+/**
+  * Allocates a new BufferData on the heap.
+  *
+  * @param data The data with which to fill the buffer, or NULL.
+  * @param length The length of the buffer to create, in bytes. Must be greater than zero.
+  */
+static BufferData *allocateData(const uint8_t *data, int length)
+{
+    BufferData *p = (BufferData *) malloc(sizeof(BufferData) + length);
+    REF_COUNTED_INIT(p);
+
+    p->length = length;
+
+    if (data)
+        memcpy(p->payload, data, length);
+
+    return p;
+}
+
 /**
   * Internal constructor helper.
   * Configures this ManagedBuffer to refer to the static empty buffer.
@@ -42,6 +61,52 @@ using namespace codal;
 void ManagedBuffer::initEmpty()
 {
     ptr = EMPTY_DATA;
+    viewOffset = 0;
+    viewLength = 0;
+}
+
+/**
+  * Adds a reference to the data held by the given buffer.
+  */
+void ManagedBuffer::assign(const ManagedBuffer &buffer)
+{
+    ptr = buffer.ptr;
+    viewOffset = buffer.viewOffset;
+    viewLength = buffer.viewLength;
+
+#if CODAL_MANAGED_BUFFER_INLINE_SIZE > 0
+    if (ptr == NULL)
+    {
+        memcpy(inlineData, buffer.inlineData, viewLength);
+        return;
+    }
+#endif
+
+    ptr->incr();
+}
+
+/**
+  * Removes our reference to the data we hold.
+  */
+void ManagedBuffer::release()
+{
+    if (ptr)
+        ptr->decr();
+}
+
+/**
+  * Ensures this buffer is the only reference to writable data, copying its bytes if required.
+  */
+void ManagedBuffer::makeWritable()
+{
+    if (viewLength == 0 || !isShared())
+        return;
+
+    BufferData *p = allocateData(data(), viewLength);
+    ptr->decr();
+
+    ptr = p;
+    viewOffset = 0;
 }
 
 /**
@@ -107,19 +172,20 @@ ManagedBuffer::ManagedBuffer(uint8_t *data, int length)
  */
 ManagedBuffer::ManagedBuffer(const ManagedBuffer &buffer)
 {
-    ptr = buffer.ptr;
-    ptr->incr();
+    assign(buffer);
 }
 
 /**
   * Constructor.
-  * Create a buffer from a raw BufferData pointer. It will ptr->incr(). This is to be used by specialized runtimes.
+  * Create a buffer covering the whole of a raw BufferData pointer. It will ptr->incr(). This is to be used by specialized runtimes.
   *
   * @param p The pointer to use.
   */
 ManagedBuffer::ManagedBuffer(BufferData *p)
 {
     ptr = p;
+    viewOffset = 0;
+    viewLength = p->length;
     ptr->incr();
 }
 
@@ -138,17 +204,25 @@ void ManagedBuffer::init(uint8_t *data, int length, BufferInitialize initialize)
         return;
     }
 
-    ptr = (BufferData *) malloc(sizeof(BufferData) + length);
-    REF_COUNTED_INIT(ptr);
+    viewOffset = 0;
+    viewLength = length;
 
-    ptr->length = length;
+#if CODAL_MANAGED_BUFFER_INLINE_SIZE > 0
+    if (length <= CODAL_MANAGED_BUFFER_INLINE_SIZE)
+    {
+        ptr = NULL;
 
-    // Copy in the data buffer, if provided.
-    if (data)
-        memcpy(ptr->payload, data, length);
+        if (data)
+            memcpy(inlineData, data, length);
+    }
+    else
+#endif
+    {
+        ptr = allocateData(data, length);
+    }
 
     if (initialize == BufferInitialize::Zero)
-        memset(ptr->payload, 0, length);
+        memset(getBytes(), 0, length);
 }
 
 /**
@@ -157,7 +231,7 @@ void ManagedBuffer::init(uint8_t *data, int length, BufferInitialize initialize)
  */
 ManagedBuffer::~ManagedBuffer()
 {
-    ptr->decr();
+    release();
 }
 
 /**
@@ -181,12 +255,18 @@ ManagedBuffer::~ManagedBuffer()
  */
 ManagedBuffer& ManagedBuffer::operator = (const ManagedBuffer &p)
 {
-    if(ptr == p.ptr)
+    if(this == &p)
         return *this;
 
-    ptr->decr();
-    ptr = p.ptr;
-    ptr->incr();
+    if(ptr != NULL && ptr == p.ptr)
+    {
+        viewOffset = p.viewOffset;
+        viewLength = p.viewLength;
+        return *this;
+    }
+
+    release();
+    assign(p);
 
     return *this;
 }
@@ -212,10 +292,13 @@ ManagedBuffer& ManagedBuffer::operator = (const ManagedBuffer &p)
  */
 bool ManagedBuffer::operator== (const ManagedBuffer& p)
 {
-    if (ptr == p.ptr)
+    if (viewLength != p.viewLength)
+        return false;
+
+    if (ptr != NULL && ptr == p.ptr && viewOffset == p.viewOffset)
         return true;
-    else
-        return (ptr->length == p.ptr->length && (memcmp(ptr->payload, p.ptr->payload, ptr->length)==0));
+
+    return memcmp(data(), p.data(), viewLength) == 0;
 }
 
 /**
@@ -232,9 +315,10 @@ bool ManagedBuffer::operator== (const ManagedBuffer& p)
  */
 int ManagedBuffer::setByte(int position, uint8_t value)
 {
-    if (0 <= position && (uint16_t)position < ptr->length)
+    if (0 <= position && (uint16_t)position < viewLength)
     {
-        ptr->payload[position] = value;
+        makeWritable();
+        data()[position] = value;
         return DEVICE_OK;
     }
     else
@@ -258,8 +342,8 @@ int ManagedBuffer::setByte(int position, uint8_t value)
  */
 int ManagedBuffer::getByte(int position)
 {
-    if (0 <= position && (uint16_t)position < ptr->length)
-        return ptr->payload[position];
+    if (0 <= position && (uint16_t)position < viewLength)
+        return data()[position];
     else
         return DEVICE_INVALID_PARAMETER;
 }
@@ -271,6 +355,19 @@ int ManagedBuffer::getByte(int position)
 BufferData *ManagedBuffer::leakData()
 {
     BufferData* res = ptr;
+
+    if (viewLength == 0)
+    {
+        release();
+        res = EMPTY_DATA;
+    }
+    else if (ptr == NULL || viewOffset != 0 || viewLength != ptr->length)
+    {
+        // Runtimes expect a BufferData holding exactly our bytes.
+        res = allocateData(data(), viewLength);
+        release();
+    }
+
     initEmpty();
     return res;
 }
@@ -278,37 +375,65 @@ BufferData *ManagedBuffer::leakData()
 
 int ManagedBuffer::fill(uint8_t value, int offset, int length)
 {
-    if (offset < 0 || (uint16_t)offset > ptr->length)
+    if (offset < 0 || (uint16_t)offset > viewLength)
         return DEVICE_INVALID_PARAMETER;
     if (length < 0)
-        length = (int)ptr->length;
-    length = min(length, (int)ptr->length - offset);
+        length = (int)viewLength;
+    length = min(length, (int)viewLength - offset);
 
-    memset(ptr->payload + offset, value, length);
+    if (length > 0)
+    {
+        makeWritable();
+        memset(data() + offset, value, length);
+    }
 
     return DEVICE_OK;
 }
 
 ManagedBuffer ManagedBuffer::slice(int offset, int length) const
 {
-    offset = min((int)ptr->length, offset);
+    offset = min((int)viewLength, offset);
     if (length < 0)
-        length = (int)ptr->length;
-    length = min(length, (int)ptr->length - offset);
-    return ManagedBuffer(ptr->payload + offset, length);
+        length = (int)viewLength;
+    length = min(length, (int)viewLength - offset);
+    return ManagedBuffer(data() + offset, length);
+}
+
+ManagedBuffer ManagedBuffer::view(int offset, int length) const
+{
+    offset = max(0, min((int)viewLength, offset));
+    if (length < 0)
+        length = (int)viewLength;
+    length = min(length, (int)viewLength - offset);
+
+    if (length <= 0)
+        return ManagedBuffer();
+
+#if CODAL_MANAGED_BUFFER_INLINE_SIZE > 0
+    if (ptr == NULL)
+        return ManagedBuffer(data() + offset, length);
+#endif
+
+    ManagedBuffer b(*this);
+    b.viewOffset += offset;
+    b.viewLength = length;
+
+    return b;
 }
 
 void ManagedBuffer::shift(int offset, int start, int len)
 {
-    if (len < 0) len = (int)ptr->length - start;
-    if (start < 0 || start + len > (int)ptr->length || start + len < start
+    if (len < 0) len = (int)viewLength - start;
+    if (start < 0 || start + len > (int)viewLength || start + len < start
         || len == 0 || offset == 0 || offset == INT_MIN) return;
     if (offset <= -len || offset >= len) {
         fill(0, start, len);
         return;
     }
 
-    uint8_t *data = ptr->payload + start;
+    makeWritable();
+
+    uint8_t *data = this->data() + start;
     if (offset < 0) {
         offset = -offset;
         memmove(data + offset, data, len - offset);
@@ -322,8 +447,8 @@ void ManagedBuffer::shift(int offset, int start, int len)
 
 void ManagedBuffer::rotate(int offset, int start, int len)
 {
-    if (len < 0) len = (int)ptr->length - start;
-    if (start < 0 || start + len > (int)ptr-> length || start + len < start
+    if (len < 0) len = (int)viewLength - start;
+    if (start < 0 || start + len > (int)viewLength || start + len < start
         || len == 0 || offset == 0 || offset == INT_MIN) return;
 
     if (offset < 0)
@@ -332,7 +457,9 @@ void ManagedBuffer::rotate(int offset, int start, int len)
     if (offset < 0)
         offset += len;
 
-    uint8_t *data = ptr->payload + start;
+    makeWritable();
+
+    uint8_t *data = this->data() + start;
 
     uint8_t *n_first = data + offset;
     uint8_t *first = data;
@@ -356,18 +483,21 @@ int ManagedBuffer::writeBuffer(int dstOffset, const ManagedBuffer &src, int srcO
     if (length < 0)
         length = src.length();
 
-    if (srcOffset < 0 || dstOffset < 0 || dstOffset > (int)ptr->length)
+    if (srcOffset < 0 || dstOffset < 0 || dstOffset > (int)viewLength)
         return DEVICE_INVALID_PARAMETER;
 
-    length = min(src.length() - srcOffset, (int)ptr->length - dstOffset);
+    length = min(src.length() - srcOffset, (int)viewLength - dstOffset);
 
     if (length < 0)
         return DEVICE_INVALID_PARAMETER;
 
+    // src holds its own reference, so its bytes remain valid even if we take a private copy here.
+    makeWritable();
+
     if (ptr == src.ptr) {
-        memmove(getBytes() + dstOffset, src.ptr->payload + srcOffset, length);
+        memmove(data() + dstOffset, src.data() + srcOffset, length);
     } else {
-        memcpy(getBytes() + dstOffset, src.ptr->payload + srcOffset, length);
+        memcpy(data() + dstOffset, src.data() + srcOffset, length);
     }
 
     return DEVICE_OK;
@@ -375,15 +505,18 @@ int ManagedBuffer::writeBuffer(int dstOffset, const ManagedBuffer &src, int srcO
 
 int ManagedBuffer::writeBytes(int offset, uint8_t *src, int length, bool swapBytes)
 {
-    if (offset < 0 || length < 0 || offset + length > (int)ptr->length)
+    if (offset < 0 || length < 0 || offset + length > (int)viewLength)
         return DEVICE_INVALID_PARAMETER;
 
+    if (length > 0)
+        makeWritable();
+
     if (swapBytes) {
-        uint8_t *p = ptr->payload + offset + length;
+        uint8_t *p = data() + offset + length;
         for (int i = 0; i < length; ++i)
             *--p = src[i];
     } else {
-        memcpy(ptr->payload + offset, src, length);
+        memcpy(data() + offset, src, length);
     }
 
     return DEVICE_OK;
@@ -391,15 +524,15 @@ int ManagedBuffer::writeBytes(int offset, uint8_t *src, int length, bool swapByt
 
 int ManagedBuffer::readBytes(uint8_t *dst, int offset, int length, bool swapBytes) const
 {
-    if (offset < 0 || length < 0 || offset + length > (int)ptr->length)
+    if (offset < 0 || length < 0 || offset + length > (int)viewLength)
         return DEVICE_INVALID_PARAMETER;
 
     if (swapBytes) {
-        uint8_t *p = ptr->payload + offset + length;
+        uint8_t *p = data() + offset + length;
         for (int i = 0; i < length; ++i)
             dst[i] = *--p;
     } else {
-        memcpy(dst, ptr->payload + offset, length);
+        memcpy(dst, data() + offset, length);
     }
 
     return DEVICE_OK;
@@ -407,10 +540,14 @@ int ManagedBuffer::readBytes(uint8_t *dst, int offset, int length, bool swapByte
 
 int ManagedBuffer::truncate(int length)
 {
-    if (length < 0 || length > (int)ptr->length)
+    if (length < 0 || length > (int)viewLength)
         return DEVICE_INVALID_PARAMETER;
 
-    ptr->length = length;
+    // Keep the BufferData length accurate for runtimes, unless other buffers still refer to the original length.
+    if (ptr != NULL && viewOffset == 0 && viewLength == ptr->length && !isShared())
+        ptr->length = length;
+
+    viewLength = length;
 
     return DEVICE_OK;
 }
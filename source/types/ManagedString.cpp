@@ -47,6 +47,7 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 #include "ManagedString.h"
 #include "CodalCompat.h"
+#include "CodalFormat.h"
 
 using namespace codal;
 
@@ -55,6 +56,9 @@ using namespace codal;
 
 REF_COUNTED_DEF_EMPTY(0, 0)
 
+// Strings returned by ManagedString::intern(). Entries are filled in order and never removed.
+static StringData *internTable[CODAL_MANAGED_STRING_INTERN_SIZE];
+
 
 /**
   * Internal constructor helper.
@@ -130,10 +134,9 @@ StringData* ManagedString::leakData()
   */
 ManagedString::ManagedString(const int value)
 {
-    char str[12];
+    char str[CODAL_FORMAT_DECIMAL_SIZE];
 
-    itoa(value, str);
-    initString(str, strlen(str));
+    initString(str, format_decimal(str, value));
 }
 
 /**
@@ -350,7 +353,10 @@ ManagedString& ManagedString::operator = (const ManagedString& s)
   */
 bool ManagedString::operator== (const ManagedString& s)
 {
-    return ((length() == s.length()) && (strcmp(toCharArray(),s.toCharArray())==0));
+    if (ptr == s.ptr)
+        return true;
+
+    return ((length() == s.length()) && (memcmp(toCharArray(), s.toCharArray(), length())==0));
 }
 
 /**
@@ -400,6 +406,9 @@ bool ManagedString::operator!= (const ManagedString& s)
   */
 bool ManagedString::operator< (const ManagedString& s)
 {
+    if (ptr == s.ptr)
+        return false;
+
     return (strcmp(toCharArray(), s.toCharArray())<0);
 }
 
@@ -425,6 +434,9 @@ bool ManagedString::operator< (const ManagedString& s)
   */
 bool ManagedString::operator> (const ManagedString& s)
 {
+    if (ptr == s.ptr)
+        return false;
+
     return (strcmp(toCharArray(), s.toCharArray())>0);
 }
 
@@ -506,6 +518,41 @@ char ManagedString::charAt(int16_t index)
     return (index >=0 && index < length()) ? ptr->data[index] : 0;
 }
 
+/**
+  * Provides the shared, interned copy of a string.
+  *
+  * The first time a given string is interned, it is added to a small table and held there for the
+  * lifetime of the program. Interning an equal string later returns the same character buffer,
+  * so equality tests between interned strings are a single pointer comparison.
+  * This is intended for strings that are compared frequently, such as keys, commands and names.
+  * If the table is full, the string is returned unchanged.
+  *
+  * @param s The string to intern.
+  *
+  * @return a ManagedString equal to s, sharing its buffer with all other interned copies.
+  */
+ManagedString ManagedString::intern(const ManagedString &s)
+{
+    int i;
+
+    for (i = 0; i < CODAL_MANAGED_STRING_INTERN_SIZE && internTable[i] != NULL; i++)
+    {
+        StringData *p = internTable[i];
+
+        if (p == s.ptr || (p->len == s.ptr->len && memcmp(p->data, s.ptr->data, p->len) == 0))
+            return ManagedString(p);
+    }
+
+    // Hold a reference in the table, so the buffer outlives every string that uses it.
+    if (i < CODAL_MANAGED_STRING_INTERN_SIZE && s.length() > 0)
+    {
+        s.ptr->incr();
+        internTable[i] = s.ptr;
+    }
+
+    return s;
+}
+
 /**
   * Empty string constant literal
   */
@@ -0,0 +1,224 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ManagedStringBuilder.h"
+#include "CodalCompat.h"
+#include "CodalFormat.h"
+#include "ErrorNo.h"
+
+#define REF_TAG REF_TAG_STRING
+
+// The smallest buffer allocated, to avoid repeated reallocation while building short strings.
+#define MANAGED_STRING_BUILDER_MIN_CAPACITY     16
+
+// The longest string ManagedString can represent, as it reports its length() as an int16_t.
+#define MANAGED_STRING_BUILDER_MAX_CAPACITY     0x7fff
+
+using namespace codal;
+
+/**
+  * Constructor.
+  *
+  * @param capacity The number of characters to allocate space for up front. Defaults to allocating on first use.
+  */
+ManagedStringBuilder::ManagedStringBuilder(int capacity)
+{
+    this->ptr = NULL;
+    this->capacity = 0;
+
+    if (capacity > 0)
+        reserve(capacity);
+}
+
+/**
+  * Destructor.
+  * Releases any string still under construction.
+  */
+ManagedStringBuilder::~ManagedStringBuilder()
+{
+    if (ptr)
+        ptr->decr();
+}
+
+/**
+  * Ensures the buffer can hold at least the given number of characters.
+  *
+  * @param length The number of characters required.
+  *
+  * @return DEVICE_OK, or DEVICE_NO_RESOURCES if the memory could not be allocated.
+  */
+int ManagedStringBuilder::reserve(int length)
+{
+    if (ptr && length <= capacity)
+        return DEVICE_OK;
+
+    if (length > MANAGED_STRING_BUILDER_MAX_CAPACITY)
+        return DEVICE_NO_RESOURCES;
+
+    // Grow geometrically, so the cost of copying is amortized over the characters appended.
+    int newCapacity = max(length, max(capacity * 2, MANAGED_STRING_BUILDER_MIN_CAPACITY));
+    newCapacity = min(newCapacity, MANAGED_STRING_BUILDER_MAX_CAPACITY);
+
+    StringData *p = (StringData *) realloc(ptr, sizeof(StringData) + newCapacity + 1);
+
+    if (p == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    if (ptr == NULL)
+    {
+        REF_COUNTED_INIT(p);
+        p->len = 0;
+        p->data[0] = 0;
+    }
+
+    ptr = p;
+    capacity = newCapacity;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Appends characters to the string.
+  *
+  * @param str The characters to append.
+  * @param length The number of characters to append.
+  *
+  * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if the string could not be extended.
+  */
+int ManagedStringBuilder::append(const char *str, int length)
+{
+    if (length < 0 || (str == NULL && length > 0))
+        return DEVICE_INVALID_PARAMETER;
+
+    if (length == 0)
+        return DEVICE_OK;
+
+    int len = this->length();
+
+    if (length > MANAGED_STRING_BUILDER_MAX_CAPACITY - len || reserve(len + length) != DEVICE_OK)
+        return DEVICE_NO_RESOURCES;
+
+    memcpy(ptr->data + len, str, length);
+    ptr->len = len + length;
+    ptr->data[ptr->len] = 0;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Appends a NULL terminated character array to the string.
+  *
+  * @param str The characters to append.
+  *
+  * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, or DEVICE_NO_RESOURCES if the string could not be extended.
+  */
+int ManagedStringBuilder::append(const char *str)
+{
+    if (str == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    return append(str, strlen(str));
+}
+
+/**
+  * Appends a ManagedString to the string.
+  *
+  * @param s The string to append.
+  *
+  * @return DEVICE_OK, or DEVICE_NO_RESOURCES if the string could not be extended.
+  */
+int ManagedStringBuilder::append(const ManagedString &s)
+{
+    return append(s.toCharArray(), s.length());
+}
+
+/**
+  * Appends a single character to the string.
+  *
+  * @param c The character to append.
+  *
+  * @return DEVICE_OK, or DEVICE_NO_RESOURCES if the string could not be extended.
+  */
+int ManagedStringBuilder::append(char c)
+{
+    return append(&c, 1);
+}
+
+/**
+  * Appends the decimal representation of an integer to the string.
+  *
+  * @param value The integer to append.
+  *
+  * @return DEVICE_OK, or DEVICE_NO_RESOURCES if the string could not be extended.
+  */
+int ManagedStringBuilder::append(int value)
+{
+    char buffer[CODAL_FORMAT_DECIMAL_SIZE];
+
+    return append(buffer, format_decimal(buffer, value));
+}
+
+/**
+  * Discards the string under construction, keeping the allocated buffer for reuse.
+  */
+void ManagedStringBuilder::clear()
+{
+    if (ptr)
+    {
+        ptr->len = 0;
+        ptr->data[0] = 0;
+    }
+}
+
+/**
+  * Provides the string built so far, and resets this builder to empty.
+  *
+  * The buffer is shrunk to fit and handed over to the returned ManagedString, so the characters are not copied.
+  *
+  * @return a ManagedString holding the appended characters.
+  */
+ManagedString ManagedStringBuilder::toString()
+{
+    if (length() == 0)
+        return ManagedString();
+
+    StringData *p = ptr;
+
+    if (p->len < capacity)
+    {
+        StringData *shrunk = (StringData *) realloc(p, sizeof(StringData) + p->len + 1);
+
+        if (shrunk)
+            p = shrunk;
+    }
+
+    ptr = NULL;
+    capacity = 0;
+
+    // The new ManagedString takes its own reference, so release the one we hold.
+    ManagedString s(p);
+    p->decr();
+
+    return s;
+}
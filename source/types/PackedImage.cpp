@@ -0,0 +1,492 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2021 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "PackedImage.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+#define REF_TAG REF_TAG_PACKED_IMAGE
+#define EMPTY_DATA ((PackedImageData*)(void*)emptyData)
+
+// A 0x0 image at 1 bit per pixel, with no bitmap, so every accessor rejects it.
+// REF_COUNTED_DEF_EMPTY() can't be used, as it doesn't give the same layout with and without DEVICE_TAG.
+#if CONFIG_ENABLED(DEVICE_TAG)
+static const uint16_t emptyData[] __attribute__((aligned(4))) = {0xffff, REF_TAG, 0, 0, 1, 0};
+#else
+static const uint16_t emptyData[] __attribute__((aligned(4))) = {0xffff, 0, 0, 1, 0};
+#endif
+
+/**
+  * Read 32 bits from a packed row, starting at the given bit offset.
+  * Anything beyond the end of the row reads as zero.
+  */
+static inline uint32_t fetchBits(const uint32_t *row, int stride, int bit)
+{
+    int i = bit >> 5;
+    int s = bit & 31;
+    uint32_t lo = i < stride ? row[i] : 0;
+
+    if (s == 0)
+        return lo;
+
+    uint32_t hi = i + 1 < stride ? row[i + 1] : 0;
+    return (lo >> s) | (hi << (32 - s));
+}
+
+/**
+  * Compute a mask covering every non-zero pixel in a word of packed pixels.
+  */
+static inline uint32_t opaqueMask(uint32_t v, int bpp)
+{
+    if (bpp == 1)
+        return v;
+
+    if (bpp == 2)
+    {
+        v = (v | (v >> 1)) & 0x55555555;
+        return v | (v << 1);
+    }
+
+    v |= v >> 1;
+    v = (v | (v >> 2)) & 0x11111111;
+    return v * 0xf;
+}
+
+/**
+  * Copy a run of bits from one packed row to another, a destination word at a time.
+  *
+  * @return the number of bits written.
+  */
+static int copyBits(uint32_t *dst, int dstBit, const uint32_t *src, int srcStride, int srcBit, int bits, int bpp, bool alpha)
+{
+    int written = 0;
+
+    while (bits > 0)
+    {
+        int s = dstBit & 31;
+        int n = min(32 - s, bits);
+        uint32_t mask = n == 32 ? 0xffffffff : (1U << n) - 1;
+        uint32_t v = fetchBits(src, srcStride, srcBit) & mask;
+
+        if (alpha)
+            mask = opaqueMask(v, bpp);
+
+        uint32_t *p = dst + (dstBit >> 5);
+        *p = (*p & ~(mask << s)) | (v << s);
+        written += alpha ? __builtin_popcount(mask) : n;
+
+        dstBit += n;
+        srcBit += n;
+        bits -= n;
+    }
+
+    return written;
+}
+
+PackedImage::PackedImage()
+{
+    init_empty();
+}
+
+PackedImage::PackedImage(PackedImageData *p)
+{
+    if(p == NULL)
+    {
+        init_empty();
+        return;
+    }
+
+    ptr = p;
+    ptr->incr();
+}
+
+PackedImage::PackedImage(const int16_t x, const int16_t y, int bpp)
+{
+    init(x, y, bpp);
+}
+
+PackedImage::PackedImage(const Image &image, int bpp)
+{
+    init(image.getWidth(), image.getHeight(), bpp);
+
+    if (ptr == EMPTY_DATA)
+        return;
+
+    // Scale 0-255 to 0-max, rounding up so no lit pixel is lost, and build up each word before storing it.
+    int max = getMaxValue();
+    const uint8_t *pIn = ((Image &)image).getBitmap();
+    uint32_t *row = getBitmap();
+
+    for (int y = 0; y < getHeight(); y++)
+    {
+        uint32_t word = 0;
+        int s = 0;
+        uint32_t *pOut = row;
+
+        for (int x = 0; x < getWidth(); x++)
+        {
+            word |= (uint32_t)((*pIn++ * max + 254) / 255) << s;
+            s += bpp;
+
+            if (s == 32)
+            {
+                *pOut++ = word;
+                word = 0;
+                s = 0;
+            }
+        }
+
+        if (s)
+            *pOut = word;
+
+        row += getStride();
+    }
+}
+
+PackedImage::PackedImage(const PackedImage &image)
+{
+    ptr = image.ptr;
+    ptr->incr();
+}
+
+PackedImage::~PackedImage()
+{
+    ptr->decr();
+}
+
+void PackedImage::init_empty()
+{
+    ptr = EMPTY_DATA;
+}
+
+void PackedImage::init(const int16_t x, const int16_t y, int bpp)
+{
+    // sanity check size and depth of image
+    if(x < 0 || y < 0 || (bpp != 1 && bpp != 2 && bpp != 4))
+    {
+        init_empty();
+        return;
+    }
+
+    int stride = (x * bpp + 31) >> 5;
+
+    ptr = (PackedImageData*)malloc(sizeof(PackedImageData) + stride * y * 4);
+    REF_COUNTED_INIT(ptr);
+    ptr->width = x;
+    ptr->height = y;
+    ptr->bitsPerPixel = bpp;
+    ptr->stride = stride;
+
+    clear();
+}
+
+PackedImage& PackedImage::operator = (const PackedImage& i)
+{
+    if(ptr == i.ptr)
+        return *this;
+
+    ptr->decr();
+    ptr = i.ptr;
+    ptr->incr();
+
+    return *this;
+}
+
+bool PackedImage::operator== (const PackedImage& i)
+{
+    if (ptr == i.ptr)
+        return true;
+
+    // The padding bits are always clear, so whole rows can be compared.
+    return (ptr->width == i.ptr->width && ptr->height == i.ptr->height && ptr->bitsPerPixel == i.ptr->bitsPerPixel &&
+            memcmp(ptr->data, i.ptr->data, ptr->stride * ptr->height * 4) == 0);
+}
+
+void PackedImage::clear()
+{
+    memclr(getBitmap(), getStride() * getHeight() * 4);
+}
+
+int PackedImage::setPixelValue(int16_t x , int16_t y, uint8_t value)
+{
+    //sanity check
+    if(x >= getWidth() || y >= getHeight() || x < 0 || y < 0 || value > getMaxValue())
+        return DEVICE_INVALID_PARAMETER;
+
+    int bit = x * getBitsPerPixel();
+    uint32_t *p = getBitmap() + y * getStride() + (bit >> 5);
+    int s = bit & 31;
+
+    *p = (*p & ~((uint32_t)getMaxValue() << s)) | ((uint32_t)value << s);
+    return DEVICE_OK;
+}
+
+int PackedImage::getPixelValue(int16_t x , int16_t y)
+{
+    //sanity check
+    if(x >= getWidth() || y >= getHeight() || x < 0 || y < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    int bit = x * getBitsPerPixel();
+    return (getBitmap()[y * getStride() + (bit >> 5)] >> (bit & 31)) & getMaxValue();
+}
+
+int PackedImage::paste(const PackedImage &image, int16_t x, int16_t y, uint8_t alpha)
+{
+    int bpp = getBitsPerPixel();
+
+    if (image.getBitsPerPixel() != bpp)
+        return DEVICE_INVALID_PARAMETER;
+
+    // We permit writes that overlap us, but ones that are clearly out of scope we can filter early.
+    if (x >= getWidth() || y >= getHeight() || x+image.getWidth() <= 0 || y+image.getHeight() <= 0)
+        return 0;
+
+    // Calculate the number of pixels we need to copy in each dimension.
+    int cx = x < 0 ? min(image.getWidth() + x, getWidth()) : min(image.getWidth(), getWidth() - x);
+    int cy = y < 0 ? min(image.getHeight() + y, getHeight()) : min(image.getHeight(), getHeight() - y);
+
+    const uint32_t *pIn = image.ptr->data + (y < 0 ? -y * image.getStride() : 0);
+    uint32_t *pOut = getBitmap() + (y > 0 ? y * getStride() : 0);
+    int srcBit = x < 0 ? -x * bpp : 0;
+    int dstBit = x > 0 ? x * bpp : 0;
+    int bitsWritten = 0;
+
+    for (int i = 0; i < cy; i++)
+    {
+        bitsWritten += copyBits(pOut, dstBit, pIn, image.getStride(), srcBit, cx * bpp, bpp, alpha);
+        pIn += image.getStride();
+        pOut += getStride();
+    }
+
+    return bitsWritten / bpp;
+}
+
+int PackedImage::shiftLeft(int16_t n)
+{
+    if (n <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (n >= getWidth())
+    {
+        clear();
+        return DEVICE_OK;
+    }
+
+    int bits = n * getBitsPerPixel();
+    int k = bits >> 5;
+    int s = bits & 31;
+    int stride = getStride();
+    int last = stride - k - 1;
+    uint32_t *row = getBitmap();
+
+    // Words are only ever read from at or beyond the one being written, so this can be done in place.
+    // The clear padding bits blank fill the rightmost columns.
+    for (int y = 0; y < getHeight(); y++)
+    {
+        if (s == 0)
+        {
+            memmove(row, row + k, (last + 1) * 4);
+        }
+        else
+        {
+            for (int i = 0; i < last; i++)
+                row[i] = (row[i + k] >> s) | (row[i + k + 1] << (32 - s));
+
+            row[last] = row[stride - 1] >> s;
+        }
+
+        memclr(row + last + 1, k * 4);
+        row += stride;
+    }
+
+    return DEVICE_OK;
+}
+
+int PackedImage::shiftRight(int16_t n)
+{
+    if (n <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (n >= getWidth())
+    {
+        clear();
+        return DEVICE_OK;
+    }
+
+    int bits = n * getBitsPerPixel();
+    int k = bits >> 5;
+    int s = bits & 31;
+    int stride = getStride();
+    int tailBits = (getWidth() * getBitsPerPixel()) & 31;
+    uint32_t tailMask = tailBits ? (1U << tailBits) - 1 : 0xffffffff;
+    uint32_t *row = getBitmap();
+
+    for (int y = 0; y < getHeight(); y++)
+    {
+        // Work from the right, so words are only ever read from at or before the one being written.
+        if (s == 0)
+        {
+            memmove(row + k, row, (stride - k) * 4);
+        }
+        else
+        {
+            for (int i = stride - 1; i > k; i--)
+                row[i] = (row[i - k] << s) | (row[i - k - 1] >> (32 - s));
+
+            row[k] = row[0] << s;
+        }
+
+        memclr(row, k * 4);
+
+        // Drop the pixels shifted off the right hand edge.
+        row[stride - 1] &= tailMask;
+        row += stride;
+    }
+
+    return DEVICE_OK;
+}
+
+int PackedImage::shiftUp(int16_t n)
+{
+    if (n <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (n >= getHeight())
+    {
+        clear();
+        return DEVICE_OK;
+    }
+
+    int rowBytes = getStride() * 4;
+
+    memmove(getBitmap(), getBitmap() + n * getStride(), (getHeight() - n) * rowBytes);
+    memclr(getBitmap() + (getHeight() - n) * getStride(), n * rowBytes);
+
+    return DEVICE_OK;
+}
+
+int PackedImage::shiftDown(int16_t n)
+{
+    if (n <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (n >= getHeight())
+    {
+        clear();
+        return DEVICE_OK;
+    }
+
+    int rowBytes = getStride() * 4;
+
+    memmove(getBitmap() + n * getStride(), getBitmap(), (getHeight() - n) * rowBytes);
+    memclr(getBitmap(), n * rowBytes);
+
+    return DEVICE_OK;
+}
+
+PackedImage PackedImage::crop(int startx, int starty, int cropWidth, int cropHeight)
+{
+    if (startx < 0)
+    {
+        cropWidth += startx;
+        startx = 0;
+    }
+
+    if (starty < 0)
+    {
+        cropHeight += starty;
+        starty = 0;
+    }
+
+    cropWidth = min(cropWidth, getWidth() - startx);
+    cropHeight = min(cropHeight, getHeight() - starty);
+
+    if (cropWidth <= 0 || cropHeight <= 0)
+        return PackedImage();
+
+    int bpp = getBitsPerPixel();
+    PackedImage cropped(cropWidth, cropHeight, bpp);
+
+    const uint32_t *pIn = getBitmap() + starty * getStride();
+    uint32_t *pOut = cropped.getBitmap();
+
+    for (int y = 0; y < cropHeight; y++)
+    {
+        copyBits(pOut, 0, pIn, getStride(), startx * bpp, cropWidth * bpp, bpp, false);
+        pIn += getStride();
+        pOut += cropped.getStride();
+    }
+
+    return cropped;
+}
+
+Image PackedImage::toImage()
+{
+    Image image(getWidth(), getHeight());
+
+    int bpp = getBitsPerPixel();
+    int max = getMaxValue();
+    int scale = 255 / max;
+    uint8_t *pOut = image.getBitmap();
+    const uint32_t *row = getBitmap();
+
+    for (int y = 0; y < getHeight(); y++)
+    {
+        const uint32_t *pIn = row;
+        uint32_t word = 0;
+        int s = 32;
+
+        for (int x = 0; x < getWidth(); x++)
+        {
+            if (s == 32)
+            {
+                word = *pIn++;
+                s = 0;
+            }
+
+            *pOut++ = ((word >> s) & max) * scale;
+            s += bpp;
+        }
+
+        row += getStride();
+    }
+
+    return image;
+}
+
+bool PackedImage::isReadOnly()
+{
+    return ptr->isReadOnly();
+}
+
+PackedImage PackedImage::clone()
+{
+    PackedImage image(getWidth(), getHeight(), getBitsPerPixel());
+    memcpy(image.getBitmap(), getBitmap(), getStride() * getHeight() * 4);
+    return image;
+}